@@ -0,0 +1,10 @@
+# Benchmarks; each prints its results and exits. See the README.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    codec \
+    load \
+    raster \
+    replay \
+    scaling \
+    session
@@ -0,0 +1,22 @@
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-codec
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+
+SOURCES += \
+    main.cpp \
+    ../../sessionlog.cpp \
+    ../../strokelog.cpp \
+    ../../strokeraster.cpp
+
+HEADERS += \
+    ../../sessionlog.h \
+    ../../strokelog.h \
+    ../../strokeraster.h
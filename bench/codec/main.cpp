@@ -0,0 +1,244 @@
+#include "sessionlog.h"
+#include "snapshotcodec.h"
+#include "strokelog.h"
+#include "strokeraster.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QDebug>
+
+// Snapshot formats on real canvases: encode and decode time and size of
+// PNG, QOI and deflated QOI. With --session the canvases are the pictures of
+// a recording made with DRAWGAME_RECORD, one per round plus every snapshot
+// it received; without it they are random-walk drawings of a few sizes, as
+// in bench-replay. The best of a few runs is taken.
+
+namespace {
+
+constexpr int kWidth = 800;
+constexpr int kHeight = 600;
+
+struct Canvas {
+    QString name;
+    QImage image;
+};
+
+QImage blankCanvas()
+{
+    QImage image(kWidth, kHeight, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    return image;
+}
+
+QVector<Canvas> generatedCanvases(const QString &counts)
+{
+    QVector<Canvas> canvases;
+    for (const QString &count : counts.split(',', Qt::SkipEmptyParts)) {
+        const int segments = qMax(1, count.trimmed().toInt());
+        QRandomGenerator random(1);
+        StrokeLog log;
+        quint32 strokeId = 0;
+        while (log.segmentCount() < segments) {
+            const QColor color = QColor::fromHsv(random.bounded(360), 200, 200);
+            const int width = 1 + random.bounded(20);
+            const bool eraser = random.bounded(10) == 0;
+            const int length = qMin(segments - log.segmentCount(), 8 + random.bounded(56));
+            QPoint from(random.bounded(kWidth), random.bounded(kHeight));
+            ++strokeId;
+            for (int i = 0; i < length; ++i) {
+                const QPoint to(qBound(0, from.x() + random.bounded(-12, 13), kWidth - 1),
+                                qBound(0, from.y() + random.bounded(-12, 13), kHeight - 1));
+                log.addSegment(from, to, color, eraser, width, strokeId);
+                from = to;
+            }
+        }
+        QImage image = blankCanvas();
+        log.paint(&image);
+        canvases.append({ QString("%1 segments").arg(segments), image });
+    }
+    return canvases;
+}
+
+// Rebuilds the canvas the way a client applies what it draws and receives;
+// undo and tiles are left out, they do not change what a round looks like
+// for the codecs.
+QVector<Canvas> recordedCanvases(const SessionLog::Reader &log)
+{
+    QVector<Canvas> canvases;
+    QImage canvas = blankCanvas();
+    bool drawn = false;
+    int penWidth = 3;
+    int round = 1;
+
+    auto drawStroke = [&](const QPoint *points, int count, Protocol::PenParams pen) {
+        if (pen.width < 0)
+            pen.width = penWidth;
+        const QColor color = pen.eraser ? QColor(Qt::white) : pen.color;
+        StrokeRaster::drawPolyline(&canvas, points, count, color.rgb(), pen.width);
+        drawn = true;
+    };
+
+    for (int i = 0; i < log.count(); ++i) {
+        Protocol::Message message;
+        if (!log.at(i).decode(&message))
+            continue;
+
+        switch (message.type) {
+        case Protocol::MessageType::Params:
+            if (message.pen.width > 0)
+                penWidth = message.pen.width;
+            break;
+        case Protocol::MessageType::Draw: {
+            const QPoint points[2] = { message.segment.from, message.segment.to };
+            drawStroke(points, 2, message.segment.pen);
+            break;
+        }
+        case Protocol::MessageType::Stroke:
+            if (message.stroke.points.size() >= 2)
+                drawStroke(message.stroke.points.constData(), message.stroke.points.size(), message.stroke.pen);
+            break;
+        case Protocol::MessageType::Clear:
+            if (drawn)
+                canvases.append({ QString("round %1").arg(round), canvas });
+            ++round;
+            canvas = blankCanvas();
+            drawn = false;
+            break;
+        case Protocol::MessageType::Image: {
+            QImage image;
+            if (!SnapshotCodec::decode(message.image, &image))
+                break;
+            canvases.append({ QString("snapshot at %1 s").arg(log.at(i).usecs / 1e6, 0, 'f', 1), image });
+            canvas = image.convertToFormat(QImage::Format_RGB32);
+            drawn = true;
+            break;
+        }
+        case Protocol::MessageType::StrokeLog: {
+            StrokeLog strokeLog;
+            if (!StrokeLog::decode(message.strokeLog, &strokeLog))
+                break;
+            canvas = blankCanvas();
+            strokeLog.paint(&canvas);
+            canvases.append({ QString("stroke log at %1 s").arg(log.at(i).usecs / 1e6, 0, 'f', 1), canvas });
+            drawn = true;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (drawn)
+        canvases.append({ QString("round %1").arg(round), canvas });
+    return canvases;
+}
+
+struct Result {
+    qint64 bytes = 0;
+    qint64 encodeNsecs = 0;
+    qint64 decodeNsecs = 0;
+};
+
+bool measure(const QImage &image, SnapshotCodec::Format format, int repeat, Result *result)
+{
+    QElapsedTimer timer;
+    QByteArray data;
+    qint64 bestEncode = -1;
+    qint64 bestDecode = -1;
+    for (int i = 0; i < repeat; ++i) {
+        timer.start();
+        data = SnapshotCodec::encode(image, format);
+        const qint64 nsecs = timer.nsecsElapsed();
+        if (bestEncode < 0 || nsecs < bestEncode)
+            bestEncode = nsecs;
+    }
+    for (int i = 0; i < repeat; ++i) {
+        QImage decoded;
+        timer.restart();
+        const bool ok = SnapshotCodec::decode(data, &decoded);
+        const qint64 nsecs = timer.nsecsElapsed();
+        if (!ok || decoded.size() != image.size())
+            return false;
+        if (bestDecode < 0 || nsecs < bestDecode)
+            bestDecode = nsecs;
+    }
+    result->bytes += data.size();
+    result->encodeNsecs += bestEncode;
+    result->decodeNsecs += bestDecode;
+    return true;
+}
+
+QString describe(SnapshotCodec::Format format, const Result &result)
+{
+    return QString("%1 %2 KB, encode %3 ms, decode %4 ms")
+        .arg(QString(SnapshotCodec::formatName(format)), -4)
+        .arg(result.bytes / 1024.0, 0, 'f', 1)
+        .arg(result.encodeNsecs / 1e6, 0, 'f', 2)
+        .arg(result.decodeNsecs / 1e6, 0, 'f', 2);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Snapshot codec speed and size.");
+    parser.addHelpOption();
+    QCommandLineOption sessionOption("session", "Take the canvases from a session recorded with DRAWGAME_RECORD.",
+                                     "file");
+    QCommandLineOption segmentsOption("segments", "Comma separated generated canvas sizes in segments.", "counts",
+                                      "1000,10000,50000");
+    QCommandLineOption repeatOption("repeat", "Runs per canvas and format; the fastest counts.", "count", "5");
+    parser.addOption(sessionOption);
+    parser.addOption(segmentsOption);
+    parser.addOption(repeatOption);
+    parser.process(a);
+
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+
+    QVector<Canvas> canvases;
+    if (parser.isSet(sessionOption)) {
+        SessionLog::Reader log;
+        if (!log.open(parser.value(sessionOption))) {
+            qCritical().noquote() << "Cannot open recording" << parser.value(sessionOption) << ":"
+                                  << log.errorString();
+            return 1;
+        }
+        canvases = recordedCanvases(log);
+        if (canvases.isEmpty()) {
+            qCritical() << "the recording has nothing drawn in it";
+            return 1;
+        }
+    } else {
+        canvases = generatedCanvases(parser.value(segmentsOption));
+    }
+
+    const SnapshotCodec::Format formats[] = { SnapshotCodec::Format::Png, SnapshotCodec::Format::Qoi,
+                                              SnapshotCodec::Format::QoiDeflate };
+    Result totals[3];
+    for (const Canvas &canvas : canvases) {
+        qInfo().noquote() << QString("%1 (%2x%3):").arg(canvas.name).arg(canvas.image.width())
+                                 .arg(canvas.image.height());
+        for (int f = 0; f < 3; ++f) {
+            Result result;
+            if (!measure(canvas.image, formats[f], repeat, &result)) {
+                qCritical() << SnapshotCodec::formatName(formats[f]) << "does not round-trip";
+                return 1;
+            }
+            totals[f].bytes += result.bytes;
+            totals[f].encodeNsecs += result.encodeNsecs;
+            totals[f].decodeNsecs += result.decodeNsecs;
+            qInfo().noquote() << "   " << describe(formats[f], result);
+        }
+    }
+
+    if (canvases.size() > 1) {
+        qInfo().noquote() << QString("all %1 canvases:").arg(canvases.size());
+        for (int f = 0; f < 3; ++f)
+            qInfo().noquote() << "   " << describe(formats[f], totals[f]);
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+# Fan-out latency and server CPU for one room of N guessers, built from the
+# load-test bots.
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-load
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+
+INCLUDEPATH += ../../bot
+
+SOURCES += \
+    main.cpp \
+    ../../bot/botclient.cpp \
+    ../../bot/loadrunner.cpp \
+    ../../strokelog.cpp \
+    ../../strokeraster.cpp
+
+HEADERS += \
+    ../../bot/botclient.h \
+    ../../bot/loadrunner.h \
+    ../../strokelog.h \
+    ../../strokeraster.h
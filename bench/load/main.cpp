@@ -0,0 +1,58 @@
+#include "loadrunner.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QDebug>
+
+// One room, one drawer and N guessers against a freshly started
+// drawgame-server per run: the stroke-to-render latency is the time from the
+// drawer writing a stroke to a guesser painting it, so it covers the server's
+// decode, fan-out and send queues. Server CPU and memory come from /proc.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    // bench/load/bench-load and server/drawgame-server in the same build tree
+    const QString builtServer = QCoreApplication::applicationDirPath() + "/../../server/drawgame-server";
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Room server fan-out latency and CPU for one room of N guessers.");
+    parser.addHelpOption();
+    QCommandLineOption serverOption("server", "drawgame-server binary to start for every run.", "path",
+                                    builtServer);
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Port for the started server.", "port", "12399");
+    QCommandLineOption guessersOption("guessers", "Comma separated guesser counts, one run each.", "counts",
+                                      "10,20,50");
+    QCommandLineOption secondsOption(QStringList() << "s" << "seconds", "Length of each run.", "seconds", "10");
+    QCommandLineOption strokesOption("strokes-per-second", "Strokes sent by the drawer.", "rate", "20");
+    QCommandLineOption pointsOption("points", "Points in a stroke.", "count", "16");
+    parser.addOption(serverOption);
+    parser.addOption(portOption);
+    parser.addOption(guessersOption);
+    parser.addOption(secondsOption);
+    parser.addOption(strokesOption);
+    parser.addOption(pointsOption);
+    parser.process(a);
+
+    LoadRunner::Options options;
+    options.serverPath = parser.value(serverOption);
+    options.bot.port = quint16(parser.value(portOption).toUInt());
+    options.bot.strokesPerSecond = parser.value(strokesOption).toDouble();
+    options.bot.pointsPerStroke = qMax(2, parser.value(pointsOption).toInt());
+    options.bot.guessesPerSecond = 0;
+    options.seconds = qMax(1, parser.value(secondsOption).toInt());
+
+    if (!QFileInfo(options.serverPath).isExecutable()) {
+        qCritical().noquote() << "No server at" << options.serverPath << "- pass --server";
+        return 1;
+    }
+
+    for (const QString &count : parser.value(guessersOption).split(',', Qt::SkipEmptyParts)) {
+        const int clients = qMax(1, count.trimmed().toInt()) + 1;
+        options.roomSize = clients;
+        LoadRunner runner(options);
+        LoadRunner::report(runner.run(clients));
+    }
+    return 0;
+}
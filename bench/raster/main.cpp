@@ -0,0 +1,95 @@
+#include "strokeraster.h"
+#include <QCoreApplication>
+#include <QColor>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QVector>
+#include <QDebug>
+
+// Segments per second for every StrokeRaster backend, drawing the same
+// random-walk polylines onto a white RGB32 canvas. Batches of one segment
+// are what a DRAW message costs, longer batches what a STROKE or a replayed
+// log costs.
+
+namespace {
+
+constexpr int kWidth = 800;
+constexpr int kHeight = 600;
+
+struct Polyline {
+    QVector<qint16> xs;
+    QVector<qint16> ys;
+    QRgb color;
+};
+
+QVector<Polyline> makePolylines(int segments, int batch)
+{
+    QRandomGenerator random(1);
+    QVector<Polyline> polylines;
+    for (int made = 0; made < segments; made += batch) {
+        Polyline polyline;
+        polyline.color = QColor::fromHsv(random.bounded(360), 200, 200).rgb();
+        int x = random.bounded(kWidth);
+        int y = random.bounded(kHeight);
+        for (int i = 0; i <= batch; ++i) {
+            polyline.xs.append(qint16(x));
+            polyline.ys.append(qint16(y));
+            x = qBound(0, x + random.bounded(-12, 13), kWidth - 1);
+            y = qBound(0, y + random.bounded(-12, 13), kHeight - 1);
+        }
+        polylines.append(polyline);
+    }
+    return polylines;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("StrokeRaster backends compared in segments per second.");
+    parser.addHelpOption();
+    QCommandLineOption segmentsOption("segments", "Segments drawn per measurement.", "count", "100000");
+    QCommandLineOption batchesOption("batches", "Comma separated segments per polyline.", "counts", "1,16,64");
+    QCommandLineOption widthsOption("widths", "Comma separated pen widths.", "widths", "3,12");
+    parser.addOption(segmentsOption);
+    parser.addOption(batchesOption);
+    parser.addOption(widthsOption);
+    parser.process(a);
+
+    const int segments = qMax(1, parser.value(segmentsOption).toInt());
+    const StrokeRaster::Backend backends[] = {
+        StrokeRaster::Backend::QPainter, StrokeRaster::Backend::Scalar, StrokeRaster::Backend::Simd
+    };
+
+    QImage canvas(kWidth, kHeight, QImage::Format_RGB32);
+    for (const QString &batchValue : parser.value(batchesOption).split(',', Qt::SkipEmptyParts)) {
+        const int batch = qMax(1, batchValue.trimmed().toInt());
+        const QVector<Polyline> polylines = makePolylines(segments, batch);
+        for (const QString &widthValue : parser.value(widthsOption).split(',', Qt::SkipEmptyParts)) {
+            const int width = qMax(1, widthValue.trimmed().toInt());
+            QString line = QString("batch %1, width %2:").arg(batch, 3).arg(width, 2);
+            double qpainterRate = 0;
+            for (StrokeRaster::Backend backend : backends) {
+                StrokeRaster::setBackend(backend);
+                canvas.fill(Qt::white);
+                QElapsedTimer timer;
+                timer.start();
+                for (const Polyline &polyline : polylines)
+                    StrokeRaster::drawPolyline(&canvas, polyline.xs.constData(), polyline.ys.constData(),
+                                               polyline.xs.size(), polyline.color, width);
+                const double rate = polylines.size() * batch / (timer.nsecsElapsed() / 1e9);
+                if (backend == StrokeRaster::Backend::QPainter)
+                    qpainterRate = rate;
+                line += QString(" %1 %2/s (%3x)").arg(StrokeRaster::backendName(backend))
+                            .arg(rate, 0, 'f', 0).arg(qpainterRate > 0 ? rate / qpainterRate : 0, 0, 'f', 2);
+            }
+            qInfo().noquote() << line;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,19 @@
+# StrokeRaster's SSE2 and scalar kernels against the QPainter path.
+QT = core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-raster
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../strokeraster.cpp
+
+HEADERS += \
+    ../../strokeraster.h
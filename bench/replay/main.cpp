@@ -0,0 +1,102 @@
+#include "strokelog.h"
+#include "strokeraster.h"
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QDebug>
+
+// What a late joiner pays for a canvas of N segments: decoding the stroke
+// log it is sent and replaying it onto a white canvas, next to the size of
+// the log and of the PNG it replaces. Strokes are random walks with the
+// lengths and widths of hand drawing; the best of a few replays is taken.
+
+namespace {
+
+constexpr int kWidth = 800;
+constexpr int kHeight = 600;
+
+StrokeLog makeLog(int segments, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    StrokeLog log;
+    quint32 strokeId = 0;
+    while (log.segmentCount() < segments) {
+        const QColor color = QColor::fromHsv(random.bounded(360), 200, 200);
+        const int width = 1 + random.bounded(20);
+        const bool eraser = random.bounded(10) == 0;
+        const int length = qMin(segments - log.segmentCount(), 8 + random.bounded(56));
+        QPoint from(random.bounded(kWidth), random.bounded(kHeight));
+        ++strokeId;
+        for (int i = 0; i < length; ++i) {
+            const QPoint to(qBound(0, from.x() + random.bounded(-12, 13), kWidth - 1),
+                            qBound(0, from.y() + random.bounded(-12, 13), kHeight - 1));
+            log.addSegment(from, to, color, eraser, width, strokeId);
+            from = to;
+        }
+    }
+    return log;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stroke log decode and replay speed.");
+    parser.addHelpOption();
+    QCommandLineOption segmentsOption("segments", "Comma separated log sizes in segments.", "counts",
+                                      "10000,50000,200000");
+    QCommandLineOption backendOption("backend", "Rasterizer: qpainter, scalar or simd.", "name", "simd");
+    QCommandLineOption repeatOption("repeat", "Replays per log; the fastest counts.", "count", "5");
+    parser.addOption(segmentsOption);
+    parser.addOption(backendOption);
+    parser.addOption(repeatOption);
+    parser.process(a);
+
+    StrokeRaster::setBackend(StrokeRaster::backendFromName(parser.value(backendOption), StrokeRaster::backend()));
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+    qInfo().noquote() << "backend" << StrokeRaster::backendName(StrokeRaster::backend());
+
+    for (const QString &count : parser.value(segmentsOption).split(',', Qt::SkipEmptyParts)) {
+        const StrokeLog source = makeLog(qMax(1, count.trimmed().toInt()), 1);
+        const QByteArray encoded = source.encode();
+
+        QElapsedTimer timer;
+        timer.start();
+        StrokeLog log;
+        if (!StrokeLog::decode(encoded, &log)) {
+            qCritical() << "log does not decode";
+            return 1;
+        }
+        const qint64 decodeNsecs = timer.nsecsElapsed();
+
+        QImage canvas(kWidth, kHeight, QImage::Format_RGB32);
+        qint64 best = -1;
+        for (int i = 0; i < repeat; ++i) {
+            canvas.fill(Qt::white);
+            timer.restart();
+            log.paint(&canvas);
+            const qint64 nsecs = timer.nsecsElapsed();
+            if (best < 0 || nsecs < best)
+                best = nsecs;
+        }
+
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        canvas.save(&buffer, "PNG");
+
+        qInfo().noquote() << QString("%1 segments in %2 strokes: log %3 KB (png %4 KB), decode %5 ms, "
+                                     "replay %6 ms, %7 segments/s")
+                                 .arg(log.segmentCount()).arg(log.strokeCount())
+                                 .arg(encoded.size() / 1024.0, 0, 'f', 1).arg(png.size() / 1024.0, 0, 'f', 1)
+                                 .arg(decodeNsecs / 1e6, 0, 'f', 2).arg(best / 1e6, 0, 'f', 2)
+                                 .arg(log.segmentCount() / (best / 1e9), 0, 'f', 0);
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+# Replaying stroke logs of 10k+ segments onto a canvas.
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-replay
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+
+SOURCES += \
+    main.cpp \
+    ../../strokelog.cpp \
+    ../../strokeraster.cpp
+
+HEADERS += \
+    ../../strokelog.h \
+    ../../strokeraster.h
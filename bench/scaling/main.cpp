@@ -0,0 +1,206 @@
+#include "roomserver.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHash>
+#include <QSet>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+
+// Broadcast throughput of the room server as worker threads are added. Every
+// room gets one drawer writing DRAW segments as fast as the server takes
+// them and a few guessers counting the segments that reach them. Clients
+// stay in text mode and run on threads of their own, so the number that
+// changes between runs is the server's.
+
+namespace {
+
+std::atomic<quint64> delivered { 0 };
+
+class RoomClients : public QObject
+{
+    Q_OBJECT
+public:
+    RoomClients(quint16 port, const QStringList &rooms, int guessers)
+        : port(port), rooms(rooms), guessers(guessers)
+    {
+        for (int i = 0; i < kBatch; ++i) {
+            Protocol::DrawSegment segment;
+            segment.from = QPoint(10 + i, 20);
+            segment.to = QPoint(11 + i, 24);
+            segment.pen.width = 3;
+            batch += Protocol::encodeText(Protocol::makeDraw(segment));
+        }
+    }
+
+public slots:
+    void start()
+    {
+        pump = new QTimer(this);
+        pump->setInterval(1);
+        connect(pump, &QTimer::timeout, this, &RoomClients::feedDrawers);
+        pump->start();
+
+        for (const QString &room : qAsConst(rooms)) {
+            for (int i = 0; i <= guessers; ++i) {
+                QTcpSocket *socket = new QTcpSocket(this);
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readLines(socket); });
+                connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { feed(socket); });
+                connect(socket, &QTcpSocket::connected, this, [socket, room]() {
+                    socket->write(Protocol::encodeText(Protocol::makeText(Protocol::MessageType::Join, room)));
+                });
+                socket->connectToHost(QHostAddress::LocalHost, port);
+            }
+        }
+    }
+
+    void stop()
+    {
+        pump->stop();
+        for (QTcpSocket *socket : findChildren<QTcpSocket *>())
+            socket->abort();
+    }
+
+private:
+    static constexpr int kBatch = 32;
+    static constexpr qint64 kWatermark = 64 * 1024;
+
+    // Whoever the room makes the drawer draws; everybody else counts.
+    void readLines(QTcpSocket *socket)
+    {
+        QByteArray &pending = partial[socket];
+        pending += socket->readAll();
+        int start = 0;
+        int end;
+        quint64 segments = 0;
+        while ((end = pending.indexOf('\n', start)) >= 0) {
+            const char *line = pending.constData() + start;
+            if (std::strncmp(line, "DRAW:", 5) == 0) {
+                segments++;
+            } else if (std::strncmp(line, "ROLE:", 5) == 0) {
+                if (std::strncmp(line + 5, "DRAWER", 6) == 0)
+                    drawers.insert(socket);
+                else
+                    drawers.remove(socket);
+            }
+            start = end + 1;
+        }
+        pending.remove(0, start);
+        if (segments)
+            delivered.fetch_add(segments, std::memory_order_relaxed);
+    }
+
+    void feed(QTcpSocket *socket)
+    {
+        if (!drawers.contains(socket) || socket->state() != QAbstractSocket::ConnectedState)
+            return;
+        while (socket->bytesToWrite() < kWatermark)
+            socket->write(batch);
+    }
+
+    void feedDrawers()
+    {
+        for (QTcpSocket *socket : qAsConst(drawers))
+            feed(socket);
+    }
+
+    quint16 port;
+    QStringList rooms;
+    int guessers;
+    QByteArray batch;
+    QTimer *pump = nullptr;
+    QSet<QTcpSocket *> drawers;
+    QHash<QTcpSocket *, QByteArray> partial;
+};
+
+void wait(int msecs)
+{
+    QEventLoop loop;
+    QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Room server broadcast throughput with 1..N worker threads.");
+    parser.addHelpOption();
+    QCommandLineOption maxWorkersOption("max-workers", "Largest worker count.", "count",
+                                        QString::number(QThread::idealThreadCount()));
+    QCommandLineOption roomsOption("rooms", "Rooms, one drawer each.", "count", "32");
+    QCommandLineOption guessersOption("guessers", "Guessers per room.", "count", "4");
+    QCommandLineOption clientThreadsOption("client-threads", "Threads running the clients.", "count", "4");
+    QCommandLineOption secondsOption("seconds", "Length of each measurement.", "seconds", "5");
+    parser.addOption(maxWorkersOption);
+    parser.addOption(roomsOption);
+    parser.addOption(guessersOption);
+    parser.addOption(clientThreadsOption);
+    parser.addOption(secondsOption);
+    parser.process(a);
+
+    const int maxWorkers = qMax(1, parser.value(maxWorkersOption).toInt());
+    const int roomCount = qMax(1, parser.value(roomsOption).toInt());
+    const int guessers = qMax(1, parser.value(guessersOption).toInt());
+    const int clientThreads = qMax(1, parser.value(clientThreadsOption).toInt());
+    const int seconds = qMax(1, parser.value(secondsOption).toInt());
+
+    double baseline = 0;
+    for (int workers = 1; workers <= maxWorkers; ++workers) {
+        RoomServer server;
+        server.setWorkerCount(workers);
+        if (!server.listen(QHostAddress::LocalHost, 0)) {
+            qCritical().noquote() << "Cannot listen:" << server.errorString();
+            return 1;
+        }
+
+        QList<QThread *> threads;
+        QList<RoomClients *> groups;
+        for (int t = 0; t < clientThreads; ++t) {
+            QStringList rooms;
+            for (int r = t; r < roomCount; r += clientThreads)
+                rooms << QString("scaling-%1").arg(r);
+            QThread *thread = new QThread;
+            RoomClients *group = new RoomClients(server.serverPort(), rooms, guessers);
+            group->moveToThread(thread);
+            QObject::connect(thread, &QThread::started, group, &RoomClients::start);
+            QObject::connect(thread, &QThread::finished, group, &QObject::deleteLater);
+            thread->start();
+            threads << thread;
+            groups << group;
+        }
+
+        wait(1000);     // joins, roles, first snapshots
+        delivered.store(0);
+        QElapsedTimer timer;
+        timer.start();
+        wait(seconds * 1000);
+        const double rate = delivered.load() / (timer.nsecsElapsed() / 1e9);
+        if (workers == 1)
+            baseline = rate;
+
+        qInfo().noquote() << QString("%1 workers: %2 segments/s delivered to %3 guessers, %4x of one worker")
+                                 .arg(workers, 2).arg(rate, 0, 'f', 0).arg(roomCount * guessers)
+                                 .arg(baseline > 0 ? rate / baseline : 0, 0, 'f', 2);
+
+        for (RoomClients *group : qAsConst(groups))
+            QMetaObject::invokeMethod(group, "stop", Qt::BlockingQueuedConnection);
+        for (QThread *thread : qAsConst(threads)) {
+            thread->quit();
+            thread->wait();
+            delete thread;
+        }
+        wait(200);      // let the lobby see the disconnects
+    }
+    return 0;
+}
+
+#include "main.moc"
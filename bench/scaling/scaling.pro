@@ -0,0 +1,12 @@
+# Room server broadcast throughput with 1..N worker threads.
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-scaling
+
+include(../../shared.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,135 @@
+#include "drawgame.h"
+#include "sessionlog.h"
+#include "sessionreplay.h"
+#include "strokelog.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QDebug>
+
+// Replaying a session recording onto a canvas the way the client does with
+// --replay: mapping the file, then every message as fast as possible. With
+// --session a recording made with DRAWGAME_RECORD is used; without it a game
+// of a few rounds is recorded first, strokes as a guesser receives them with
+// a stroke log snapshot now and then. The best of a few replays is taken.
+
+namespace {
+
+constexpr int kWidth = 800;
+constexpr int kHeight = 600;
+
+Protocol::Stroke makeStroke(QRandomGenerator &random, quint32 strokeId)
+{
+    Protocol::Stroke stroke;
+    stroke.pen.color = QColor::fromHsv(random.bounded(360), 200, 200);
+    stroke.pen.width = 1 + random.bounded(20);
+    stroke.pen.eraser = random.bounded(10) == 0;
+    stroke.pen.strokeId = strokeId;
+    QPoint point(random.bounded(kWidth), random.bounded(kHeight));
+    const int length = 8 + random.bounded(56);
+    for (int i = 0; i <= length; ++i) {
+        stroke.points.append(point);
+        point = QPoint(qBound(0, point.x() + random.bounded(-12, 13), kWidth - 1),
+                       qBound(0, point.y() + random.bounded(-12, 13), kHeight - 1));
+    }
+    return stroke;
+}
+
+bool recordGame(const QString &path, int rounds, int strokesPerRound)
+{
+    SessionLog::Recorder recorder;
+    if (!recorder.open(path))
+        return false;
+
+    QRandomGenerator random(1);
+    quint32 strokeId = 0;
+    for (int round = 0; round < rounds; ++round) {
+        StrokeLog log;
+        for (int i = 0; i < strokesPerRound; ++i) {
+            const Protocol::Stroke stroke = makeStroke(random, ++strokeId);
+            for (int p = 1; p < stroke.points.size(); ++p) {
+                log.addSegment(stroke.points[p - 1], stroke.points[p], stroke.pen.color, stroke.pen.eraser,
+                               stroke.pen.width, stroke.pen.strokeId);
+            }
+            recorder.record(SessionLog::Direction::In, Protocol::makeStroke(stroke));
+            if (i % 100 == 99)
+                recorder.record(SessionLog::Direction::In, Protocol::makeStrokeLog(log.encode()));
+            if (i % 25 == 0) {
+                recorder.record(SessionLog::Direction::Out,
+                                Protocol::makeText(Protocol::MessageType::Chat, QString("слово %1").arg(i)));
+            }
+        }
+        recorder.record(SessionLog::Direction::In,
+                        Protocol::makeText(Protocol::MessageType::Clear, QString::number(strokeId)));
+    }
+    recorder.flush();
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // The canvas is a widget but is never shown.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Session recording replay speed.");
+    parser.addHelpOption();
+    QCommandLineOption sessionOption("session", "Replay a session recorded with DRAWGAME_RECORD.", "file");
+    QCommandLineOption roundsOption("rounds", "Rounds in the generated recording.", "count", "10");
+    QCommandLineOption strokesOption("strokes", "Strokes per round in the generated recording.", "count", "500");
+    QCommandLineOption repeatOption("repeat", "Replays of the recording; the fastest counts.", "count", "5");
+    parser.addOption(sessionOption);
+    parser.addOption(roundsOption);
+    parser.addOption(strokesOption);
+    parser.addOption(repeatOption);
+    parser.process(a);
+
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+
+    QTemporaryDir dir;
+    QString path = parser.value(sessionOption);
+    if (path.isEmpty()) {
+        path = dir.filePath("generated.dgrec");
+        if (!dir.isValid() || !recordGame(path, qMax(1, parser.value(roundsOption).toInt()),
+                                          qMax(1, parser.value(strokesOption).toInt()))) {
+            qCritical() << "cannot write the generated recording";
+            return 1;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    SessionLog::Reader log;
+    if (!log.open(path)) {
+        qCritical().noquote() << "Cannot open recording" << path << ":" << log.errorString();
+        return 1;
+    }
+    const qint64 openNsecs = timer.nsecsElapsed();
+
+    SessionReplay::Stats best;
+    for (int i = 0; i < repeat; ++i) {
+        DrawingArea area;
+        area.setDrawingEnabled(false);
+        SessionReplay replay(&log, &area);
+        replay.runFast();
+        const SessionReplay::Stats stats = replay.stats();
+        if (i == 0 || stats.nsecs < best.nsecs)
+            best = stats;
+    }
+
+    const double seconds = qMax<qint64>(best.nsecs, 1) / 1e9;
+    qInfo().noquote() << QString("%1: %2 KB, %3 messages (%4 canvas), %5 segments, %6 snapshots")
+                             .arg(parser.isSet(sessionOption) ? path : QString("generated"))
+                             .arg(log.mappedBytes() / 1024.0, 0, 'f', 1).arg(best.messages)
+                             .arg(best.canvasMessages).arg(best.segments).arg(best.snapshots);
+    qInfo().noquote() << QString("open %1 ms, replay %2 ms, %3 messages/s, %4 segments/s")
+                             .arg(openNsecs / 1e6, 0, 'f', 2).arg(best.nsecs / 1e6, 0, 'f', 2)
+                             .arg(best.messages / seconds, 0, 'f', 0).arg(best.segments / seconds, 0, 'f', 0);
+    return 0;
+}
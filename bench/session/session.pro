@@ -0,0 +1,15 @@
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench-session
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+include(../../client.pri)
+
+SOURCES += \
+    main.cpp
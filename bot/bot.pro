@@ -0,0 +1,28 @@
+# Headless bots and load runner for the room server. Like the server it
+# needs no display; the bots paint what they receive with StrokeRaster.
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = drawgame-bot
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../shared.pri)
+
+SOURCES += \
+    botclient.cpp \
+    loadrunner.cpp \
+    main.cpp \
+    ../sessionlog.cpp \
+    ../strokelog.cpp \
+    ../strokeraster.cpp
+
+HEADERS += \
+    botclient.h \
+    loadrunner.h \
+    ../sessionlog.h \
+    ../strokelog.h \
+    ../strokeraster.h
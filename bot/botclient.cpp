@@ -0,0 +1,235 @@
+#include "botclient.h"
+#include "gameroom.h"
+#include "strokeraster.h"
+#include <QRandomGenerator>
+
+void LatencyBook::rendered(quint32 strokeId)
+{
+    auto it = sentAt.constFind(strokeId);
+    if (it != sentAt.constEnd())
+        samples.append(now() - it.value());
+}
+
+QVector<qint64> LatencyBook::takeSamples()
+{
+    QVector<qint64> taken;
+    taken.swap(samples);
+    sentAt.clear();
+    return taken;
+}
+
+BotClient::BotClient(const Config &config, LatencyBook *book, QObject *parent)
+    : QObject(parent),
+      config(config),
+      book(book),
+      socket(new QTcpSocket(this)),
+      binarySend(false),
+      binaryVersion(Protocol::kBinaryVersion),
+      sendSequence(0),
+      isDrawer(false),
+      pen(400, 300),
+      scriptPosition(0),
+      canvas(800, 600, QImage::Format_RGB32)
+{
+    canvas.fill(Qt::white);
+    connect(socket, &QTcpSocket::connected, this, &BotClient::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &BotClient::readData);
+    connect(socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        counters.errors++;
+    });
+
+    if (config.strokesPerSecond > 0)
+        strokeTimer.setInterval(qMax(1, int(1000 / config.strokesPerSecond)));
+    if (config.guessesPerSecond > 0)
+        guessTimer.setInterval(qMax(1, int(1000 / config.guessesPerSecond)));
+    connect(&strokeTimer, &QTimer::timeout, this, &BotClient::sendStroke);
+    connect(&guessTimer, &QTimer::timeout, this, &BotClient::sendGuess);
+    connect(&reconnectTimer, &QTimer::timeout, this, &BotClient::reconnect);
+}
+
+void BotClient::start()
+{
+    socket->connectToHost(config.host, config.port);
+    if (config.reconnectSeconds > 0) {
+        // spread the reconnects so the bots do not all drop at once
+        const int interval = config.reconnectSeconds * 1000;
+        reconnectTimer.start(interval / 2 + QRandomGenerator::global()->bounded(interval));
+    }
+}
+
+void BotClient::stop()
+{
+    strokeTimer.stop();
+    guessTimer.stop();
+    reconnectTimer.stop();
+    socket->abort();
+}
+
+void BotClient::reconnect()
+{
+    counters.reconnects++;
+    strokeTimer.stop();
+    guessTimer.stop();
+    socket->abort();
+    decoder.reset();
+    binarySend = false;
+    binaryVersion = Protocol::kBinaryVersion;
+    sendSequence = 0;
+    isDrawer = false;
+    socket->connectToHost(config.host, config.port);
+}
+
+void BotClient::onConnected()
+{
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    send(Protocol::makeText(Protocol::MessageType::Join, config.room));
+    send(Protocol::makeText(Protocol::MessageType::RequestImage));
+}
+
+void BotClient::count(Traffic *table, Protocol::MessageType type, int bytes)
+{
+    Traffic &entry = table[quint8(type) % kTypeSlots];
+    entry.messages++;
+    entry.bytes += bytes;
+}
+
+void BotClient::send(const Protocol::Message &message)
+{
+    if (socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    const QByteArray frame = binarySend ? Protocol::encodeFrame(message, sendSequence++, binaryVersion)
+                                        : Protocol::encodeText(message);
+    socket->write(frame);
+    count(counters.sent, message.type, frame.size());
+}
+
+void BotClient::readData()
+{
+    while (socket->bytesAvailable() > 0) {
+        if (decoder.readFrom(socket) <= 0) break;
+
+        FrameDecoder::Frame frame;
+        FrameDecoder::Status status;
+        while ((status = decoder.next(&frame)) == FrameDecoder::Status::Ready) {
+            Protocol::Message message;
+            if (!FrameDecoder::decode(frame, &message))
+                continue;
+            const int overhead = frame.mode == FrameDecoder::Mode::Binary ? Protocol::kFrameHeaderSize : 1;
+            count(counters.received, message.type, frame.size + overhead);
+            handleMessage(message);
+        }
+
+        if (status == FrameDecoder::Status::Error) {
+            qWarning().noquote() << "bot: dropping connection:" << decoder.errorString();
+            counters.errors++;
+            socket->abort();
+            break;
+        }
+    }
+}
+
+void BotClient::handleMessage(const Protocol::Message &message)
+{
+    switch (message.type) {
+    case Protocol::MessageType::Proto:
+        if (!binarySend && Protocol::commonVersion(message.text) >= Protocol::kMinBinaryVersion) {
+            binaryVersion = Protocol::commonVersion(message.text);
+            send(Protocol::makeText(Protocol::MessageType::Binary, QString::number(binaryVersion)));
+            binarySend = true;
+        }
+        break;
+    case Protocol::MessageType::Binary:
+        decoder.setMode(FrameDecoder::Mode::Binary);
+        if (!binarySend) {
+            binaryVersion = qMax(Protocol::commonVersion(message.text), Protocol::kMinBinaryVersion);
+            send(Protocol::makeText(Protocol::MessageType::Binary, QString::number(binaryVersion)));
+            binarySend = true;
+        }
+        break;
+    case Protocol::MessageType::Role:
+        isDrawer = (message.text == "DRAWER");
+        canvas.fill(Qt::white);
+        drawn.clear();
+        if (isDrawer) {
+            guessTimer.stop();
+            if (config.strokesPerSecond > 0)
+                strokeTimer.start();
+        } else {
+            strokeTimer.stop();
+            if (config.guessesPerSecond > 0)
+                guessTimer.start();
+        }
+        break;
+    case Protocol::MessageType::Stroke:
+        paint(message.stroke);
+        break;
+    case Protocol::MessageType::Clear:
+        canvas.fill(Qt::white);
+        break;
+    case Protocol::MessageType::RequestImage:
+        if (isDrawer)
+            send(Protocol::makeStrokeLog(drawn.encode(binaryVersion)));
+        break;
+    default:
+        break;
+    }
+}
+
+Protocol::Stroke BotClient::nextStroke()
+{
+    if (!config.script.isEmpty())
+        return config.script.at(scriptPosition++ % config.script.size());
+
+    // a random walk across the canvas
+    Protocol::Stroke stroke;
+    stroke.pen.width = 3;
+    QRandomGenerator *random = QRandomGenerator::global();
+    stroke.points.append(pen);
+    for (int i = 1; i < config.pointsPerStroke; ++i) {
+        pen = QPoint(qBound(0, pen.x() + random->bounded(-12, 13), canvas.width() - 1),
+                     qBound(0, pen.y() + random->bounded(-12, 13), canvas.height() - 1));
+        stroke.points.append(pen);
+    }
+    return stroke;
+}
+
+void BotClient::sendStroke()
+{
+    if (!isDrawer)
+        return;
+
+    Protocol::Stroke stroke = nextStroke();
+    if (stroke.points.size() < 2)
+        return;
+    stroke.pen.strokeId = book->nextStrokeId();
+    const quint32 now = quint32(book->now() / 1000000);
+    stroke.times.fill(now, stroke.points.size());
+    for (int i = 1; i < stroke.points.size(); ++i) {
+        drawn.addSegment(stroke.points[i - 1], stroke.points[i], stroke.pen.color, stroke.pen.eraser,
+                         qMax(stroke.pen.width, 1), stroke.pen.strokeId);
+    }
+    book->sent(stroke.pen.strokeId);
+    send(Protocol::makeStroke(stroke));
+}
+
+void BotClient::sendGuess()
+{
+    if (isDrawer)
+        return;
+
+    const QStringList words = GameRoom::defaultWords();
+    const QString guess = words.at(QRandomGenerator::global()->bounded(words.size()));
+    send(Protocol::makeText(Protocol::MessageType::Chat, guess));
+}
+
+void BotClient::paint(const Protocol::Stroke &stroke)
+{
+    if (stroke.points.size() >= 2) {
+        const QColor color = stroke.pen.eraser ? QColor(Qt::white) : stroke.pen.color;
+        StrokeRaster::drawPolyline(&canvas, stroke.points.constData(), stroke.points.size(), color.rgb(),
+                                   qMax(stroke.pen.width, 1));
+    }
+    if (stroke.pen.strokeId)
+        book->rendered(stroke.pen.strokeId);
+}
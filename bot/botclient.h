@@ -0,0 +1,107 @@
+#ifndef BOTCLIENT_H
+#define BOTCLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QImage>
+#include <QHash>
+#include <QElapsedTimer>
+#include "framedecoder.h"
+#include "strokelog.h"
+
+// Clock and stroke ids shared by every bot of a run. Drawers note when they
+// sent each stroke, guessers when they painted it; the difference is the
+// stroke-to-render latency.
+class LatencyBook
+{
+public:
+    LatencyBook() { clock.start(); }
+
+    quint32 nextStrokeId() { return ++lastStrokeId; }
+    qint64 now() const { return clock.nsecsElapsed(); }
+    void sent(quint32 strokeId) { sentAt.insert(strokeId, now()); }
+    void rendered(quint32 strokeId);
+    QVector<qint64> takeSamples();
+
+private:
+    QElapsedTimer clock;
+    quint32 lastStrokeId = 0;
+    QHash<quint32, qint64> sentAt;
+    QVector<qint64> samples;
+};
+
+// A headless player speaking the same protocol as DrawGame: text until the
+// server offers frames, then binary. As the drawer it sends strokes at a
+// fixed rate (generated, or taken from a recording) and answers snapshot
+// requests with its stroke log; as a guesser it chats guesses and paints
+// what it receives onto an offscreen canvas. It can drop and reopen its
+// connection on a timer. The UDP offer is ignored, strokes stay on TCP.
+class BotClient : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int kTypeSlots = 32;
+
+    struct Config {
+        QString host = "127.0.0.1";
+        quint16 port = 12345;
+        QString room;
+        double strokesPerSecond = 20;
+        int pointsPerStroke = 16;
+        double guessesPerSecond = 0.5;
+        int reconnectSeconds = 0;       // 0: stay connected
+        QVector<Protocol::Stroke> script;
+    };
+
+    struct Traffic {
+        quint64 messages = 0;
+        quint64 bytes = 0;
+    };
+
+    struct Stats {
+        Traffic sent[kTypeSlots];
+        Traffic received[kTypeSlots];
+        quint64 reconnects = 0;
+        quint64 errors = 0;
+    };
+
+    BotClient(const Config &config, LatencyBook *book, QObject *parent = nullptr);
+
+    void start();
+    void stop();
+    const Stats &stats() const { return counters; }
+
+private slots:
+    void onConnected();
+    void readData();
+    void sendStroke();
+    void sendGuess();
+    void reconnect();
+
+private:
+    void handleMessage(const Protocol::Message &message);
+    void send(const Protocol::Message &message);
+    void count(Traffic *table, Protocol::MessageType type, int bytes);
+    Protocol::Stroke nextStroke();
+    void paint(const Protocol::Stroke &stroke);
+
+    Config config;
+    LatencyBook *book;
+    QTcpSocket *socket;
+    FrameDecoder decoder;
+    bool binarySend;
+    int binaryVersion;
+    quint32 sendSequence;
+    bool isDrawer;
+    QTimer strokeTimer;
+    QTimer guessTimer;
+    QTimer reconnectTimer;
+    QPoint pen;
+    int scriptPosition;
+    StrokeLog drawn;
+    QImage canvas;
+    Stats counters;
+};
+
+#endif // BOTCLIENT_H
@@ -0,0 +1,181 @@
+#include "loadrunner.h"
+#include <QEventLoop>
+#include <QFile>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+LoadRunner::LoadRunner(const Options &options, QObject *parent)
+    : QObject(parent),
+      options(options),
+      server(nullptr)
+{
+}
+
+// The server is up once it accepts a connection.
+bool LoadRunner::startServer()
+{
+    server = new QProcess(this);
+    server->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    server->start(options.serverPath, QStringList() << "--port" << QString::number(options.bot.port)
+                                                    << options.serverArguments);
+    if (!server->waitForStarted()) {
+        qCritical().noquote() << "Cannot start" << options.serverPath << ":" << server->errorString();
+        return false;
+    }
+
+    for (int attempt = 0; attempt < 50; ++attempt) {
+        QTcpSocket probe;
+        probe.connectToHost(options.bot.host, options.bot.port);
+        if (probe.waitForConnected(100))
+            return true;
+        QThread::msleep(100);
+    }
+    qCritical().noquote() << "Server did not start listening on port" << options.bot.port;
+    return false;
+}
+
+void LoadRunner::stopServer()
+{
+    if (!server)
+        return;
+    server->terminate();
+    if (!server->waitForFinished(3000))
+        server->kill();
+    server->waitForFinished();
+    delete server;
+    server = nullptr;
+}
+
+qint64 LoadRunner::serverCpuTicks() const
+{
+#ifdef Q_OS_LINUX
+    QFile stat(QString("/proc/%1/stat").arg(server->processId()));
+    if (!stat.open(QIODevice::ReadOnly))
+        return -1;
+    // utime and stime are fields 14 and 15; the command name may hold spaces
+    const QByteArray line = stat.readAll();
+    const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13)
+        return -1;
+    return fields[11].toLongLong() + fields[12].toLongLong();
+#else
+    return -1;
+#endif
+}
+
+qint64 LoadRunner::serverRssKb() const
+{
+#ifdef Q_OS_LINUX
+    QFile status(QString("/proc/%1/status").arg(server->processId()));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+    while (!status.atEnd()) {
+        const QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+    }
+#endif
+    return -1;
+}
+
+LoadRunner::Result LoadRunner::run(int clients)
+{
+    Result result;
+    result.clients = clients;
+    if (!options.serverPath.isEmpty() && !startServer()) {
+        stopServer();
+        return result;
+    }
+
+    LatencyBook book;
+    QList<BotClient *> bots;
+    for (int i = 0; i < clients; ++i) {
+        BotClient::Config config = options.bot;
+        config.room = QString("bench-%1").arg(i / qMax(1, options.roomSize));
+        BotClient *bot = new BotClient(config, &book, this);
+        bots.append(bot);
+        bot->start();
+    }
+
+#ifdef Q_OS_LINUX
+    const qint64 startTicks = server ? serverCpuTicks() : -1;
+    QElapsedTimer elapsed;
+    elapsed.start();
+#endif
+    QTimer rssTimer;
+    connect(&rssTimer, &QTimer::timeout, this, [&]() {
+        if (server)
+            result.serverPeakRssKb = qMax(result.serverPeakRssKb, serverRssKb());
+    });
+    rssTimer.start(500);
+
+    QEventLoop loop;
+    QTimer::singleShot(options.seconds * 1000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+#ifdef Q_OS_LINUX
+    const qint64 endTicks = server ? serverCpuTicks() : -1;
+    if (startTicks >= 0 && endTicks >= 0) {
+        const double seconds = elapsed.nsecsElapsed() / 1e9;
+        result.serverCpuPercent = (endTicks - startTicks) * 100.0 / sysconf(_SC_CLK_TCK) / seconds;
+    }
+#endif
+
+    for (BotClient *bot : qAsConst(bots)) {
+        bot->stop();
+        const BotClient::Stats &stats = bot->stats();
+        for (int type = 0; type < BotClient::kTypeSlots; ++type) {
+            result.traffic.sent[type].messages += stats.sent[type].messages;
+            result.traffic.sent[type].bytes += stats.sent[type].bytes;
+            result.traffic.received[type].messages += stats.received[type].messages;
+            result.traffic.received[type].bytes += stats.received[type].bytes;
+        }
+        result.traffic.reconnects += stats.reconnects;
+        result.traffic.errors += stats.errors;
+        delete bot;
+    }
+    stopServer();
+
+    result.latencies = book.takeSamples();
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+void LoadRunner::report(const Result &result)
+{
+    auto percentile = [&result](double fraction) {
+        const int index = qMin(result.latencies.size() - 1, int(fraction * result.latencies.size()));
+        return result.latencies.at(index) / 1e6;
+    };
+
+    if (result.latencies.isEmpty()) {
+        qInfo().noquote() << QString("%1 clients: no strokes rendered").arg(result.clients);
+    } else {
+        qInfo().noquote() << QString("%1 clients: stroke-to-render p50 %2 ms, p90 %3 ms, p99 %4 ms, max %5 ms (%6 samples)")
+                                 .arg(result.clients)
+                                 .arg(percentile(0.50), 0, 'f', 2).arg(percentile(0.90), 0, 'f', 2)
+                                 .arg(percentile(0.99), 0, 'f', 2).arg(result.latencies.last() / 1e6, 0, 'f', 2)
+                                 .arg(result.latencies.size());
+    }
+    qInfo().noquote() << QString("    server cpu %1, peak rss %2; %3 reconnects, %4 errors")
+                             .arg(result.serverCpuPercent >= 0 ? QString("%1%").arg(result.serverCpuPercent, 0, 'f', 1) : QString("n/a"))
+                             .arg(result.serverPeakRssKb >= 0 ? QString("%1 kB").arg(result.serverPeakRssKb) : QString("n/a"))
+                             .arg(result.traffic.reconnects).arg(result.traffic.errors);
+
+    for (int type = 0; type < BotClient::kTypeSlots; ++type) {
+        const BotClient::Traffic &sent = result.traffic.sent[type];
+        const BotClient::Traffic &received = result.traffic.received[type];
+        if (sent.messages == 0 && received.messages == 0)
+            continue;
+        qInfo().noquote() << QString("    %1: sent %2 msgs / %3 B, received %4 msgs / %5 B")
+                                 .arg(Protocol::typeName(Protocol::MessageType(type)), -14)
+                                 .arg(sent.messages).arg(sent.bytes)
+                                 .arg(received.messages).arg(received.bytes);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef LOADRUNNER_H
+#define LOADRUNNER_H
+
+#include <QObject>
+#include <QProcess>
+#include "botclient.h"
+
+// Runs a number of bots against one server for a fixed time and collects
+// what they saw. With a server binary set, a fresh server is started for
+// every run and its CPU time and resident memory are read from /proc
+// (Linux only); otherwise the bots connect to an already running server.
+class LoadRunner : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        BotClient::Config bot;
+        int roomSize = 5;
+        int seconds = 10;
+        QString serverPath;
+        QStringList serverArguments;
+    };
+
+    struct Result {
+        int clients = 0;
+        QVector<qint64> latencies;      // ns, sorted
+        BotClient::Stats traffic;       // summed over all bots
+        double serverCpuPercent = -1;   // -1: not measured
+        qint64 serverPeakRssKb = -1;
+    };
+
+    explicit LoadRunner(const Options &options, QObject *parent = nullptr);
+
+    Result run(int clients);
+    static void report(const Result &result);
+
+private:
+    bool startServer();
+    void stopServer();
+    qint64 serverCpuTicks() const;
+    qint64 serverRssKb() const;
+
+    Options options;
+    QProcess *server;
+};
+
+#endif // LOADRUNNER_H
@@ -0,0 +1,98 @@
+#include "loadrunner.h"
+#include "sessionlog.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+// Strokes recorded in a session log, replayed by every drawer bot in a loop.
+static bool loadScript(const QString &path, QVector<Protocol::Stroke> *script)
+{
+    SessionLog::Reader reader;
+    if (!reader.open(path)) {
+        qCritical().noquote() << "Cannot read" << path << ":" << reader.errorString();
+        return false;
+    }
+    for (int i = 0; i < reader.count(); ++i) {
+        const SessionLog::Record &record = reader.at(i);
+        if (record.type != Protocol::MessageType::Stroke)
+            continue;
+        Protocol::Message message;
+        if (record.decode(&message) && message.stroke.points.size() >= 2)
+            script->append(message.stroke);
+    }
+    if (script->isEmpty()) {
+        qCritical().noquote() << "No strokes in" << path;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("drawgame-bot");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless players for load testing the drawing game server.");
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Server address.", "address", "127.0.0.1");
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Server port.", "port", "12345");
+    QCommandLineOption clientsOption(QStringList() << "c" << "clients",
+                                     "Comma separated client counts, one run each.", "counts", "10");
+    QCommandLineOption suiteOption("suite", "Run with 1, 10 and 100 clients.");
+    QCommandLineOption secondsOption(QStringList() << "s" << "seconds", "Length of each run.", "seconds", "10");
+    QCommandLineOption roomSizeOption("room-size", "Bots per room.", "count", "5");
+    QCommandLineOption strokesOption("strokes-per-second", "Strokes sent by each drawer.", "rate", "20");
+    QCommandLineOption pointsOption("points", "Points in a generated stroke.", "count", "16");
+    QCommandLineOption guessesOption("guesses-per-second", "Guesses sent by each guesser.", "rate", "0.5");
+    QCommandLineOption reconnectOption("reconnect", "Reconnect every bot about this often (0: never).",
+                                       "seconds", "0");
+    QCommandLineOption scriptOption("script", "Replay the strokes of a recorded session instead of random ones.",
+                                    "file");
+    QCommandLineOption serverOption("server", "Start this drawgame-server binary for every run and "
+                                              "measure its CPU and memory.", "path");
+    QCommandLineOption serverArgumentOption("server-arg", "Extra argument for the started server, "
+                                                          "may be repeated.", "argument");
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(clientsOption);
+    parser.addOption(suiteOption);
+    parser.addOption(secondsOption);
+    parser.addOption(roomSizeOption);
+    parser.addOption(strokesOption);
+    parser.addOption(pointsOption);
+    parser.addOption(guessesOption);
+    parser.addOption(reconnectOption);
+    parser.addOption(scriptOption);
+    parser.addOption(serverOption);
+    parser.addOption(serverArgumentOption);
+    parser.process(a);
+
+    LoadRunner::Options options;
+    options.bot.host = parser.value(hostOption);
+    options.bot.port = quint16(parser.value(portOption).toUInt());
+    options.bot.strokesPerSecond = parser.value(strokesOption).toDouble();
+    options.bot.pointsPerStroke = qMax(2, parser.value(pointsOption).toInt());
+    options.bot.guessesPerSecond = parser.value(guessesOption).toDouble();
+    options.bot.reconnectSeconds = parser.value(reconnectOption).toInt();
+    options.roomSize = qMax(1, parser.value(roomSizeOption).toInt());
+    options.seconds = qMax(1, parser.value(secondsOption).toInt());
+    options.serverPath = parser.value(serverOption);
+    options.serverArguments = parser.values(serverArgumentOption);
+    if (parser.isSet(scriptOption) && !loadScript(parser.value(scriptOption), &options.bot.script))
+        return 1;
+
+    QList<int> counts;
+    if (parser.isSet(suiteOption)) {
+        counts << 1 << 10 << 100;
+    } else {
+        for (const QString &count : parser.value(clientsOption).split(',', Qt::SkipEmptyParts))
+            counts << qMax(1, count.trimmed().toInt());
+    }
+
+    LoadRunner runner(options);
+    for (int clients : qAsConst(counts))
+        LoadRunner::report(runner.run(clients));
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+# Client sources other than main.cpp, shared with the tests and benchmarks
+# that need a canvas. Include shared.pri as well.
+
+QT += widgets concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/drawgame.cpp \
+    $$PWD/imagecodec.cpp \
+    $$PWD/jitterbuffer.cpp \
+    $$PWD/sessionlog.cpp \
+    $$PWD/sessionreplay.cpp \
+    $$PWD/strokebatcher.cpp \
+    $$PWD/strokelog.cpp \
+    $$PWD/strokeraster.cpp
+
+HEADERS += \
+    $$PWD/drawgame.h \
+    $$PWD/imagecodec.h \
+    $$PWD/jitterbuffer.h \
+    $$PWD/sessionlog.h \
+    $$PWD/sessionreplay.h \
+    $$PWD/strokebatcher.h \
+    $$PWD/strokelog.h \
+    $$PWD/strokeraster.h
+
+FORMS += \
+    $$PWD/drawgame.ui
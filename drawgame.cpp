@@ -1,13 +1,17 @@
 #include "drawgame.h"
 #include "ui_drawgame.h"
+#include "metrics.h"
+#include "strokeraster.h"
+#include "udpchannel.h"
 #include <QPainter>
 #include <QMouseEvent>
+#include <QTabletEvent>
 #include <QMessageBox>
-#include <QRandomGenerator>
 #include <QDebug>
 #include <QNetworkInterface>
 #include <QInputDialog>
-#include <QBuffer>
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
 
 DrawingArea::DrawingArea(QWidget *parent) : QWidget(parent)
 {
@@ -19,6 +23,20 @@ DrawingArea::DrawingArea(QWidget *parent) : QWidget(parent)
     image = QImage(800, 600, QImage::Format_RGB32);
     image.fill(Qt::white);
     drawingEnabled = true;
+    strokeLogComplete = true;
+    flushQueued = false;
+    simplifyTolerance = StrokeBatcher::kDefaultTolerance;
+    settleTimer.setSingleShot(true);
+    settleTimer.setInterval(StrokeBatcher::kDefaultFlushInterval);
+    connect(&settleTimer, &QTimer::timeout, this, &DrawingArea::flushInput);
+    strokeRawPoints = 0;
+    strokeKeptPoints = 0;
+    unpaintedSince = -1;
+    inputClock.start();
+    nextStrokeId = 0;
+    currentStrokeId = 0;
+    resetTiles();
+    resetHistory(true);
 }
 
 void DrawingArea::setDrawingEnabled(bool enabled) {
@@ -28,32 +46,308 @@ void DrawingArea::setDrawingEnabled(bool enabled) {
     update();
 }
 
-void DrawingArea::handleMousePressEvent(QMouseEvent *event) {
-    if (event->button() == Qt::LeftButton) {
-        lastPoint = event->pos();
-        drawing = true;
+DrawingArea::InputStats DrawingArea::takeInputStats()
+{
+    InputStats taken = inputStats;
+    inputStats = InputStats();
+    return taken;
+}
+
+// The eraser always uses the full width; a mouse reports pressure 1.
+int DrawingArea::widthFor(qreal pressure) const
+{
+    if (eraserMode || pressure <= 0)
+        return penWidth;
+    return qMax(1, qRound(penWidth * qMin<qreal>(pressure, 1.0)));
+}
+
+void DrawingArea::pressPointer(const QPoint &pos, qreal pressure)
+{
+    Q_UNUSED(pressure);
+    inputStats.events++;
+    flushInput();
+    lastPoint = pos;
+    drawing = true;
+    strokeRawPoints = 1;
+    strokeKeptPoints = 1;
+    currentStrokeId = ++nextStrokeId;
+    redoStack.clear();
+}
+
+void DrawingArea::movePointer(const QPoint &pos, qreal pressure)
+{
+    inputStats.events++;
+    if (!drawing)
+        return;
+
+    const QPoint previous = pendingPoints.isEmpty() ? lastPoint : pendingPoints.last();
+    if (pos == previous)
+        return;
+
+    if (unpaintedSince < 0)
+        unpaintedSince = inputClock.nsecsElapsed();
+    pendingPoints.append(pos);
+    pendingWidths.append(widthFor(pressure));
+    inputStats.points++;
+    strokeRawPoints++;
+
+    // When simplifying, samples are only painted over the canvas as a
+    // preview until enough of them have come to be simplified together.
+    if (simplifyTolerance > 0) {
+        const int margin = pendingWidths.last() / 2 + 2;
+        const QRect rect = QRect(previous, pos).normalized().adjusted(-margin, -margin, margin, margin);
+        previewRect |= rect;
+        update(rect);
+        if (pendingPoints.size() >= kSettlePoints)
+            flushInput();
+        else if (!settleTimer.isActive())
+            settleTimer.start();
+        return;
+    }
+
+    // Samples already waiting in the event queue are handled before this
+    // call runs, so a burst of them is rasterized in a single pass.
+    if (!flushQueued) {
+        flushQueued = true;
+        QMetaObject::invokeMethod(this, &DrawingArea::flushInput, Qt::QueuedConnection);
+    }
+}
+
+void DrawingArea::releasePointer(const QPoint &pos, qreal pressure)
+{
+    if (!drawing)
+        return;
+
+    movePointer(pos, pressure);
+    flushInput();
+    drawing = false;
+    emit strokeFinished(strokeRawPoints, strokeKeptPoints);
+}
+
+// Draws the queued samples as one polyline per pen width and hands every
+// segment on; sending them is up to the listeners. With a tolerance set the
+// polylines are simplified first, so the canvas, the log and the peers all
+// get the same points.
+void DrawingArea::flushInput()
+{
+    flushQueued = false;
+    settleTimer.stop();
+    if (pendingPoints.isEmpty())
+        return;
+
+    Protocol::PenParams pen;
+    pen.color = penColor;
+    pen.eraser = eraserMode;
+    pen.strokeId = currentStrokeId;
+    QRegion dirty;
+    QVector<QPoint> run;
+    int i = 0;
+    while (i < pendingPoints.size()) {
+        pen.width = pendingWidths[i];
+        run.clear();
+        run.append(lastPoint);
+        while (i < pendingPoints.size() && pendingWidths[i] == pen.width)
+            run.append(pendingPoints[i++]);
+        if (simplifyTolerance > 0 && run.size() > 2) {
+            QVector<QPoint> simplified;
+            for (int index : StrokeBatcher::simplify(run, simplifyTolerance))
+                simplified.append(run[index]);
+            run.swap(simplified);
+        }
+        strokeKeptPoints += run.size() - 1;
+        inputStats.keptPoints += run.size() - 1;
+
+        dirty += drawStroke(run.constData(), run.size(), pen);
+        for (int j = 1; j < run.size(); ++j)
+            emit segmentDrawn(run[j - 1], run[j], pen);
+        lastPoint = run.last();
+    }
+    pendingPoints.clear();
+    pendingWidths.clear();
+    inputStats.rasterPasses++;
+
+    dirty += previewRect;
+    previewRect = QRect();
+    update(dirty);
+    emit imageModified();
+}
+
+// Text peers send one DRAW per segment: glue them back into polylines.
+void DrawingArea::appendSegment(QVector<Protocol::Stroke> *strokes, const Protocol::DrawSegment &segment)
+{
+    if (!strokes->isEmpty()) {
+        Protocol::Stroke &last = strokes->last();
+        if (last.pen == segment.pen && last.points.last() == segment.from) {
+            last.points.append(segment.to);
+            return;
+        }
     }
+
+    Protocol::Stroke stroke;
+    stroke.pen = segment.pen;
+    stroke.points << segment.from << segment.to;
+    strokes->append(stroke);
 }
 
-void DrawingArea::handleMouseMoveEvent(QMouseEvent *event) {
-    if ((event->buttons() & Qt::LeftButton) && drawing) {
-        publicDrawLineTo(event->pos());
+// Paints a batch of remote strokes: one rasterizer pass per stroke, a single
+// update region and one imageModified() for the whole batch.
+void DrawingArea::applyStrokes(const QVector<Protocol::Stroke> &strokes)
+{
+    QRegion dirty;
+    for (const Protocol::Stroke &stroke : strokes) {
+        if (stroke.points.size() < 2)
+            continue;
+
+        Protocol::PenParams pen = stroke.pen;
+        if (pen.width < 0)
+            pen.width = penWidth;
+        dirty += drawStroke(stroke.points.constData(), stroke.points.size(), pen);
     }
+    if (dirty.isEmpty())
+        return;
+
+    update(dirty);
+    emit imageModified();
 }
 
-void DrawingArea::publicDrawLineTo(const QPoint &endPoint) {
+// Rasterizes one polyline and appends it to the log. A checkpoint is only
+// taken before a new log entry starts, when the previous ones are final.
+QRect DrawingArea::drawStroke(const QPoint *points, int count, const Protocol::PenParams &pen)
+{
+    if (historyStale)
+        resetHistory(false);
+    if (!strokeLog.continuesLast(points[0], pen.color, pen.eraser, pen.width, pen.strokeId)
+        && strokeLog.strokeCount() - checkpoints.last().strokeIndex >= kCheckpointInterval)
+        takeCheckpoint();
+
+    const QColor color = pen.eraser ? QColor(Qt::white) : pen.color;
+    const QRect rect = StrokeRaster::drawPolyline(&image, points, count, color.rgb(), pen.width);
+    markDirty(rect);
+    for (int i = 1; i < count; ++i)
+        strokeLog.addSegment(points[i - 1], points[i], pen.color, pen.eraser, pen.width, pen.strokeId);
+    return rect;
+}
+
+// The base checkpoint holds the canvas the log is painted over: blank, or
+// the current image when it came from a snapshot.
+void DrawingArea::resetHistory(bool blank)
+{
+    const int count = TileSync::columns(image.size()) * TileSync::rows(image.size());
+    QImage whiteTile(TileSync::kTileSize, TileSync::kTileSize, QImage::Format_RGB32);
+    whiteTile.fill(Qt::white);
+
+    Checkpoint base;
+    base.strokeIndex = 0;
+    base.tiles.resize(count);
+    for (int i = 0; i < count; ++i) {
+        const QRect rect = TileSync::tileRect(image.size(), i);
+        if (!blank) {
+            base.tiles[i] = image.copy(rect);
+        } else if (rect.size() == whiteTile.size()) {
+            base.tiles[i] = whiteTile;
+        } else {
+            base.tiles[i] = QImage(rect.size(), QImage::Format_RGB32);
+            base.tiles[i].fill(Qt::white);
+        }
+    }
+    checkpoints.clear();
+    checkpoints.append(base);
+    checkpointDirty = QBitArray(count, false);
+    historyStale = false;
+}
+
+void DrawingArea::takeCheckpoint()
+{
+    Checkpoint next;
+    next.strokeIndex = strokeLog.strokeCount();
+    next.tiles = checkpoints.last().tiles;
+    for (int i = 0; i < next.tiles.size(); ++i) {
+        if (checkpointDirty.testBit(i))
+            next.tiles[i] = image.copy(TileSync::tileRect(image.size(), i));
+    }
+    checkpointDirty.fill(false);
+    checkpoints.append(next);
+    // the base stays, every stroke in the log can be undone from it
+    if (checkpoints.size() > kMaxCheckpoints)
+        checkpoints.remove(1);
+}
+
+// Everything painted since the checkpoint lies inside the bounds of the
+// strokes after it, so restoring those tiles and replaying the strokes that
+// remain rebuilds the canvas exactly.
+bool DrawingArea::eraseStroke(quint32 strokeId, QVector<Protocol::Stroke> *removed)
+{
+    const int first = strokeId ? strokeLog.indexOf(strokeId) : -1;
+    if (first < 0 || historyStale)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    int index = checkpoints.size() - 1;
+    while (checkpoints[index].strokeIndex > first)
+        --index;
+    checkpoints.resize(index + 1);
+    const Checkpoint &checkpoint = checkpoints.last();
+
+    const QRect area = strokeLog.bounds(checkpoint.strokeIndex).intersected(image.rect());
+    const QVector<Protocol::Stroke> taken = strokeLog.takeStrokes(strokeId);
+
     QPainter painter(&image);
-    QColor currentColor = eraserMode ? Qt::white : penColor;
-    painter.setPen(QPen(currentColor, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-    painter.drawLine(lastPoint, endPoint);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (int i = 0; i < checkpoint.tiles.size(); ++i) {
+        const QRect rect = TileSync::tileRect(image.size(), i);
+        if (rect.intersects(area))
+            painter.drawImage(rect.topLeft(), checkpoint.tiles[i]);
+    }
+    painter.end();
+    strokeLog.paint(&image, checkpoint.strokeIndex);
+
+    qCDebug(lcStats).noquote() << QString("undo: stroke %1, %2 strokes replayed from checkpoint %3 in %4 ms")
+                                      .arg(strokeId).arg(strokeLog.strokeCount() - checkpoint.strokeIndex)
+                                      .arg(index).arg(timer.nsecsElapsed() / 1000000.0, 0, 'f', 2);
+    if (removed)
+        *removed = taken;
+    markDirty(area);
+    update(area);
+    emit imageModified();
+    return true;
+}
 
-    int adjust = penWidth * 2;
-    QRect rect = QRect(lastPoint, endPoint).normalized().adjusted(-adjust, -adjust, adjust, adjust);
-    update(rect);
+quint32 DrawingArea::undo()
+{
+    if (drawing || strokeLog.isEmpty())
+        return 0;
+
+    const quint32 strokeId = strokeLog.strokeId(strokeLog.strokeCount() - 1);
+    QVector<Protocol::Stroke> removed;
+    if (!eraseStroke(strokeId, &removed))
+        return 0;
+    redoStack.append(removed);
+    return strokeId;
+}
 
-    lastPoint = endPoint;
+QVector<Protocol::Stroke> DrawingArea::redo()
+{
+    if (drawing || redoStack.isEmpty())
+        return QVector<Protocol::Stroke>();
+
+    QVector<Protocol::Stroke> strokes = redoStack.takeLast();
+    const quint32 strokeId = ++nextStrokeId;
+    QRegion dirty;
+    for (Protocol::Stroke &stroke : strokes) {
+        stroke.pen.strokeId = strokeId;
+        dirty += drawStroke(stroke.points.constData(), stroke.points.size(), stroke.pen);
+    }
+    update(dirty);
     emit imageModified();
+    return strokes;
 }
+
+bool DrawingArea::removeStroke(quint32 strokeId)
+{
+    return eraseStroke(strokeId, nullptr);
+}
+
 void DrawingArea::setPenColor(const QColor &newColor)
 {
     penColor = newColor;
@@ -67,6 +361,11 @@ void DrawingArea::setPenWidth(int newWidth)
 void DrawingArea::clear()
 {
     image.fill(Qt::white);
+    strokeLog.clear();
+    strokeLogComplete = true;
+    dirtyTiles.fill(true);
+    redoStack.clear();
+    resetHistory(true);
     update();
 }
 
@@ -75,7 +374,7 @@ void DrawingArea::mousePressEvent(QMouseEvent *event)
     if (!drawingEnabled) return;
 
     if (event->button() == Qt::LeftButton && rect().contains(event->pos())) {
-        handleMousePressEvent(event);
+        pressPointer(event->pos(), 1.0);
     }
 }
 
@@ -84,23 +383,75 @@ void DrawingArea::mouseMoveEvent(QMouseEvent *event)
     if (!drawingEnabled) return;
 
     if ((event->buttons() & Qt::LeftButton) && rect().contains(event->pos())) {
-        handleMouseMoveEvent(event);
+        movePointer(event->pos(), 1.0);
     }
 }
 
 void DrawingArea::mouseReleaseEvent(QMouseEvent *event)
 {
-    if (event->button() == Qt::LeftButton && drawing) {
-        publicDrawLineTo(event->pos());
-        drawing = false;
+    if (event->button() == Qt::LeftButton) {
+        releasePointer(event->pos(), 1.0);
+    }
+}
+
+// Accepted tablet events are not synthesized into mouse events again, so
+// every pen sample reaches the pipeline exactly once, with its pressure.
+void DrawingArea::tabletEvent(QTabletEvent *event)
+{
+    if (!drawingEnabled) {
+        event->ignore();
+        return;
     }
+
+    switch (event->type()) {
+    case QEvent::TabletPress:
+        if (event->button() == Qt::LeftButton && rect().contains(event->pos()))
+            pressPointer(event->pos(), event->pressure());
+        break;
+    case QEvent::TabletMove:
+        if (rect().contains(event->pos()))
+            movePointer(event->pos(), event->pressure());
+        break;
+    case QEvent::TabletRelease:
+        if (event->button() == Qt::LeftButton)
+            releasePointer(event->pos(), event->pressure());
+        break;
+    default:
+        break;
+    }
+    event->accept();
 }
 
 void DrawingArea::paintEvent(QPaintEvent *event)
 {
+    Metrics::ScopedTimer timer(Metrics::Timing::Paint);
     QPainter painter(this);
     QRect dirtyRect = event->rect();
     painter.drawImage(dirtyRect, image, dirtyRect);
+    if (!previewRect.isEmpty())
+        paintPreview(&painter);
+
+    // Latency up to the backing store; the compositor adds its own.
+    if (unpaintedSince >= 0 && (pendingPoints.isEmpty() || !previewRect.isEmpty())) {
+        const qint64 latency = inputClock.nsecsElapsed() - unpaintedSince;
+        unpaintedSince = -1;
+        inputStats.paints++;
+        inputStats.latencyNsecs += latency;
+        inputStats.maxLatencyNsecs = qMax(inputStats.maxLatencyNsecs, latency);
+    }
+}
+
+// Samples waiting to be simplified, drawn straight as they came.
+void DrawingArea::paintPreview(QPainter *painter)
+{
+    const QColor color = eraserMode ? QColor(Qt::white) : penColor;
+    painter->setRenderHint(QPainter::Antialiasing);
+    QPoint from = lastPoint;
+    for (int i = 0; i < pendingPoints.size(); ++i) {
+        painter->setPen(QPen(color, pendingWidths[i], Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        painter->drawLine(from, pendingPoints[i]);
+        from = pendingPoints[i];
+    }
 }
 
 void DrawingArea::resizeEvent(QResizeEvent *event)
@@ -109,6 +460,16 @@ void DrawingArea::resizeEvent(QResizeEvent *event)
         int newWidth = qMax(width() + 128, image.width());
         int newHeight = qMax(height() + 128, image.height());
         resizeImage(&image, QSize(newWidth, newHeight));
+        resetTiles();
+        // the new area is blank, so a complete log still paints the canvas
+        if (strokeLogComplete) {
+            resetHistory(true);
+            checkpointDirty.fill(true);
+            takeCheckpoint();
+        } else {
+            strokeLog.clear();
+            historyStale = true;
+        }
         update();
     }
     QWidget::resizeEvent(event);
@@ -129,45 +490,158 @@ void DrawingArea::resizeImage(QImage *image, const QSize &newSize)
 void DrawingArea::setImage(const QImage& newImage)
 {
     image = newImage;
+    strokeLog.clear();
+    strokeLogComplete = false;
+    historyStale = true;
+    redoStack.clear();
+    resetTiles();
     update();
     emit imageModified();
 }
 
+void DrawingArea::setStrokeLog(const StrokeLog &log)
+{
+    QElapsedTimer timer;
+    timer.start();
+    image.fill(Qt::white);
+    log.paint(&image);
+    const qint64 nsecs = qMax<qint64>(timer.nsecsElapsed(), 1);
+    qCDebug(lcStats).noquote() << QString("replay[%1]: %2 segments in %3 ms, %4 segments/s")
+                                      .arg(StrokeRaster::backendName(StrokeRaster::backend()))
+                                      .arg(log.segmentCount())
+                                      .arg(nsecs / 1000000.0, 0, 'f', 2)
+                                      .arg(qint64(log.segmentCount() * 1e9 / nsecs));
+    strokeLog = log;
+    strokeLogComplete = true;
+    dirtyTiles.fill(true);
+    redoStack.clear();
+    resetHistory(true);
+    if (!strokeLog.isEmpty()) {
+        checkpointDirty.fill(true);
+        takeCheckpoint();
+    }
+    update();
+    emit imageModified();
+}
+
+void DrawingArea::resetTiles()
+{
+    const int count = TileSync::columns(image.size()) * TileSync::rows(image.size());
+    dirtyTiles = QBitArray(count, true);
+    tileHashes.fill(0, count);
+}
+
+void DrawingArea::markDirty(const QRect &rect)
+{
+    const QRect clipped = rect.intersected(image.rect());
+    if (clipped.isEmpty())
+        return;
+
+    const int columns = TileSync::columns(image.size());
+    const int firstColumn = clipped.left() / TileSync::kTileSize;
+    const int lastColumn = clipped.right() / TileSync::kTileSize;
+    for (int row = clipped.top() / TileSync::kTileSize; row <= clipped.bottom() / TileSync::kTileSize; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            dirtyTiles.setBit(row * columns + column);
+            if (!historyStale)
+                checkpointDirty.setBit(row * columns + column);
+        }
+    }
+}
+
+TileSync::Manifest DrawingArea::tileManifest()
+{
+    for (int i = 0; i < tileHashes.size(); ++i) {
+        if (dirtyTiles.testBit(i)) {
+            tileHashes[i] = TileSync::hashTile(image, TileSync::tileRect(image.size(), i));
+            dirtyTiles.clearBit(i);
+        }
+    }
+
+    TileSync::Manifest manifest;
+    manifest.size = image.size();
+    manifest.hashes = tileHashes;
+    return manifest;
+}
+
+QImage DrawingArea::tileImage(int index) const
+{
+    return image.copy(TileSync::tileRect(image.size(), index));
+}
+
+void DrawingArea::resizeCanvas(const QSize &size)
+{
+    if (image.size() == size)
+        return;
+
+    resizeImage(&image, size);
+    strokeLog.clear();
+    strokeLogComplete = false;
+    historyStale = true;
+    resetTiles();
+    update();
+}
+
+void DrawingArea::setTile(int index, const QImage &tile, quint64 hash)
+{
+    const QRect rect = TileSync::tileRect(image.size(), index);
+    if (rect.isEmpty())
+        return;
+
+    QPainter painter(&image);
+    painter.drawImage(rect.topLeft(), tile);
+    painter.end();
+    tileHashes[index] = hash;
+    dirtyTiles.clearBit(index);
+    strokeLog.clear();
+    strokeLogComplete = false;
+    historyStale = true;
+    update(rect);
+}
+
 DrawGame::DrawGame(QWidget *parent) :
 
     QMainWindow(parent),
     ui(new Ui::DrawGame),
     gameTimer(new QTimer(this)),
+    statsTimer(new QTimer(this)),
+    strokeBatcher(new StrokeBatcher(this)),
+    imageCodec(new ImageCodec(this)),
+    clearedStrokeId(0),
+    jitterBuffer(new JitterBuffer(this)),
+    reportedJitterStrokes(0),
+    frameTimer(new QTimer(this)),
+    maxFrameGap(0),
+    lateFrames(0),
+    maxImageJobs(0),
+    watchOnly(false),
     isDrawer(false),
+    isSpectator(false),
     secondsLeft(180),
-    server(nullptr),
+    roomServer(nullptr),
     clientSocket(nullptr),
-    isServer(false)
+    isServer(false),
+    binarySend(false),
+    binaryVersion(Protocol::kBinaryVersion),
+    sendSequence(0),
+    receiveSequence(0),
+    outboxResync(false),
+    udpSocket(nullptr),
+    udpTimer(new QTimer(this)),
+    udpPort(0),
+    udpToken(0),
+    udpReady(false),
+    udpSendSequence(0),
+    udpReceiveSequence(0),
+    udpResyncPending(false),
+    udpResyncAgain(false),
+    udpLossPercent(qBound(0, qEnvironmentVariableIntValue("DRAWGAME_UDP_LOSS"), 100)),
+    udpJitterMs(qMax(0, qEnvironmentVariableIntValue("DRAWGAME_UDP_JITTER"))),
+    syncMode(SyncMode::Delta),
+    snapshotFormat(SnapshotCodec::Format::Qoi)
 {
     ui->setupUi(this);
 
-    wordList << "Машина" << "Река" << "Гора" << "Книга" << "Цветок"
-             << "Солнце" << "Дерево" << "Окно" << "Часы" << "Телефон"
-             << "Яблоко" << "Кошка" << "Собака" << "Море" << "Снег"
-             << "Дождь" << "Гитара" << "Футбол" << "Компьютер" << "Ручка"
-             << "Самолет" << "Велосипед" << "Мороженое" << "Торт" << "Музыка"
-             << "Звезда" << "Луна" << "Огонь" << "Вода" << "Воздух"
-             << "Земля" << "Молния" << "Радуга" << "Вулкан" << "Остров"
-             << "Пустыня" << "Лес" << "Поле" << "Сад" << "Учитель"
-             << "Врач" << "Повар" << "Космонавт" << "Робот" << "Дракон"
-             << "Замок" << "Мост" << "Фонарь" << "Ключ" << "Зонт"
-             << "Чемодан" << "Карта" << "Глобус" << "Телевизор" << "Микрофон"
-             << "Фотоаппарат" << "Кино" << "Театр" << "Цирк" << "Музей"
-             << "Библиотека" << "Школа" << "Университет" << "Стадион" << "Ресторан"
-             << "Пирамида" << "Сфинкс" << "Эйфелева башня" << "Кремль" << "Водопад"
-             << "Айсберг" << "Пингвин" << "Кенгуру" << "Слон" << "Тигр"
-             << "Медведь" << "Волк" << "Лиса" << "Заяц" << "Ежик"
-             << "Бабочка" << "Пчела" << "Муравей" << "Рыба" << "Дельфин"
-             << "Кит" << "Акула" << "Черепаха" << "Змея" << "Ящерица"
-             << "Динозавр" << "Вампир" << "Привидение" << "Фея" << "Волшебник"
-             << "Супергерой" << "Космос" << "Ракета" << "Спутник" << "НЛО"
-             << "Парашют" << "Подводная лодка" << "Корабль" << "Поезд" << "Метро";
-
     QLayoutItem* item = ui->horizontalLayout->takeAt(0);
     if (item) {
         delete item->widget();
@@ -177,11 +651,46 @@ DrawGame::DrawGame(QWidget *parent) :
     drawingArea = new DrawingArea(this);
     drawingArea->setMinimumSize(600, 400);
     ui->horizontalLayout->insertWidget(0, drawingArea);
-    drawingArea->setMouseTracking(true);
-    setMouseTracking(true);
     drawingArea->setFocusPolicy(Qt::StrongFocus);
     gameTimer->setInterval(1000);
-    connect(drawingArea, &DrawingArea::imageModified, this, &DrawGame::sendFullState);
+    statsTimer->setInterval(1000);
+    connect(statsTimer, &QTimer::timeout, this, &DrawGame::reportTraffic);
+    statsTimer->start();
+    frameTimer->setInterval(16);
+    connect(frameTimer, &QTimer::timeout, this, &DrawGame::onFrameTick);
+    frameClock.start();
+    frameTimer->start();
+    udpTimer->setInterval(1000);
+    connect(udpTimer, &QTimer::timeout, this, &DrawGame::sendUdpHello);
+    connect(imageCodec, &ImageCodec::encoded, this, &DrawGame::onImageEncoded);
+    connect(imageCodec, &ImageCodec::decoded, this, &DrawGame::onImageDecoded);
+    connect(jitterBuffer, &JitterBuffer::strokesReady, drawingArea, &DrawingArea::applyStrokes);
+    if (qEnvironmentVariable("DRAWGAME_JITTER") == "0")
+        jitterBuffer->setEnabled(false);
+    if (qEnvironmentVariable("DRAWGAME_SMOOTH") == "1")
+        jitterBuffer->setSmoothing(true);
+    bool flushOk = false;
+    int flushInterval = qEnvironmentVariableIntValue("DRAWGAME_FLUSH_MS", &flushOk);
+    if (flushOk)
+        setStrokeFlushInterval(flushInterval);
+    connect(strokeBatcher, &StrokeBatcher::strokeReady, this, &DrawGame::onStrokeReady);
+    if (qEnvironmentVariableIsSet("DRAWGAME_SIMPLIFY_PX"))
+        drawingArea->setSimplifyTolerance(qEnvironmentVariable("DRAWGAME_SIMPLIFY_PX").toDouble());
+    if (qEnvironmentVariableIsSet("DRAWGAME_RECORD")) {
+        const QString path = qEnvironmentVariable("DRAWGAME_RECORD");
+        if (recorder.open(path))
+            qDebug() << "Recording session to" << path;
+        else
+            qWarning() << "Cannot record to" << path << ":" << recorder.errorString();
+    }
+    if (qEnvironmentVariable("DRAWGAME_SYNC") == "snapshot")
+        syncMode = SyncMode::Snapshot;
+    snapshotFormat = SnapshotCodec::formatFromName(qEnvironmentVariable("DRAWGAME_SNAPSHOT"), snapshotFormat);
+    StrokeRaster::setBackend(StrokeRaster::backendFromName(qEnvironmentVariable("DRAWGAME_RASTER"),
+                                                           StrokeRaster::backend()));
+    connect(drawingArea, &DrawingArea::segmentDrawn, this, &DrawGame::onSegmentDrawn);
+    connect(drawingArea, &DrawingArea::imageModified, this, &DrawGame::onImageModified);
+    connect(drawingArea, &DrawingArea::strokeFinished, this, &DrawGame::onStrokeFinished);
     setupConnections();
     updateToolsAvailability();
 
@@ -190,8 +699,10 @@ DrawGame::DrawGame(QWidget *parent) :
     isServer = (reply == QMessageBox::Yes);
 
     if (isServer) {
-        server = new QTcpServer(this);
-        if (!server->listen(QHostAddress::Any, 12345)) {
+        roomServer = new RoomServer(this);
+        roomServer->setWorkerCount(1);
+        roomServer->setUdpEnabled(qEnvironmentVariable("DRAWGAME_UDP") == "1");
+        if (!roomServer->listen(QHostAddress::Any, 12345)) {
             QMessageBox::critical(this, "Ошибка", "Не удалось запустить сервер!");
             return;
         }
@@ -208,39 +719,23 @@ DrawGame::DrawGame(QWidget *parent) :
             ipAddress = QHostAddress(QHostAddress::LocalHost).toString();
 
         ui->statusLabel->setText(tr("Сервер запущен на %1:%2. Ожидание подключения...")
-                                     .arg(ipAddress).arg(server->serverPort()));
+                                     .arg(ipAddress).arg(roomServer->serverPort()));
 
-        connect(server, &QTcpServer::newConnection, this, &DrawGame::newConnection);
-        isDrawer = true;
+        connectToServer(QHostAddress(QHostAddress::LocalHost).toString());
     } else {
         bool ok;
         QString host = QInputDialog::getText(this, "Подключение к серверу",
-                                             "Введите IP сервера:", QLineEdit::Normal,
+                                             "Введите IP сервера (комната через /, например 127.0.0.1/room;\n"
+                                             "127.0.0.1/room/watch — только смотреть):",
+                                             QLineEdit::Normal,
                                              "127.0.0.1", &ok);
         if (!ok || host.isEmpty()) return;
 
-        clientSocket = new QTcpSocket(this);
-        connect(clientSocket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
-            QMessageBox::critical(this, "Ошибка", "Ошибка подключения: " + clientSocket->errorString());
-        });
-
-        clientSocket->connectToHost(host, 12345);
-
-        connect(clientSocket, &QTcpSocket::connected, this, [this]() {
-            ui->statusLabel->setText("Подключено к серверу");
-            if (!isServer) {
-                sendData("REQUEST_IMAGE:");
-            }
-        });
-
-
-        connect(clientSocket, &QTcpSocket::readyRead, this, &DrawGame::readData);
-        connect(clientSocket, &QTcpSocket::disconnected, this, &DrawGame::disconnected);
+        connectToServer(host);
     }
 
 
     updateToolsAvailability();
-    onStartGameClicked();
 
     connect(ui->messageLineEdit, &QLineEdit::returnPressed, this,
             &DrawGame::onSendMessageClicked);
@@ -266,45 +761,172 @@ DrawGame::~DrawGame()
     delete ui;
 }
 
-void DrawGame::sendFullState()
+void DrawGame::connectToServer(const QString &address)
 {
-    if (!clientSocket || !isDrawer) return;
+    // "host/room" joins a named room, a bare host joins the default one and
+    // "host/room/watch" only watches it
+    QString host = address.section('/', 0, 0).trimmed();
+    roomName = address.section('/', 1, 1).trimmed();
+    watchOnly = (address.section('/', 2).trimmed() == "watch");
+    if (roomName.isEmpty())
+        roomName = RoomServer::kDefaultRoom;
+
+    clientSocket = new QTcpSocket(this);
+    resetProtocol();
+    connect(clientSocket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        QMessageBox::critical(this, "Ошибка", "Ошибка подключения: " + clientSocket->errorString());
+    });
+
+    clientSocket->connectToHost(host, 12345);
+
+    connect(clientSocket, &QTcpSocket::connected, this, [this]() {
+        clientSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        if (!isServer) {
+            ui->statusLabel->setText("Подключено к серверу");
+        }
+        if (watchOnly) {
+            // the room sends a spectator its catch-up without being asked
+            sendData(Protocol::makeText(Protocol::MessageType::Watch, roomName));
+        } else {
+            sendData(Protocol::makeText(Protocol::MessageType::Join, roomName));
+            sendData(Protocol::makeText(Protocol::MessageType::RequestImage));
+        }
+    });
+
+    connect(clientSocket, &QTcpSocket::readyRead, this, &DrawGame::readData);
+    connect(clientSocket, &QTcpSocket::bytesWritten, this, &DrawGame::pumpOutbox);
+    connect(clientSocket, &QTcpSocket::disconnected, this, &DrawGame::disconnected);
+}
+
+qint64 DrawGame::sendFullState()
+{
+    if (!clientSocket || !isDrawer) return 0;
 
     sendImageData();
 
-    QString params = QString("PARAMS:%1,%2,%3,%4,%5")
-                         .arg(drawingArea->getPenColor().red())
-                         .arg(drawingArea->getPenColor().green())
-                         .arg(drawingArea->getPenColor().blue())
-                         .arg(drawingArea->isEraserMode() ? 1 : 0)
-                         .arg(drawingArea->getPenWidth());
-    sendData(params);
+    return sendData(Protocol::makeParams(currentPen()));
 }
 
+Protocol::PenParams DrawGame::currentPen() const
+{
+    Protocol::PenParams pen;
+    pen.color = drawingArea->getPenColor();
+    pen.eraser = drawingArea->isEraserMode();
+    pen.width = drawingArea->getPenWidth();
+    return pen;
+}
 
-void DrawGame::assignRandomRole()
+void DrawGame::onSegmentDrawn(const QPoint &from, const QPoint &to, const Protocol::PenParams &pen)
 {
-    isDrawer = isServer;
-    if (clientSocket) {
-        sendData(QString("ROLE:%1").arg(isServer ? "GUESSER" : "DRAWER"));
-    }
+    if (syncMode == SyncMode::Delta && isDrawer)
+        strokeBatcher->addSegment(from, to, pen);
+}
 
-    updateToolsAvailability();
+void DrawGame::onStrokeReady(const Protocol::Stroke &stroke)
+{
+    syncStats.currentStrokeBytes += sendDrawingData(stroke);
 }
 
-void DrawGame::switchRoles(bool wordGuessed)
+void DrawGame::setStrokeFlushInterval(int msec)
 {
-    if (wordGuessed) {
-        isDrawer = !isDrawer;
-        if (clientSocket) {
-            sendData(QString("ROLE:%1").arg(isDrawer ? "GUESSER" : "DRAWER"));
-        }
+    strokeBatcher->setFlushInterval(qBound(1, msec, 1000));
+    drawingArea->setSettleInterval(strokeBatcher->flushInterval());
+}
+
+int DrawGame::strokeFlushInterval() const
+{
+    return strokeBatcher->flushInterval();
+}
+
+void DrawGame::reportTraffic()
+{
+    recorder.flush();
+
+    if (maxImageJobs > 0 || lateFrames > 0) {
+        qCDebug(lcStats).noquote() << QString("frame: max gap %1 ms, %2 late ticks, up to %3 image jobs in flight, %4 stale results dropped")
+                                          .arg(maxFrameGap).arg(lateFrames).arg(maxImageJobs).arg(imageCodec->staleResults());
+    }
+    maxFrameGap = 0;
+    lateFrames = 0;
+    maxImageJobs = 0;
+
+    const DrawingArea::InputStats input = drawingArea->takeInputStats();
+    if (input.paints > 0) {
+        qCDebug(lcStats).noquote() << QString("input: %1 events, %2 points (%3 kept) in %4 raster passes, latency to paint avg %5 ms, max %6 ms")
+                                          .arg(input.events).arg(input.points).arg(input.keptPoints).arg(input.rasterPasses)
+                                          .arg(input.latencyNsecs / qint64(input.paints) / 1e6, 0, 'f', 2)
+                                          .arg(input.maxLatencyNsecs / 1e6, 0, 'f', 2);
     }
 
-    updateToolsAvailability();
-    onStartGameClicked();
+    const JitterBuffer::Stats jitter = jitterBuffer->stats();
+    if (jitter.strokes != reportedJitterStrokes) {
+        qCDebug(lcStats).noquote() << QString("jitter: depth %1 ms, %2 points buffered, %3 late of %4 strokes")
+                                          .arg(jitter.depth).arg(jitter.buffered).arg(jitter.late).arg(jitter.strokes);
+        reportedJitterStrokes = jitter.strokes;
+    }
+
+    const QString simulation = udpLossPercent || udpJitterMs
+                                   ? QString(" (simulating %1% loss, %2 ms jitter)").arg(udpLossPercent).arg(udpJitterMs)
+                                   : QString(" (no simulated loss)");
+    if (syncStats.udpReceived != syncStats.reportedUdpReceived) {
+        qCDebug(lcStats).noquote() << QString("udp: %1 datagrams/s, %2 lost, %3 stale, %4 resyncs so far%5")
+                                          .arg(syncStats.udpReceived - syncStats.reportedUdpReceived)
+                                          .arg(syncStats.udpLost).arg(syncStats.udpStale).arg(syncStats.udpResyncs)
+                                          .arg(simulation);
+        syncStats.reportedUdpReceived = syncStats.udpReceived;
+    }
+
+    const JitterBuffer::Latency latency = jitterBuffer->takeLatency();
+    if (latency.strokes > 0) {
+        qCDebug(lcStats).noquote() << QString("latency: %1 strokes, send to paint avg %2 ms, p99 %3 ms, max %4 ms%5")
+                                          .arg(latency.strokes).arg(latency.mean, 0, 'f', 1)
+                                          .arg(latency.p99).arg(latency.max).arg(simulation);
+    }
+
+    quint64 messages = syncStats.messages - syncStats.reportedMessages;
+    quint64 bytes = syncStats.bytes - syncStats.reportedBytes;
+    if (messages == 0) return;
+
+    qCDebug(lcStats).noquote() << QString("net: %1 msg/s, %2 B/s (flush interval %3 ms)")
+                                      .arg(messages).arg(bytes).arg(strokeFlushInterval());
+    syncStats.reportedMessages = syncStats.messages;
+    syncStats.reportedBytes = syncStats.bytes;
+}
+
+void DrawGame::onImageModified()
+{
+    // simplified input comes in settled batches that are strokes already
+    if (drawingArea->getSimplifyTolerance() > 0)
+        strokeBatcher->flush();
+    if (syncMode == SyncMode::Snapshot)
+        syncStats.currentStrokeBytes += sendFullState();
 }
 
+void DrawGame::onStrokeFinished(int rawPoints, int keptPoints)
+{
+    strokeBatcher->flush();
+    if (!clientSocket || !isDrawer) return;
+
+    if (keptPoints > 0) {
+        qCDebug(lcStats).noquote() << QString("simplify: %1 -> %2 points, ratio %3 at %4 px tolerance")
+                                          .arg(rawPoints).arg(keptPoints)
+                                          .arg(double(rawPoints) / keptPoints, 0, 'f', 2)
+                                          .arg(drawingArea->getSimplifyTolerance());
+    }
+    syncStats.strokes++;
+    syncStats.strokeBytes += syncStats.currentStrokeBytes;
+    qCDebug(lcStats).noquote() << QString("sync[%1]: stroke %2 bytes, avg %3 bytes/stroke over %4 strokes; "
+                                          "snapshots: %5, %6 bytes")
+                                      .arg(syncMode == SyncMode::Delta ? "delta" : "snapshot")
+                                      .arg(syncStats.currentStrokeBytes)
+                                      .arg(syncStats.strokeBytes / syncStats.strokes)
+                                      .arg(syncStats.strokes)
+                                      .arg(syncStats.snapshots)
+                                      .arg(syncStats.snapshotBytes);
+    syncStats.currentStrokeBytes = 0;
+}
+
+
 void DrawGame::setupConnections()
 {
 
@@ -312,87 +934,288 @@ void DrawGame::setupConnections()
     connect(ui->colorComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &DrawGame::onColorChanged);
     connect(ui->clearButton, &QPushButton::clicked, this, &DrawGame::onClearClicked);
+    connect(ui->undoButton, &QPushButton::clicked, this, &DrawGame::onUndoClicked);
+    connect(ui->redoButton, &QPushButton::clicked, this, &DrawGame::onRedoClicked);
     connect(ui->eraserButton, &QPushButton::toggled, this, &DrawGame::onEraserClicked);
     connect(gameTimer, &QTimer::timeout, this, &DrawGame::updateGame);
 }
 
-void DrawGame::sendDrawingData(const QPoint& from, const QPoint& to)
+qint64 DrawGame::sendDrawingData(const Protocol::Stroke &stroke)
 {
-    if (clientSocket && clientSocket->state() == QAbstractSocket::ConnectedState && isDrawer) {
-        QString data = QString("DRAW:%1,%2;%3,%4;%5,%6,%7,%8,%9")
-        .arg(from.x()).arg(from.y())
-            .arg(to.x()).arg(to.y())
-            .arg(drawingArea->getPenColor().red())
-            .arg(drawingArea->getPenColor().green())
-            .arg(drawingArea->getPenColor().blue())
-            .arg(drawingArea->isEraserMode() ? 1 : 0)
-            .arg(drawingArea->getPenWidth());
-        sendData(data);
+    if (!clientSocket || clientSocket->state() != QAbstractSocket::ConnectedState || !isDrawer)
+        return 0;
+    if (holdWhileEncoding(Protocol::makeStroke(stroke)))
+        return 0;
+
+    if (binarySend) {
+        const Protocol::Message message = Protocol::makeStroke(stroke);
+        if (udpReady) {
+            qint64 sent = sendUdp(message);
+            if (sent > 0)
+                return sent;
+        }
+        return sendData(message);
     }
+
+    // Text peers may predate STROKE: fall back to one DRAW line per segment,
+    // still written to the socket in one go.
+    recorder.record(SessionLog::Direction::Out, Protocol::makeStroke(stroke));
+    QByteArray data;
+    Protocol::DrawSegment segment;
+    segment.pen = stroke.pen;
+    for (int i = 1; i < stroke.points.size(); ++i) {
+        segment.from = stroke.points[i - 1];
+        segment.to = stroke.points[i];
+        data += Protocol::encodeText(Protocol::makeDraw(segment));
+    }
+    return writeData(data, Protocol::MessageType::Draw, stroke.points.size() - 1);
 }
 
-void DrawGame::sendImageData()
+// The PNG is encoded on the thread pool. Canvas traffic produced meanwhile
+// is held back and sent after the image so peers apply it on top; a newer
+// snapshot already contains it, so starting one drops what was held.
+void DrawGame::sendImageData(SnapshotCodec::Format format)
 {
     if (clientSocket && clientSocket->state() == QAbstractSocket::ConnectedState && isDrawer) {
-        QByteArray byteArray;
-        QBuffer buffer(&byteArray);
-        buffer.open(QIODevice::WriteOnly);
-        drawingArea->getImage().save(&buffer, "PNG");
-        buffer.close();
-        sendData("IMAGE:" + QString::fromLatin1(byteArray.toBase64()));
+        heldMessages.clear();
+        imageCodec->encode(drawingArea->getImage(), format);
+    }
+}
+
+void DrawGame::onImageEncoded(const QByteArray &data, qint64 msecs)
+{
+    if (!isDrawer) {
+        heldMessages.clear();
+        return;
+    }
+
+    qint64 bytes = sendData(Protocol::makeImage(data));
+    syncStats.snapshots++;
+    syncStats.snapshotBytes += bytes;
+    qCDebug(lcStats).noquote() << QString("snapshot: %1 %2 bytes, encoded in %3 ms off the GUI thread, %4 messages held")
+                                      .arg(SnapshotCodec::formatName(SnapshotCodec::detect(data)))
+                                      .arg(bytes).arg(msecs).arg(heldMessages.size());
+
+    const QList<Protocol::Message> held = heldMessages;
+    heldMessages.clear();
+    for (const Protocol::Message &message : held) {
+        if (message.type == Protocol::MessageType::Stroke)
+            bytes += sendDrawingData(message.stroke);
+        else
+            bytes += sendData(message);
     }
+    if (syncMode == SyncMode::Snapshot)
+        syncStats.currentStrokeBytes += bytes;
 }
 
+void DrawGame::onImageDecoded(const QImage &image, qint64 msecs)
+{
+    drawingArea->setImage(image);
+
+    const QList<Protocol::Message> deferred = deferredMessages;
+    deferredMessages.clear();
+    qCDebug(lcStats).noquote() << QString("snapshot: decoded in %1 ms off the GUI thread, replaying %2 messages")
+                                      .arg(msecs).arg(deferred.size());
+    for (const Protocol::Message &message : deferred)
+        handleMessage(message);
+    flushReceivedStrokes();
+}
 
+bool DrawGame::holdWhileEncoding(const Protocol::Message &message)
+{
+    if (!imageCodec->isEncodePending())
+        return false;
+
+    switch (message.type) {
+    case Protocol::MessageType::Draw:
+    case Protocol::MessageType::Stroke:
+    case Protocol::MessageType::Params:
+    case Protocol::MessageType::Clear:
+    case Protocol::MessageType::Undo:
+    case Protocol::MessageType::StrokeLog:
+    case Protocol::MessageType::TileHashes:
+    case Protocol::MessageType::Tiles:
+        heldMessages.append(message);
+        return true;
+    default:
+        return false;
+    }
+}
 
-void DrawGame::onStartGameClicked()
+// Canvas traffic that arrives beside the chunks of a snapshot is newer than
+// the snapshot and waits for it as well.
+bool DrawGame::deferWhileDecoding(const Protocol::Message &message)
 {
-    if (!isServer && !clientSocket) {
-        QMessageBox::warning(this, "Ошибка", "Не подключен к серверу!");
-        return;
+    const bool assembling = receiveDecoder.isAssembling();
+    if (!imageCodec->isDecodePending() && !assembling)
+        return false;
+
+    switch (message.type) {
+    case Protocol::MessageType::Clear:
+    case Protocol::MessageType::StrokeLog:
+        if (assembling) {
+            deferredMessages.append(message);
+            return true;
+        }
+        // replaces the canvas anyway
+        imageCodec->cancel();
+        deferredMessages.clear();
+        return false;
+    case Protocol::MessageType::Draw:
+    case Protocol::MessageType::Stroke:
+    case Protocol::MessageType::Params:
+    case Protocol::MessageType::Undo:
+    case Protocol::MessageType::TileHashes:
+    case Protocol::MessageType::Tiles:
+        deferredMessages.append(message);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// A snapshot that came in chunks: what was deferred meanwhile goes on top
+// of it, through handleMessage() again so it waits for the decode if the
+// snapshot is an image.
+void DrawGame::completeIncomingSnapshot(const Protocol::Message &message)
+{
+    const QList<Protocol::Message> newer = deferredMessages;
+    deferredMessages.clear();
+    handleMessage(message);
+    for (const Protocol::Message &deferred : newer)
+        handleMessage(deferred);
+}
+
+void DrawGame::cancelImageJobs()
+{
+    imageCodec->cancel();
+    heldMessages.clear();
+    deferredMessages.clear();
+}
+
+void DrawGame::onFrameTick()
+{
+    qint64 gap = frameClock.restart();
+    maxFrameGap = qMax(maxFrameGap, gap);
+    if (gap > 2 * frameTimer->interval())
+        lateFrames++;
+    maxImageJobs = qMax(maxImageJobs, imageCodec->jobsInFlight());
+}
+
+qint64 DrawGame::sendStrokeLog()
+{
+    if (!clientSocket || clientSocket->state() != QAbstractSocket::ConnectedState || !isDrawer)
+        return 0;
+
+    const StrokeLog &log = drawingArea->getStrokeLog();
+    qint64 bytes = sendData(Protocol::makeStrokeLog(log.encode(binaryVersion)));
+    syncStats.snapshots++;
+    syncStats.snapshotBytes += bytes;
+    qCDebug(lcStats).noquote() << QString("snapshot: stroke log, %1 strokes / %2 points, %3 bytes on the wire, %4 bytes in memory")
+                                      .arg(log.strokeCount()).arg(log.pointCount()).arg(bytes).arg(log.memoryBytes());
+    return bytes;
+}
+
+qint64 DrawGame::sendTileManifest()
+{
+    if (!clientSocket || clientSocket->state() != QAbstractSocket::ConnectedState || !isDrawer)
+        return 0;
+
+    return sendData(Protocol::makeTiles(Protocol::MessageType::TileHashes,
+                                        TileSync::encodeManifest(drawingArea->tileManifest())));
+}
+
+qint64 DrawGame::sendTiles(const TileSync::Request &request)
+{
+    if (!clientSocket || clientSocket->state() != QAbstractSocket::ConnectedState || !isDrawer)
+        return 0;
+
+    Metrics::ScopedTimer probe(Metrics::Timing::Encode);
+    QElapsedTimer timer;
+    timer.start();
+    TileSync::Manifest manifest = drawingArea->tileManifest();
+    TileSync::TileSet set;
+    set.id = request.id;
+    set.size = manifest.size;
+    for (int index : request.indices) {
+        if (index >= manifest.hashes.size())
+            continue;
+        TileSync::Tile tile;
+        tile.index = index;
+        tile.hash = manifest.hashes[index];
+        tile.data = SnapshotCodec::encode(drawingArea->tileImage(index), snapshotFormat);
+        set.tiles.append(tile);
+    }
+    const qint64 encodeMsecs = timer.elapsed();
+
+    qint64 bytes = sendData(Protocol::makeTiles(Protocol::MessageType::Tiles, TileSync::encodeTileSet(set)));
+    syncStats.snapshots++;
+    syncStats.snapshotBytes += bytes;
+    qCDebug(lcStats).noquote() << QString("snapshot: %1 of %2 tiles as %3, %4 bytes, encoded in %5 ms")
+                                      .arg(set.tiles.size()).arg(manifest.hashes.size())
+                                      .arg(SnapshotCodec::formatName(snapshotFormat)).arg(bytes).arg(encodeMsecs);
+    return bytes;
+}
+
+void DrawGame::requestMissingTiles(const TileSync::Manifest &manifest)
+{
+    if (isDrawer || manifest.tileSize != TileSync::kTileSize) return;
+
+    drawingArea->resizeCanvas(manifest.size);
+    const QVector<quint64> own = drawingArea->tileManifest().hashes;
+
+    TileSync::Request request;
+    for (int i = 0; i < manifest.hashes.size(); ++i) {
+        if (own.value(i) != manifest.hashes[i])
+            request.indices.append(i);
+    }
+    if (!request.indices.isEmpty())
+        sendData(Protocol::makeTiles(Protocol::MessageType::RequestTiles, TileSync::encodeRequest(request)));
+}
+
+void DrawGame::applyTiles(const TileSync::TileSet &set)
+{
+    if (isDrawer || set.tileSize != TileSync::kTileSize) return;
+
+    drawingArea->resizeCanvas(set.size);
+    for (const TileSync::Tile &tile : set.tiles) {
+        QImage image;
+        if (SnapshotCodec::decode(tile.data, &image))
+            drawingArea->setTile(tile.index, image, tile.hash);
     }
+}
+
 
-    if (isServer && !clientSocket) {
-        ui->statusLabel->setText("Ожидание подключения соперника...");
+
+void DrawGame::onStartGameClicked()
+{
+    if (!clientSocket) {
+        QMessageBox::warning(this, "Ошибка", "Не подключен к серверу!");
         return;
     }
 
-    generateRandomWord();
+    cancelImageJobs();
+    jitterBuffer->reset();
     gameTimer->start();
-    secondsLeft = 180;
+    secondsLeft = GameRoom::kRoundSeconds;
     ui->statusLabel->setText("Статус: Игра началась! Время: 3:00");
     drawingArea->clear();
-
-    if (isDrawer) {
-        ui->wordLabel->setText("Слово: " + currentWord);
-        if (clientSocket) {
-            sendData("WORD:" + currentWord);
-        }
-    } else {
-        ui->wordLabel->setText("Слово: *****");
-    }
+    undoneStrokes.clear();
+    clearedStrokeId = 0;
+    currentWord.clear();
+    ui->wordLabel->setText("Слово: *****");
 }
 
 void DrawGame::onSendMessageClicked()
 {
     QString message = ui->messageLineEdit->text().trimmed();
-    if (!message.isEmpty()) {
+    if (!message.isEmpty() && !isSpectator) {
         ui->chatTextEdit->append("Вы: " + message);
         ui->messageLineEdit->clear();
 
+        // the room checks guesses and answers with WIN or CLOSE
         if (clientSocket) {
-            sendData("CHAT:" + message);
-        }
-
-        if (!isDrawer && message.compare(currentWord, Qt::CaseInsensitive) == 0) {
-            gameTimer->stop();
-            ui->chatTextEdit->append("Система: Слово угадано! Это было \"" + currentWord + "\"");
-            QMessageBox::information(this, "Поздравляем!", "Вы угадали слово: " + currentWord);
-
-            if (clientSocket) {
-                sendData("WIN:" + currentWord);
-            }
-            switchRoles(true);
+            sendData(Protocol::makeText(Protocol::MessageType::Chat, message));
         }
     }
 }
@@ -417,11 +1240,32 @@ void DrawGame::onClearClicked()
 {
     drawingArea->clear();
     if (clientSocket) {
-        sendData("CLEAR:");
+        sendData(Protocol::makeText(Protocol::MessageType::Clear, QString::number(drawingArea->lastStrokeId())));
         sendImageData();
     }
 }
 
+// Peers only get the stroke id to remove, a redo is sent as new strokes.
+void DrawGame::onUndoClicked()
+{
+    if (!isDrawer) return;
+
+    strokeBatcher->flush();
+    const quint32 strokeId = drawingArea->undo();
+    if (strokeId && clientSocket)
+        sendData(Protocol::makeText(Protocol::MessageType::Undo, QString::number(strokeId)));
+}
+
+void DrawGame::onRedoClicked()
+{
+    if (!isDrawer) return;
+
+    strokeBatcher->flush();
+    const QVector<Protocol::Stroke> strokes = drawingArea->redo();
+    for (const Protocol::Stroke &stroke : strokes)
+        syncStats.currentStrokeBytes += sendDrawingData(stroke);
+}
+
 void DrawGame::onEraserClicked(bool checked)
 {
     drawingArea->setEraserMode(checked);
@@ -444,170 +1288,510 @@ void DrawGame::updateGame()
 
     if (secondsLeft <= 0) {
         gameTimer->stop();
-        QMessageBox::information(this, "Время вышло!", "Слово было: " + currentWord);
-        onStartGameClicked();
     }
 }
 
-void DrawGame::generateRandomWord()
-{
-    if (!wordList.isEmpty()) {
-        int randomIndex = QRandomGenerator::global()->bounded(wordList.size());
-        currentWord = wordList.at(randomIndex);
-    }
-}
 
 
-
-void DrawGame::newConnection()
+void DrawGame::processDrawingCommand(const Protocol::DrawSegment &segment)
 {
-    if (clientSocket) {
-        clientSocket->disconnectFromHost();
-        delete clientSocket;
-    }
-
-    clientSocket = server->nextPendingConnection();
-    connect(clientSocket, &QTcpSocket::readyRead, this, &DrawGame::readData);
-    connect(clientSocket, &QTcpSocket::disconnected, this, &DrawGame::disconnected);
-
-    ui->statusLabel->setText("Клиент подключен");
-    assignRandomRole();
-    onStartGameClicked();
+    if (isDrawer) return;
 
-    sendFullState();
+    DrawingArea::appendSegment(&receivedStrokes, segment);
 }
 
-void DrawGame::processDrawingCommand(const QString &data)
+void DrawGame::processStrokeCommand(const Protocol::Stroke &stroke)
 {
-    if (isDrawer) return;
+    if (isDrawer || stroke.points.isEmpty()) return;
+    if (stroke.pen.strokeId && undoneStrokes.contains(stroke.pen.strokeId)) return;
 
-    QStringList parts = data.split(';');
-    if (parts.size() >= 3) {
-        QStringList start = parts[0].split(',');
-        QStringList end = parts[1].split(',');
-        QStringList params = parts[2].split(',');
-
-        if (start.size() == 2 && end.size() == 2 && params.size() >= 4) {
-            QPoint startPoint(start[0].toInt(), start[1].toInt());
-            QPoint endPoint(end[0].toInt(), end[1].toInt());
+    if (jitterBuffer->isEnabled() && !stroke.times.isEmpty()) {
+        jitterBuffer->push(stroke);
+    } else {
+        jitterBuffer->recordDirect(stroke);
+        receivedStrokes.append(stroke);
+    }
+}
 
-            drawingArea->blockSignals(true);
+void DrawGame::flushReceivedStrokes()
+{
+    if (receivedStrokes.isEmpty()) return;
 
-            drawingArea->setPenColor(QColor(params[0].toInt(), params[1].toInt(), params[2].toInt()));
-            drawingArea->setEraserMode(params[3].toInt());
-            if (params.size() > 4) {
-                drawingArea->setPenWidth(params[4].toInt());
-            }
+    const Protocol::Stroke &last = receivedStrokes.last();
+    drawingArea->blockSignals(true);
+    applyPen(last.pen);
+    drawingArea->setLastPoint(last.points.last());
+    drawingArea->blockSignals(false);
 
-            drawingArea->setLastPoint(startPoint);
-            drawingArea->publicDrawLineTo(endPoint);
+    drawingArea->applyStrokes(receivedStrokes);
+    receivedStrokes.clear();
+}
 
-            drawingArea->blockSignals(false);
-        }
+void DrawGame::applyPen(const Protocol::PenParams &pen)
+{
+    drawingArea->setPenColor(pen.color);
+    drawingArea->setEraserMode(pen.eraser);
+    if (pen.width >= 0) {
+        drawingArea->setPenWidth(pen.width);
     }
 }
 
 void DrawGame::readData()
 {
-    while (clientSocket->bytesAvailable() > 0) {
-        QByteArray data = clientSocket->readAll();
-        QString strData = QString::fromUtf8(data);
-
-        QStringList messages = strData.split("\n", Qt::SkipEmptyParts);
-        for (const QString &message : messages) {
-            int separatorIndex = message.indexOf(':');
-            if (separatorIndex == -1) continue;
-
-            QString command = message.left(separatorIndex);
-            QString dataPart = message.mid(separatorIndex + 1);
-
-            if (command == "DRAW") {
-                processDrawingCommand(dataPart);
+    while (clientSocket && clientSocket->bytesAvailable() > 0) {
+        if (receiveDecoder.readFrom(clientSocket) <= 0) break;
+
+        FrameDecoder::Frame frame;
+        FrameDecoder::Status status;
+        while ((status = receiveDecoder.next(&frame)) == FrameDecoder::Status::Ready) {
+            Protocol::Message message;
+            if (frame.mode == FrameDecoder::Mode::Binary) {
+                receiveSequence = frame.sequence;
             }
-            else if (command == "CLEAR") {
-                drawingArea->clear();
+            bool decoded;
+            {
+                Metrics::ScopedTimer timer(Metrics::Timing::Decode);
+                decoded = FrameDecoder::decode(frame, &message);
             }
-            else if (command == "WORD") {
-                currentWord = dataPart;
-                ui->wordLabel->setText(isDrawer ? "Слово: " + currentWord : "Слово: *****");
+            if (decoded) {
+                Metrics::count(Metrics::Direction::In, message.type,
+                               frame.size + (frame.mode == FrameDecoder::Mode::Binary ? Protocol::kFrameHeaderSize : 1));
+                recorder.record(SessionLog::Direction::In, message);
+                if (frame.assembled)
+                    completeIncomingSnapshot(message);
+                else
+                    handleMessage(message);
             }
-            else if (command == "ROLE") {
-                isDrawer = (dataPart == "DRAWER");
+            if (!clientSocket) break;
+        }
 
-            }
-            else if (command == "CHAT") {
-                ui->chatTextEdit->append("Соперник: " + dataPart);
-            }
-            else if (command == "WIN") {
-                gameTimer->stop();
-                currentWord = dataPart;
-                ui->chatTextEdit->append("Система: Соперник угадал слово \"" + currentWord + "\"");
-                QMessageBox::information(this, "Игра окончена", "Соперник угадал слово: " + currentWord);
-                switchRoles(true);
-            }
-            else if (command == "IMAGE") {
-                QByteArray byteArray = QByteArray::fromBase64(dataPart.toLatin1());
-                QImage image;
-                image.loadFromData(byteArray, "PNG");
-                drawingArea->setImage(image);
-            }
-            else if (command == "REQUEST_IMAGE") {
-                if (isDrawer) {
-                    sendImageData();
-                }
-            }
-            else if (command == "PARAMS") {
-                QStringList params = dataPart.split(',');
-                if (params.size() >= 4) {
-                    drawingArea->blockSignals(true);
-                    drawingArea->setPenColor(QColor(params[0].toInt(), params[1].toInt(), params[2].toInt()));
-                    drawingArea->setEraserMode(params[3].toInt());
-                    if (params.size() > 4) {
-                        drawingArea->setPenWidth(params[4].toInt());
-                    }
-                    drawingArea->blockSignals(false);
-                }
-            }
+        if (status == FrameDecoder::Status::Error) {
+            qWarning() << "Dropping peer:" << receiveDecoder.errorString();
+            ui->statusLabel->setText("Ошибка протокола: " + receiveDecoder.errorString());
+            clientSocket->abort();
+            break;
+        }
+    }
+    flushReceivedStrokes();
+}
+
+void DrawGame::handleMessage(const Protocol::Message &message)
+{
+    if (deferWhileDecoding(message))
+        return;
+    if (message.type != Protocol::MessageType::Draw && message.type != Protocol::MessageType::Stroke)
+        flushReceivedStrokes();
+
+    switch (message.type) {
+    case Protocol::MessageType::Draw:
+        processDrawingCommand(message.segment);
+        break;
+    case Protocol::MessageType::Stroke:
+        processStrokeCommand(message.stroke);
+        break;
+    case Protocol::MessageType::Undo: {
+        // the stroke may still sit in the jitter buffer, or come late by UDP
+        const quint32 strokeId = message.text.toUInt();
+        jitterBuffer->flush();
+        flushReceivedStrokes();
+        undoneStrokes.append(strokeId);
+        if (undoneStrokes.size() > 64)
+            undoneStrokes.removeFirst();
+        // only a snapshot taken before the stroke can still contain it
+        if (!drawingArea->removeStroke(strokeId) && !drawingArea->hasCompleteStrokeLog() && !isSpectator)
+            sendData(Protocol::makeText(Protocol::MessageType::RequestImage));
+        break;
+    }
+    case Protocol::MessageType::Clear:
+        // nothing lost before a clear matters any more
+        finishUdpResync();
+        clearedStrokeId = message.text.toUInt();
+        jitterBuffer->reset();
+        drawingArea->clear();
+        break;
+    case Protocol::MessageType::Word:
+        // guessers get the word as blanks until the round is over
+        currentWord = message.text;
+        ui->wordLabel->setText("Слово: " + currentWord);
+        break;
+    case Protocol::MessageType::Time:
+        secondsLeft = message.text.toInt();
+        if (secondsLeft <= 0) {
+            gameTimer->stop();
+            QMessageBox::information(this, "Время вышло!", "Слово было: " + currentWord);
+        }
+        break;
+    case Protocol::MessageType::Role:
+        isDrawer = (message.text == "DRAWER");
+        isSpectator = (message.text == "SPECTATOR");
+        updateToolsAvailability();
+        onStartGameClicked();
+        break;
+    case Protocol::MessageType::Chat:
+        ui->chatTextEdit->append("Соперник: " + message.text);
+        break;
+    case Protocol::MessageType::Close:
+        ui->chatTextEdit->append("Система: \"" + message.text + "\" — почти угадали!");
+        break;
+    case Protocol::MessageType::Win:
+        // comes after the next round's role: whoever guessed draws now
+        if (isDrawer) {
+            ui->chatTextEdit->append("Система: Слово угадано! Это было \"" + message.text + "\"");
+            QMessageBox::information(this, "Поздравляем!", "Вы угадали слово: " + message.text);
+        } else {
+            ui->chatTextEdit->append("Система: Соперник угадал слово \"" + message.text + "\"");
+            QMessageBox::information(this, "Игра окончена", "Соперник угадал слово: " + message.text);
+        }
+        break;
+    case Protocol::MessageType::Image:
+        finishUdpResync();
+        jitterBuffer->reset();
+        deferredMessages.clear();
+        imageCodec->decode(message.image);
+        break;
+    case Protocol::MessageType::StrokeLog: {
+        StrokeLog log;
+        finishUdpResync();
+        jitterBuffer->reset();
+        if (StrokeLog::decode(message.strokeLog, &log))
+            drawingArea->setStrokeLog(log);
+        else
+            qWarning() << "Ignoring malformed stroke log," << message.strokeLog.size() << "bytes";
+        break;
+    }
+    case Protocol::MessageType::RequestImage:
+        if (isDrawer) {
+            // "PNG" asks for a raster snapshot for a text peer. Binary peers
+            // get the stroke log, which is usually far smaller and replays
+            // losslessly, or else the tile hashes so they can fetch only the
+            // tiles they are missing. "KEYFRAME" asks for a full snapshot
+            // the room keeps for its spectators.
+            if (!binarySend || message.text == "PNG")
+                sendImageData();
+            else if (drawingArea->hasCompleteStrokeLog())
+                sendStrokeLog();
+            else if (message.text == "KEYFRAME")
+                sendImageData(snapshotFormat);
+            else
+                sendTileManifest();
         }
+        break;
+    case Protocol::MessageType::TileHashes: {
+        TileSync::Manifest manifest;
+        finishUdpResync();
+        jitterBuffer->flush();
+        if (TileSync::decodeManifest(message.tiles, &manifest))
+            requestMissingTiles(manifest);
+        break;
+    }
+    case Protocol::MessageType::RequestTiles: {
+        TileSync::Request request;
+        if (isDrawer && TileSync::decodeRequest(message.tiles, &request))
+            sendTiles(request);
+        break;
+    }
+    case Protocol::MessageType::Tiles: {
+        TileSync::TileSet set;
+        jitterBuffer->flush();
+        if (TileSync::decodeTileSet(message.tiles, &set))
+            applyTiles(set);
+        else
+            qWarning() << "Ignoring malformed tile set," << message.tiles.size() << "bytes";
+        break;
+    }
+    case Protocol::MessageType::Udp:
+        openUdpChannel(message.text);
+        break;
+    case Protocol::MessageType::Params:
+        drawingArea->blockSignals(true);
+        applyPen(message.pen);
+        drawingArea->blockSignals(false);
+        break;
+    case Protocol::MessageType::Proto:
+        if (!binarySend && Protocol::commonVersion(message.text) >= Protocol::kMinBinaryVersion) {
+            binaryVersion = Protocol::commonVersion(message.text);
+            flushOutbox();
+            sendData(Protocol::makeText(Protocol::MessageType::Binary, QString::number(binaryVersion)));
+            binarySend = true;
+        }
+        break;
+    case Protocol::MessageType::Binary:
+        receiveDecoder.setMode(FrameDecoder::Mode::Binary);
+        if (!binarySend) {
+            binaryVersion = qMax(Protocol::commonVersion(message.text), Protocol::kMinBinaryVersion);
+            flushOutbox();
+            sendData(Protocol::makeText(Protocol::MessageType::Binary, QString::number(binaryVersion)));
+            binarySend = true;
+        }
+        break;
+    default:
+        break;
     }
 }
 
+void DrawGame::resetProtocol()
+{
+    binarySend = false;
+    binaryVersion = Protocol::kBinaryVersion;
+    sendSequence = 0;
+    receiveSequence = 0;
+    receiveDecoder.reset();
+    outbox.clear();
+    outboxResync = false;
+}
+
 void DrawGame::disconnected()
 {
     ui->statusLabel->setText("Соединение разорвано");
+    cancelImageJobs();
+    jitterBuffer->reset();
+    closeUdpChannel();
     if (clientSocket) {
         clientSocket->deleteLater();
         clientSocket = nullptr;
     }
 }
 
-void DrawGame::sendData(const QString &data)
+qint64 DrawGame::sendData(const Protocol::Message &message)
 {
+    if (holdWhileEncoding(message))
+        return 0;
     if (clientSocket && clientSocket->state() == QAbstractSocket::ConnectedState) {
-        clientSocket->write((data + "\n").toUtf8());
+        recorder.record(SessionLog::Direction::Out, message);
+        QByteArray data;
+        {
+            Metrics::ScopedTimer timer(Metrics::Timing::Encode);
+            data = binarySend ? Protocol::encodeFrame(message, sendSequence++, binaryVersion)
+                              : Protocol::encodeText(message);
+        }
+        return writeData(data, message.type);
     }
+    return 0;
 }
 
-void DrawGame::mousePressEvent(QMouseEvent *event)
+// The server offered its UDP relay. Live strokes switch to it once our
+// hello is acknowledged; everything else stays on TCP. DRAWGAME_UDP=0
+// declines the offer.
+void DrawGame::openUdpChannel(const QString &offer)
 {
-    if (event->button() == Qt::LeftButton && isDrawer) {
-        QPoint pos = drawingArea->mapFromParent(event->pos());
-        if (drawingArea->rect().contains(pos)) {
-            drawingArea->handleMousePressEvent(event);
-            sendDrawingData(pos, pos);
+    quint16 port;
+    quint32 token;
+    if (!clientSocket || qEnvironmentVariable("DRAWGAME_UDP") == "0" || !UdpChannel::parseOffer(offer, &port, &token))
+        return;
+
+    if (!udpSocket) {
+        udpSocket = new QUdpSocket(this);
+        if (!udpSocket->bind()) {
+            qWarning() << "Cannot open UDP socket:" << udpSocket->errorString();
+            delete udpSocket;
+            udpSocket = nullptr;
+            return;
         }
+        connect(udpSocket, &QUdpSocket::readyRead, this, &DrawGame::readDatagrams);
+    }
+
+    udpHost = clientSocket->peerAddress();
+    udpPort = port;
+    udpToken = token;
+    udpReady = false;
+    udpSendSequence = 0;
+    udpReceiveSequence = 0;
+    udpResyncPending = false;
+    udpResyncAgain = false;
+    sendUdpHello();
+    udpTimer->start();
+}
+
+void DrawGame::closeUdpChannel()
+{
+    udpTimer->stop();
+    udpToken = 0;
+    udpReady = false;
+    if (udpSocket) {
+        udpSocket->deleteLater();
+        udpSocket = nullptr;
+    }
+}
+
+// Sent until the server answers and then kept up as a keepalive, which
+// also keeps NAT mappings open.
+void DrawGame::sendUdpHello()
+{
+    if (udpSocket && udpToken)
+        writeDatagram(UdpChannel::encodeDatagram(udpToken, 0));
+}
+
+qint64 DrawGame::sendUdp(const Protocol::Message &message)
+{
+    const QByteArray frame = Protocol::encodeFrame(message, udpSendSequence + 1, binaryVersion);
+    if (!udpSocket || frame.size() + UdpChannel::kHeaderSize > UdpChannel::kMaxDatagramSize)
+        return 0;
+
+    const QByteArray datagram = UdpChannel::encodeDatagram(udpToken, ++udpSendSequence, frame);
+    writeDatagram(datagram);
+    recorder.record(SessionLog::Direction::Out, message);
+    syncStats.messages++;
+    syncStats.bytes += datagram.size();
+    return datagram.size();
+}
+
+void DrawGame::writeDatagram(const QByteArray &datagram)
+{
+    if (udpDropped())
+        return;
+
+    const int delay = udpDelay();
+    if (delay == 0) {
+        udpSocket->writeDatagram(datagram, udpHost, udpPort);
+        return;
     }
+    QTimer::singleShot(delay, this, [this, datagram]() {
+        if (udpSocket)
+            udpSocket->writeDatagram(datagram, udpHost, udpPort);
+    });
 }
 
-void DrawGame::mouseMoveEvent(QMouseEvent *event)
+void DrawGame::readDatagrams()
 {
-    if ((event->buttons() & Qt::LeftButton) && isDrawer) {
-        QPoint pos = drawingArea->mapFromParent(event->pos());
-        if (drawingArea->rect().contains(pos)) {
-            drawingArea->handleMouseMoveEvent(event);
-            sendDrawingData(drawingArea->getLastPoint(), pos);
+    while (udpSocket && udpSocket->hasPendingDatagrams()) {
+        const QByteArray datagram = udpSocket->receiveDatagram().data();
+        if (udpDropped())
+            continue;
+
+        const int delay = udpDelay();
+        if (delay == 0) {
+            processDatagram(datagram);
+            continue;
         }
+        QTimer::singleShot(delay, this, [this, datagram]() { processDatagram(datagram); });
+    }
+}
+
+void DrawGame::processDatagram(const QByteArray &datagram)
+{
+    quint32 token, sequence;
+    Protocol::Message message;
+    if (!udpToken || !UdpChannel::decodeDatagram(datagram, &token, &sequence, &message) || token != udpToken)
+        return;
+
+    if (message.type == Protocol::MessageType::Invalid) {
+        if (!udpReady)
+            qDebug() << "UDP stroke channel ready on port" << udpPort;
+        udpReady = true;
+        return;
+    }
+
+    if (sequence <= udpReceiveSequence) {
+        syncStats.udpStale++;
+        return;
+    }
+    const quint32 gap = sequence - udpReceiveSequence - 1;
+    udpReceiveSequence = sequence;
+    syncStats.udpReceived++;
+    if (gap > 0) {
+        syncStats.udpLost += gap;
+        requestUdpResync();
     }
+
+    // CLEAR goes over TCP, so a stroke drawn before it can still arrive here
+    const quint32 strokeId = message.type == Protocol::MessageType::Stroke ? message.stroke.pen.strokeId
+                                                                           : message.segment.pen.strokeId;
+    if (strokeId && strokeId <= clearedStrokeId) {
+        syncStats.udpStale++;
+        return;
+    }
+
+    if (message.type == Protocol::MessageType::Stroke || message.type == Protocol::MessageType::Draw) {
+        recorder.record(SessionLog::Direction::In, message);
+        handleMessage(message);
+        flushReceivedStrokes();
+    }
+}
+
+// Lost strokes are never resent; the drawer's stroke log or tiles bring the
+// canvas back. One request is in flight at a time, and a loss noticed while
+// waiting asks again once the answer has been applied.
+void DrawGame::requestUdpResync()
+{
+    if (isDrawer)
+        return;
+    if (udpResyncPending) {
+        udpResyncAgain = true;
+        return;
+    }
+    udpResyncPending = true;
+    syncStats.udpResyncs++;
+    sendData(Protocol::makeText(Protocol::MessageType::RequestImage));
+}
+
+void DrawGame::finishUdpResync()
+{
+    udpResyncPending = false;
+    if (udpResyncAgain) {
+        udpResyncAgain = false;
+        requestUdpResync();
+    }
+}
+
+bool DrawGame::udpDropped() const
+{
+    return udpLossPercent > 0 && int(QRandomGenerator::global()->bounded(100)) < udpLossPercent;
+}
+
+int DrawGame::udpDelay() const
+{
+    return udpJitterMs > 0 ? int(QRandomGenerator::global()->bounded(udpJitterMs + 1)) : 0;
+}
+
+// Everything goes through the outbox and is written as the socket drains:
+// strokes overtake a snapshot that is still queued, and a peer that cannot
+// keep up costs us the queued strokes rather than unbounded memory.
+qint64 DrawGame::writeData(const QByteArray &data, Protocol::MessageType type, int messages)
+{
+    if (data.isEmpty() || !clientSocket || clientSocket->state() != QAbstractSocket::ConnectedState)
+        return 0;
+
+    const bool droppable = (type == Protocol::MessageType::Draw || type == Protocol::MessageType::Stroke);
+    Metrics::count(Metrics::Direction::Out, type, data.size());
+    outbox.enqueue(data, SendQueue::priorityOf(type), droppable, binarySend);
+    syncStats.messages += messages;
+    syncStats.bytes += data.size();
+
+    if (outbox.bytes() > SendQueue::kMaxQueuedBytes) {
+        qint64 dropped = outbox.dropDroppable();
+        qWarning() << "Slow connection: dropped" << dropped << "queued bytes of strokes";
+        if (isDrawer)
+            outboxResync = true;
+    }
+    pumpOutbox();
+    return data.size();
+}
+
+void DrawGame::pumpOutbox()
+{
+    {
+        Metrics::ScopedTimer timer(Metrics::Timing::Send);
+        QByteArray frame;
+        while (clientSocket && outbox.takeNext(clientSocket->bytesToWrite(), &frame))
+            clientSocket->write(frame);
+    }
+    if (clientSocket)
+        Metrics::queueDepth(clientSocket->bytesToWrite() + outbox.bytes());
+
+    // Peers missed the dropped strokes; a snapshot with no waiters is
+    // passed on to everybody.
+    if (outbox.isEmpty() && outboxResync) {
+        outboxResync = false;
+        sendImageData();
+    }
+}
+
+// Frames queued in text mode must be written before the BINARY line.
+void DrawGame::flushOutbox()
+{
+    QByteArray frame;
+    while (clientSocket && outbox.takeNext(0, &frame))
+        clientSocket->write(frame);
 }
 
 void DrawGame::updateToolsAvailability()
@@ -616,11 +1800,15 @@ void DrawGame::updateToolsAvailability()
 
     ui->colorComboBox->setEnabled(isDrawingEnabled);
     ui->clearButton->setEnabled(isDrawingEnabled);
+    ui->undoButton->setEnabled(isDrawingEnabled);
+    ui->redoButton->setEnabled(isDrawingEnabled);
     ui->eraserButton->setEnabled(isDrawingEnabled);
 
     drawingArea->setDrawingEnabled(isDrawingEnabled);
+    ui->messageLineEdit->setEnabled(!isSpectator);
+    ui->sendButton->setEnabled(!isSpectator);
 
-    if (!isDrawingEnabled) {
+    if (!isDrawingEnabled && !isSpectator) {
         ui->messageLineEdit->setFocus();
     }
 }
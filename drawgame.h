@@ -8,45 +8,124 @@
 #include <QPoint>
 #include <QImage>
 #include <QTimer>
-#include <QTcpServer>
 #include <QTcpSocket>
+#include <QUdpSocket>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include "protocol.h"
+#include "framedecoder.h"
+#include "sendqueue.h"
+#include "strokebatcher.h"
+#include "strokelog.h"
+#include "tilesync.h"
+#include "imagecodec.h"
+#include "jitterbuffer.h"
+#include "roomserver.h"
+#include "sessionlog.h"
+
+class QPainter;
 
 namespace Ui {
 class DrawGame;
 }
 
+// The drawer's canvas. Mouse and tablet input go through one pipeline: the
+// event handlers only queue pointer samples, and the samples that arrive
+// within one event loop pass are rasterized together as a polyline. With a
+// simplify tolerance set (the default), samples are painted as a preview
+// for up to one stroke flush interval instead and then simplified (see
+// StrokeBatcher::simplify) before they go into the canvas and the log, so
+// the drawer keeps exactly the points the peers are sent. Tablet pressure
+// scales the pen width. The time from the first queued sample to the paint
+// that shows it is tracked as the input latency.
+//
+// Undo works from the stroke log: every kCheckpointInterval strokes the
+// canvas tiles are saved as a checkpoint, sharing the tiles that did not
+// change since the previous one, and removing a stroke restores the last
+// checkpoint before it over the area drawn since and replays the strokes
+// after it. Older checkpoints are dropped beyond kMaxCheckpoints.
 class DrawingArea : public QWidget
 {
     Q_OBJECT
 public:
+    static constexpr int kCheckpointInterval = 32;
+    static constexpr int kMaxCheckpoints = 16;
+    static constexpr int kSettlePoints = StrokeBatcher::kDefaultMaxPoints - 1;
+
+    struct InputStats {
+        quint64 events = 0;
+        quint64 points = 0;
+        quint64 keptPoints = 0;     // left after simplification
+        quint64 rasterPasses = 0;
+        quint64 paints = 0;
+        qint64 latencyNsecs = 0;
+        qint64 maxLatencyNsecs = 0;
+    };
+
     explicit DrawingArea(QWidget *parent = nullptr);
     void setPenColor(const QColor &newColor);
     void setPenWidth(int newWidth);
     void clear();
     bool isEraserMode() const { return eraserMode; }
     void setEraserMode(bool mode) { eraserMode = mode; }
+    void setSimplifyTolerance(double pixels) { simplifyTolerance = qMax(0.0, pixels); }
+    double getSimplifyTolerance() const { return simplifyTolerance; }
+    void setSettleInterval(int msec) { settleTimer.setInterval(msec); }
     const QImage& getImage() const { return image; }
     void setImage(const QImage& newImage);
+    const StrokeLog& getStrokeLog() const { return strokeLog; }
+    bool hasCompleteStrokeLog() const { return strokeLogComplete; }
+    void setStrokeLog(const StrokeLog &log);
+    TileSync::Manifest tileManifest();
+    QImage tileImage(int index) const;
+    void resizeCanvas(const QSize &size);
+    void setTile(int index, const QImage &tile, quint64 hash);
     QColor getPenColor() const { return penColor; }
     int getPenWidth() const { return penWidth; }
     QPoint getLastPoint() const { return lastPoint; }
     void setLastPoint(const QPoint &point) { lastPoint = point; }
-    void handleMousePressEvent(QMouseEvent *event);
-    void handleMouseMoveEvent(QMouseEvent *event);
-    void publicDrawLineTo(const QPoint &endPoint);
+    InputStats takeInputStats();
+    // undo() returns the id of the stroke it removed, 0 if there was none;
+    // redo() draws it again under a new id and returns what it drew.
+    quint32 undo();
+    QVector<Protocol::Stroke> redo();
+    bool removeStroke(quint32 strokeId);
+    quint32 lastStrokeId() const { return nextStrokeId; }
     void setDrawingEnabled(bool enabled);
+    void applyStrokes(const QVector<Protocol::Stroke> &strokes);
+    static void appendSegment(QVector<Protocol::Stroke> *strokes, const Protocol::DrawSegment &segment);
 
 signals:
     void imageModified();
+    void segmentDrawn(const QPoint &from, const QPoint &to, const Protocol::PenParams &pen);
+    void strokeFinished(int rawPoints, int keptPoints);
 protected:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
+    void tabletEvent(QTabletEvent *event) override;
     void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
 
 private:
     void resizeImage(QImage *image, const QSize &newSize);
+    void resetTiles();
+    void markDirty(const QRect &rect);
+    void pressPointer(const QPoint &pos, qreal pressure);
+    void movePointer(const QPoint &pos, qreal pressure);
+    void releasePointer(const QPoint &pos, qreal pressure);
+    void flushInput();
+    void paintPreview(QPainter *painter);
+    int widthFor(qreal pressure) const;
+    QRect drawStroke(const QPoint *points, int count, const Protocol::PenParams &pen);
+    bool eraseStroke(quint32 strokeId, QVector<Protocol::Stroke> *removed);
+    void resetHistory(bool blank);
+    void takeCheckpoint();
+
+    struct Checkpoint {
+        int strokeIndex;        // strokes of the log painted into it
+        QVector<QImage> tiles;  // TileSync grid, shared with the previous checkpoint where unchanged
+    };
 
     bool drawing;
     bool eraserMode;
@@ -55,6 +134,27 @@ private:
     QImage image;
     QPoint lastPoint;
     bool drawingEnabled;
+    StrokeLog strokeLog;
+    bool strokeLogComplete;     // false once a raster image was loaded over the strokes
+    QBitArray dirtyTiles;       // tiles whose hash is stale
+    QVector<quint64> tileHashes;
+    QVector<QPoint> pendingPoints;      // queued input samples not yet rasterized
+    QVector<int> pendingWidths;
+    bool flushQueued;
+    double simplifyTolerance;
+    QTimer settleTimer;                 // pending samples are a preview until it fires
+    QRect previewRect;
+    int strokeRawPoints;
+    int strokeKeptPoints;
+    QElapsedTimer inputClock;
+    qint64 unpaintedSince;              // -1: everything queued has been painted
+    InputStats inputStats;
+    QVector<Checkpoint> checkpoints;
+    QBitArray checkpointDirty;          // tiles changed since the last checkpoint
+    bool historyStale;                  // the canvas changed outside the log
+    QVector<QVector<Protocol::Stroke>> redoStack;
+    quint32 nextStrokeId;
+    quint32 currentStrokeId;
 };
 
 class DrawGame : public QMainWindow
@@ -62,50 +162,148 @@ class DrawGame : public QMainWindow
     Q_OBJECT
 
 public:
+    enum class SyncMode {
+        Delta,      // only DRAW segments; snapshots on join, CLEAR and REQUEST_IMAGE
+        Snapshot    // legacy: full PNG after every segment
+    };
+
+    struct SyncStats {
+        quint64 strokes = 0;
+        quint64 strokeBytes = 0;
+        quint64 currentStrokeBytes = 0;
+        quint64 snapshots = 0;
+        quint64 snapshotBytes = 0;
+        quint64 messages = 0;
+        quint64 bytes = 0;
+        quint64 reportedMessages = 0;
+        quint64 reportedBytes = 0;
+        quint64 udpReceived = 0;
+        quint64 udpLost = 0;
+        quint64 udpStale = 0;
+        quint64 udpResyncs = 0;
+        quint64 reportedUdpReceived = 0;
+    };
+
     explicit DrawGame(QWidget *parent = nullptr);
     ~DrawGame();
 
-protected:
-    void mousePressEvent(QMouseEvent *event) override;
-    void mouseMoveEvent(QMouseEvent *event) override;
+    void setSyncMode(SyncMode mode) { syncMode = mode; }
+    SyncMode getSyncMode() const { return syncMode; }
+    const SyncStats& getSyncStats() const { return syncStats; }
+    void setStrokeFlushInterval(int msec);
+    int strokeFlushInterval() const;
 
 private slots:
     void onStartGameClicked();
     void onSendMessageClicked();
     void onColorChanged(int index);
     void onClearClicked();
+    void onUndoClicked();
+    void onRedoClicked();
     void onEraserClicked(bool checked);
     void updateGame();
-    void newConnection();
     void readData();
     void disconnected();
-    void switchRoles(bool wordGuessed);
     void onBrushSizeChanged(int value);
     void onEraserSizeChanged(int value);
-
+    void onSegmentDrawn(const QPoint &from, const QPoint &to, const Protocol::PenParams &pen);
+    void onImageModified();
+    void onStrokeFinished(int rawPoints, int keptPoints);
+    void onStrokeReady(const Protocol::Stroke &stroke);
+    void reportTraffic();
+    void onImageEncoded(const QByteArray &data, qint64 msecs);
+    void onImageDecoded(const QImage &image, qint64 msecs);
+    void onFrameTick();
+    void readDatagrams();
+    void sendUdpHello();
+    void pumpOutbox();
 
 private:
     void setupConnections();
-    void generateRandomWord();
-    void switchRoles();
-    void sendData(const QString &data);
-    void processDrawingCommand(const QString &data);
-    void sendImageData();
-    void assignRandomRole();
-    void sendDrawingData(const QPoint& from, const QPoint& to);
+    qint64 sendData(const Protocol::Message &message);
+    qint64 writeData(const QByteArray &data, Protocol::MessageType type, int messages = 1);
+    void flushOutbox();
+    void handleMessage(const Protocol::Message &message);
+    void completeIncomingSnapshot(const Protocol::Message &message);
+    bool deferWhileDecoding(const Protocol::Message &message);
+    bool holdWhileEncoding(const Protocol::Message &message);
+    void cancelImageJobs();
+    void processDrawingCommand(const Protocol::DrawSegment &segment);
+    void processStrokeCommand(const Protocol::Stroke &stroke);
+    void flushReceivedStrokes();
+    void applyPen(const Protocol::PenParams &pen);
+    Protocol::PenParams currentPen() const;
+    void resetProtocol();
+    void sendImageData(SnapshotCodec::Format format = SnapshotCodec::Format::Png);
+    qint64 sendStrokeLog();
+    qint64 sendTileManifest();
+    qint64 sendTiles(const TileSync::Request &request);
+    void requestMissingTiles(const TileSync::Manifest &manifest);
+    void applyTiles(const TileSync::TileSet &set);
+    void connectToServer(const QString &address);
+    void openUdpChannel(const QString &offer);
+    void closeUdpChannel();
+    qint64 sendUdp(const Protocol::Message &message);
+    void writeDatagram(const QByteArray &datagram);
+    void processDatagram(const QByteArray &datagram);
+    void requestUdpResync();
+    void finishUdpResync();
+    bool udpDropped() const;
+    int udpDelay() const;
+    qint64 sendDrawingData(const Protocol::Stroke &stroke);
     Ui::DrawGame *ui;
     DrawingArea *drawingArea;
     QTimer *gameTimer;
+    QTimer *statsTimer;
+    StrokeBatcher *strokeBatcher;
+    ImageCodec *imageCodec;
+    SessionLog::Recorder recorder;              // DRAWGAME_RECORD=path
+    QList<Protocol::Message> heldMessages;      // drawn while a snapshot is being encoded
+    QList<Protocol::Message> deferredMessages;  // received while a snapshot is being decoded
+    QVector<Protocol::Stroke> receivedStrokes;  // painted together at the end of a read
+    QList<quint32> undoneStrokes;               // late UDP strokes of these are dropped
+    quint32 clearedStrokeId;                    // and of this id and below, drawn before the last CLEAR
+    JitterBuffer *jitterBuffer;
+    quint64 reportedJitterStrokes;
+    QTimer *frameTimer;
+    QElapsedTimer frameClock;
+    qint64 maxFrameGap;
+    int lateFrames;
+    int maxImageJobs;
     QString currentWord;
-    QStringList wordList;
+    QString roomName;
+    bool watchOnly;
     bool isDrawer;
+    bool isSpectator;
     int secondsLeft;
     int brushSize;
     int eraserSize;
-    QTcpServer *server;
+    RoomServer *roomServer;
     QTcpSocket *clientSocket;
     bool isServer;
-    void sendFullState();
+    bool binarySend;
+    int binaryVersion;          // agreed in the PROTO/BINARY handshake
+    quint32 sendSequence;
+    quint32 receiveSequence;
+    FrameDecoder receiveDecoder;
+    SendQueue outbox;
+    bool outboxResync;          // strokes were dropped, send a full snapshot once drained
+    QUdpSocket *udpSocket;
+    QTimer *udpTimer;
+    QHostAddress udpHost;
+    quint16 udpPort;
+    quint32 udpToken;           // 0 while no UDP channel is offered
+    bool udpReady;              // the server acknowledged our hello
+    quint32 udpSendSequence;
+    quint32 udpReceiveSequence;
+    bool udpResyncPending;      // a snapshot was asked for after a loss
+    bool udpResyncAgain;        // more strokes were lost while waiting for it
+    int udpLossPercent;         // DRAWGAME_UDP_LOSS, simulated
+    int udpJitterMs;            // DRAWGAME_UDP_JITTER, simulated
+    SyncMode syncMode;
+    SnapshotCodec::Format snapshotFormat;   // for peers that asked for more than PNG
+    SyncStats syncStats;
+    qint64 sendFullState();
     void updateToolsAvailability();
     void updateBrushSizeDisplay();
     void updateEraserSizeDisplay();
@@ -0,0 +1,16 @@
+# Everything in one build: the game client, the headless room server, the
+# load-test bots, the benchmarks and the tests.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    app \
+    server \
+    bot \
+    bench \
+    tests
+
+app.file = untitled12.pro
+server.subdir = server
+bot.subdir = bot
+bench.subdir = bench
+tests.subdir = tests
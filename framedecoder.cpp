@@ -0,0 +1,176 @@
+#include "framedecoder.h"
+#include <QIODevice>
+#include <cstring>
+
+FrameDecoder::FrameDecoder(int maxFrameSize)
+    : head(0),
+      tail(0),
+      scanPos(0),
+      maxFrameSize(maxFrameSize),
+      currentMode(Mode::Text),
+      partialBytes(0)
+{
+}
+
+void FrameDecoder::reset()
+{
+    head = tail = scanPos = 0;
+    currentMode = Mode::Text;
+    error.clear();
+    partials.clear();
+    partialBytes = 0;
+    assembled.clear();
+}
+
+void FrameDecoder::reserve(int extra)
+{
+    if (buffer.size() - tail >= extra)
+        return;
+
+    if (head > 0) {
+        std::memmove(buffer.data(), buffer.constData() + head, size_t(tail - head));
+        tail -= head;
+        scanPos -= head;
+        head = 0;
+    }
+    if (buffer.size() - tail < extra)
+        buffer.resize(qMax(tail + extra, buffer.size() * 2));
+}
+
+qint64 FrameDecoder::readFrom(QIODevice *device)
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return 0;
+
+    reserve(int(qMin<qint64>(available, kReadChunk)));
+    qint64 bytesRead = device->read(buffer.data() + tail, buffer.size() - tail);
+    if (bytesRead > 0)
+        tail += int(bytesRead);
+    return bytesRead;
+}
+
+void FrameDecoder::append(const char *data, int size)
+{
+    reserve(size);
+    std::memcpy(buffer.data() + tail, data, size_t(size));
+    tail += size;
+}
+
+FrameDecoder::Status FrameDecoder::fail(const QString &reason)
+{
+    error = reason;
+    return Status::Error;
+}
+
+FrameDecoder::Status FrameDecoder::next(Frame *frame)
+{
+    if (!error.isEmpty())
+        return Status::Error;
+
+    if (head == tail) {
+        head = tail = scanPos = 0;
+        return Status::NeedMore;
+    }
+
+    const char *data = buffer.constData();
+
+    if (currentMode == Mode::Binary) {
+        for (;;) {
+            const int available = tail - head;
+            if (available < Protocol::kFrameHeaderSize)
+                return Status::NeedMore;
+
+            Protocol::FrameHeader header = Protocol::decodeFrameHeader(data + head);
+            if (header.length > maxFrameSize)
+                return fail(QString("frame of %1 bytes exceeds the %2 byte limit").arg(header.length).arg(maxFrameSize));
+            if (available - Protocol::kFrameHeaderSize < header.length)
+                return Status::NeedMore;
+
+            const char *payload = data + head + Protocol::kFrameHeaderSize;
+            head += Protocol::kFrameHeaderSize + header.length;
+            scanPos = head;
+
+            if (header.type == Protocol::MessageType::Part) {
+                Status status = addPart(payload, header.length, frame);
+                if (status == Status::NeedMore)
+                    continue;
+                return status;
+            }
+
+            frame->mode = Mode::Binary;
+            frame->type = header.type;
+            frame->sequence = header.sequence;
+            frame->data = payload;
+            frame->size = header.length;
+            frame->assembled = false;
+            return Status::Ready;
+        }
+    }
+
+    const int start = qMax(scanPos, head);
+    const void *newline = std::memchr(data + start, '\n', size_t(tail - start));
+    if (!newline) {
+        scanPos = tail;
+        if (tail - head > maxFrameSize)
+            return fail(QString("text line exceeds the %1 byte limit").arg(maxFrameSize));
+        return Status::NeedMore;
+    }
+
+    const int end = int(static_cast<const char *>(newline) - data);
+    frame->mode = Mode::Text;
+    frame->type = Protocol::MessageType::Invalid;
+    frame->sequence = 0;
+    frame->data = data + head;
+    frame->size = end - head;
+    frame->assembled = false;
+    head = end + 1;
+    scanPos = head;
+    return Status::Ready;
+}
+
+// NeedMore here means the slice was stored and the caller should go on with
+// the next frame in the buffer.
+FrameDecoder::Status FrameDecoder::addPart(const char *data, int size, Frame *frame)
+{
+    quint32 transfer;
+    bool last;
+    int offset;
+    if (!Protocol::decodePart(data, size, &transfer, &last, &offset))
+        return fail("malformed PART frame");
+
+    if (!partials.contains(transfer) && partials.size() >= kMaxTransfers)
+        return fail(QString("more than %1 transfers open").arg(kMaxTransfers));
+    QByteArray &partial = partials[transfer];
+    partial.append(data + offset, size - offset);
+    partialBytes += size - offset;
+    if (partial.size() > Protocol::kFrameHeaderSize + maxFrameSize)
+        return fail(QString("transfer %1 exceeds the %2 byte limit").arg(transfer).arg(maxFrameSize));
+    if (partialBytes > 2 * qint64(maxFrameSize))
+        return fail(QString("open transfers exceed %1 bytes").arg(2 * qint64(maxFrameSize)));
+    if (!last)
+        return Status::NeedMore;
+
+    assembled = partials.take(transfer);
+    partialBytes -= assembled.size();
+    if (assembled.size() < Protocol::kFrameHeaderSize)
+        return fail(QString("transfer %1 is truncated").arg(transfer));
+    Protocol::FrameHeader header = Protocol::decodeFrameHeader(assembled.constData());
+    if (header.type == Protocol::MessageType::Part || header.length != assembled.size() - Protocol::kFrameHeaderSize)
+        return fail(QString("transfer %1 does not hold one frame").arg(transfer));
+
+    frame->mode = Mode::Binary;
+    frame->type = header.type;
+    frame->sequence = header.sequence;
+    frame->data = assembled.constData() + Protocol::kFrameHeaderSize;
+    frame->size = header.length;
+    frame->assembled = true;
+    return Status::Ready;
+}
+
+bool FrameDecoder::decode(const Frame &frame, Protocol::Message *message)
+{
+    if (frame.mode == Mode::Binary)
+        return Protocol::decodeFramePayload(frame.type, frame.data, frame.size, message);
+    return Protocol::decodeText(QByteArray::fromRawData(frame.data, frame.size), message);
+}
@@ -0,0 +1,70 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include "protocol.h"
+
+class QIODevice;
+
+// Per-connection receive buffer. Bytes are read straight from the socket into
+// the tail of the buffer and complete frames (text lines or binary frames,
+// depending on the current mode) are handed out as views into it. Only the
+// unconsumed remainder of a partial frame is ever moved, and a frame larger
+// than maxFrameSize puts the decoder into the error state. PART frames are
+// collected per transfer and the reassembled frame is handed out in place of
+// the last one; at most kMaxTransfers may be open at a time, holding no more
+// than twice maxFrameSize together.
+class FrameDecoder
+{
+public:
+    enum class Mode { Text, Binary };
+    enum class Status { NeedMore, Ready, Error };
+
+    struct Frame {
+        Mode mode = Mode::Text;
+        Protocol::MessageType type = Protocol::MessageType::Invalid;
+        quint32 sequence = 0;
+        const char *data = nullptr;   // valid until the next read, append or next()
+        int size = 0;
+        bool assembled = false;       // put together from PART frames
+    };
+
+    static constexpr int kDefaultMaxFrameSize = 8 * 1024 * 1024;
+    static constexpr int kMaxTransfers = 8;
+    static constexpr int kReadChunk = 64 * 1024;
+
+    explicit FrameDecoder(int maxFrameSize = kDefaultMaxFrameSize);
+
+    void setMode(Mode mode) { currentMode = mode; }
+    Mode mode() const { return currentMode; }
+    int bufferedBytes() const { return tail - head; }
+    bool isAssembling() const { return !partials.isEmpty(); }
+    QString errorString() const { return error; }
+
+    qint64 readFrom(QIODevice *device);
+    void append(const char *data, int size);
+    Status next(Frame *frame);
+    void reset();
+
+    static bool decode(const Frame &frame, Protocol::Message *message);
+
+private:
+    void reserve(int extra);
+    Status fail(const QString &reason);
+    Status addPart(const char *data, int size, Frame *frame);
+
+    QByteArray buffer;
+    int head;
+    int tail;
+    int scanPos;
+    int maxFrameSize;
+    Mode currentMode;
+    QString error;
+    QHash<quint32, QByteArray> partials;
+    qint64 partialBytes;
+    QByteArray assembled;
+};
+
+#endif // FRAMEDECODER_H
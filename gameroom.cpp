@@ -0,0 +1,633 @@
+#include "gameroom.h"
+#include "snapshotcodec.h"
+#include "tilesync.h"
+#include "udprelay.h"
+#include "udpchannel.h"
+#include <QTimer>
+#include <QElapsedTimer>
+
+GameRoom::GameRoom(const QString &name, const WordDictionary *words, QObject *parent)
+    : QObject(parent),
+      roomName(name),
+      words(words),
+      sampler(words->count()),
+      roundTimer(new QTimer(this)),
+      udpRelay(nullptr),
+      drawer(nullptr),
+      pngRequested(false),
+      lastTileRequest(0),
+      deltaBytes(0),
+      logStale(false),
+      keyframeRequested(false),
+      keyframeAge(0),
+      secondsLeft(kRoundSeconds)
+{
+    roundTimer->setInterval(1000);
+    connect(roundTimer, &QTimer::timeout, this, &GameRoom::tick);
+}
+
+QStringList GameRoom::defaultWords()
+{
+    static const QStringList words = QStringList()
+             << "Машина" << "Река" << "Гора" << "Книга" << "Цветок"
+             << "Солнце" << "Дерево" << "Окно" << "Часы" << "Телефон"
+             << "Яблоко" << "Кошка" << "Собака" << "Море" << "Снег"
+             << "Дождь" << "Гитара" << "Футбол" << "Компьютер" << "Ручка"
+             << "Самолет" << "Велосипед" << "Мороженое" << "Торт" << "Музыка"
+             << "Звезда" << "Луна" << "Огонь" << "Вода" << "Воздух"
+             << "Земля" << "Молния" << "Радуга" << "Вулкан" << "Остров"
+             << "Пустыня" << "Лес" << "Поле" << "Сад" << "Учитель"
+             << "Врач" << "Повар" << "Космонавт" << "Робот" << "Дракон"
+             << "Замок" << "Мост" << "Фонарь" << "Ключ" << "Зонт"
+             << "Чемодан" << "Карта" << "Глобус" << "Телевизор" << "Микрофон"
+             << "Фотоаппарат" << "Кино" << "Театр" << "Цирк" << "Музей"
+             << "Библиотека" << "Школа" << "Университет" << "Стадион" << "Ресторан"
+             << "Пирамида" << "Сфинкс" << "Эйфелева башня" << "Кремль" << "Водопад"
+             << "Айсберг" << "Пингвин" << "Кенгуру" << "Слон" << "Тигр"
+             << "Медведь" << "Волк" << "Лиса" << "Заяц" << "Ежик"
+             << "Бабочка" << "Пчела" << "Муравей" << "Рыба" << "Дельфин"
+             << "Кит" << "Акула" << "Черепаха" << "Змея" << "Ящерица"
+             << "Динозавр" << "Вампир" << "Привидение" << "Фея" << "Волшебник"
+             << "Супергерой" << "Космос" << "Ракета" << "Спутник" << "НЛО"
+             << "Парашют" << "Подводная лодка" << "Корабль" << "Поезд" << "Метро";
+    return words;
+}
+
+QString GameRoom::pickWord()
+{
+    return words->word(sampler.next());
+}
+
+// What guessers and spectators see of the word: a blank per letter, other
+// characters as they are.
+QString GameRoom::maskWord(const QString &word)
+{
+    QStringList blanks;
+    for (QChar c : word)
+        blanks << (c.isLetterOrNumber() ? QString("_") : QString(c));
+    return blanks.join(' ');
+}
+
+qint64 GameRoom::maxQueuedBytes() const
+{
+    qint64 maxQueued = 0;
+    for (PeerSession *session : sessions)
+        maxQueued = qMax(maxQueued, session->queuedBytes());
+    for (PeerSession *session : spectators)
+        maxQueued = qMax(maxQueued, session->queuedBytes());
+    return maxQueued;
+}
+
+GameRoom::Stats GameRoom::takeStats()
+{
+    Stats taken = stats;
+    stats = Stats();
+    return taken;
+}
+
+void GameRoom::addSession(PeerSession *session)
+{
+    if (udpRelay) {
+        const quint32 token = udpRelay->addSession(session);
+        session->send(Protocol::makeText(Protocol::MessageType::Udp, UdpChannel::makeOffer(udpRelay->port(), token)));
+    }
+    if (session->isSpectator()) {
+        addSpectator(session);
+        return;
+    }
+
+    sessions.append(session);
+    connect(session, &PeerSession::messageReceived, this, &GameRoom::handleMessage);
+    connect(session, &PeerSession::resyncNeeded, this, &GameRoom::onResyncNeeded);
+
+    if (drawer) {
+        sendRoundState(session);
+    } else if (sessions.size() >= 2) {
+        startRound(sessions.first());
+    }
+}
+
+void GameRoom::removeSession(PeerSession *session)
+{
+    disconnect(session, nullptr, this, nullptr);
+    snapshotWaiters.remove(session);
+    pngWaiters.remove(session);
+    catchUpWaiters.remove(session);
+    heldFor.remove(session);
+    if (udpRelay)
+        udpRelay->removeSession(session);
+    for (auto it = tileRequests.begin(); it != tileRequests.end();) {
+        if (it.value() == session)
+            it = tileRequests.erase(it);
+        else
+            ++it;
+    }
+    if (spectators.removeAll(session) > 0) {
+        if (spectators.isEmpty()) {
+            // The answer to a pending request must still not be broadcast.
+            const bool requested = keyframeRequested;
+            resetKeyframe();
+            keyframeRequested = requested;
+            logStale = true;
+        }
+        return;
+    }
+
+    sessions.removeAll(session);
+    if (sessions.size() < 2) {
+        stopRound();
+    } else if (session == drawer) {
+        startRound(sessions.first());
+    }
+}
+
+void GameRoom::startRound(PeerSession *newDrawer)
+{
+    drawer = newDrawer;
+    currentWord = pickWord();
+    matcher.setWord(currentWord);
+    secondsLeft = kRoundSeconds;
+    snapshotWaiters.clear();
+    pngWaiters.clear();
+    pngRequested = false;
+    tileRequests.clear();
+    heldFor.clear();
+    heldMessages.clear();
+    resetKeyframe();
+
+    for (PeerSession *session : qAsConst(sessions))
+        sendRoundState(session);
+    for (PeerSession *session : qAsConst(spectators))
+        sendRoundState(session);
+    roundTimer->start();
+}
+
+void GameRoom::stopRound()
+{
+    roundTimer->stop();
+    drawer = nullptr;
+    currentWord.clear();
+    matcher.setWord(currentWord);
+    snapshotWaiters.clear();
+    pngWaiters.clear();
+    pngRequested = false;
+    tileRequests.clear();
+    heldFor.clear();
+    heldMessages.clear();
+    resetKeyframe();
+}
+
+void GameRoom::sendRoundState(PeerSession *session)
+{
+    const QString role = session->isSpectator() ? "SPECTATOR" : (session == drawer ? "DRAWER" : "GUESSER");
+    session->send(Protocol::makeText(Protocol::MessageType::Role, role));
+    session->send(Protocol::makeText(Protocol::MessageType::Word,
+                                     session == drawer ? currentWord : maskWord(currentWord)));
+    session->send(Protocol::makeText(Protocol::MessageType::Time, QString::number(secondsLeft)));
+}
+
+void GameRoom::tick()
+{
+    if (++keyframeAge >= kKeyframeSeconds && (!deltas.isEmpty() || !catchUpWaiters.isEmpty()))
+        requestKeyframe();
+    if (--secondsLeft > 0)
+        return;
+
+    broadcast(Protocol::makeText(Protocol::MessageType::Word, currentWord), nullptr);
+    broadcast(Protocol::makeText(Protocol::MessageType::Time, QString::number(0)), nullptr);
+    startRound(drawer);
+}
+
+void GameRoom::requestSnapshot(PeerSession *session)
+{
+    if (!drawer || session == drawer)
+        return;
+
+    // Peers that read stroke ids can take the drawer's stroke log or an
+    // image in any format, text and version 2 peers need a PNG.
+    if (!session->readsStrokeIds()) {
+        pngWaiters.insert(session);
+        requestPng();
+        return;
+    }
+    bool alreadyRequested = !snapshotWaiters.isEmpty() || pngRequested;
+    snapshotWaiters.insert(session);
+    if (!alreadyRequested)
+        drawer->send(Protocol::makeText(Protocol::MessageType::RequestImage));
+}
+
+void GameRoom::requestPng()
+{
+    if (pngRequested || pngWaiters.isEmpty())
+        return;
+    pngRequested = true;
+    drawer->send(Protocol::makeText(Protocol::MessageType::RequestImage, "PNG"));
+}
+
+// PNG waiters only take an IMAGE that is a PNG. The drawer encodes one
+// snapshot at a time and drops the older request when a newer one starts,
+// so a KEYFRAME answer in another format means the PNG is asked for again.
+void GameRoom::sendSnapshot(const Protocol::Message &message)
+{
+    SharedFrame frame{ message, {} };
+    const QSet<PeerSession *> waiters = snapshotWaiters;
+    snapshotWaiters.clear();
+    for (PeerSession *waiter : waiters)
+        waiter->sendEncoded(frame.encoded(waiter->version()), message.type);
+
+    if (message.type != Protocol::MessageType::Image)
+        return;
+    pngRequested = false;
+    if (SnapshotCodec::detect(message.image) != SnapshotCodec::Format::Png) {
+        requestPng();
+        return;
+    }
+    const QSet<PeerSession *> pngTakers = pngWaiters;
+    pngWaiters.clear();
+    for (PeerSession *waiter : pngTakers)
+        waiter->sendEncoded(frame.encoded(waiter->version()), message.type);
+}
+
+// Tile requests go to the drawer one by one; the id the room puts in each
+// request comes back in the TILES answer and tells whom to deliver it to.
+void GameRoom::forwardTileRequest(PeerSession *session, const Protocol::Message &message)
+{
+    const quint32 id = ++lastTileRequest;
+    const QByteArray request = TileSync::withRequestId(message.tiles, id);
+    if (request.isEmpty())
+        return;
+
+    tileRequests.insert(id, session);
+    drawer->send(Protocol::makeTiles(Protocol::MessageType::RequestTiles, request));
+}
+
+void GameRoom::routeTiles(const Protocol::Message &message)
+{
+    quint32 id;
+    if (!TileSync::requestId(message.tiles, &id))
+        return;
+
+    PeerSession *requester = tileRequests.take(id);
+    if (requester)
+        requester->send(message);
+}
+
+void GameRoom::onResyncNeeded(PeerSession *session)
+{
+    if (session->isSpectator())
+        sendCatchUp(session);
+    else
+        requestSnapshot(session);
+}
+
+// Strokes the drawer sent over UDP that never arrived are missing for
+// everybody else, the keyframe log included; a snapshot brings them back
+// and becomes the new keyframe.
+void GameRoom::onStrokesLost(PeerSession *session)
+{
+    if (session != drawer)
+        return;
+    for (PeerSession *peer : qAsConst(sessions))
+        requestSnapshot(peer);
+    if (spectators.isEmpty())
+        return;
+    for (PeerSession *peer : qAsConst(spectators))
+        catchUpWaiters.insert(peer);
+    keyframeRequested = false;
+    requestKeyframe();
+}
+
+void GameRoom::addSpectator(PeerSession *session)
+{
+    spectators.append(session);
+    connect(session, &PeerSession::messageReceived, this, &GameRoom::handleSpectatorMessage);
+    connect(session, &PeerSession::resyncNeeded, this, &GameRoom::onResyncNeeded);
+
+    sendRoundState(session);
+    if (drawer)
+        sendCatchUp(session);
+}
+
+// Spectators only ever ask to be caught up again.
+void GameRoom::handleSpectatorMessage(PeerSession *session, const Protocol::Message &message)
+{
+    if (message.type == Protocol::MessageType::RequestImage && drawer)
+        sendCatchUp(session);
+}
+
+const QByteArray &GameRoom::SharedFrame::encoded(int version)
+{
+    QByteArray &frame = frames[version];
+    if (frame.isEmpty())
+        frame = PeerSession::encode(message, version);
+    return frame;
+}
+
+// A version 2 peer cannot read a stroke log keyframe and waits for a PNG
+// from the drawer instead.
+void GameRoom::sendCatchUp(PeerSession *session)
+{
+    if (logStale) {
+        catchUpWaiters.insert(session);
+        requestKeyframe();
+        return;
+    }
+    if (keyframe.message.type == Protocol::MessageType::StrokeLog && session->isBinary()
+        && !session->readsStrokeIds()) {
+        requestSnapshot(session);
+        return;
+    }
+
+    const int version = session->version();
+    qint64 bytes = 0;
+    auto send = [&](SharedFrame &frame) {
+        const QByteArray &encoded = frame.encoded(version);
+        session->sendEncoded(encoded, frame.message.type);
+        bytes += encoded.size();
+    };
+
+    if (keyframe.message.type == Protocol::MessageType::Invalid) {
+        SharedFrame clear{ Protocol::makeText(Protocol::MessageType::Clear), {} };
+        send(clear);
+    } else {
+        send(keyframe);
+    }
+    for (SharedFrame &delta : deltas)
+        send(delta);
+    for (SharedFrame &delta : uploadDeltas)
+        send(delta);
+
+    stats.catchUps++;
+    stats.catchUpBytes += bytes;
+}
+
+// Called after the frame went out, so the log shares its encodings.
+void GameRoom::recordDelta(SharedFrame &frame)
+{
+    if (frame.message.type == Protocol::MessageType::Clear && !drawer->isReceivingBulk()) {
+        resetKeyframe();
+        return;
+    }
+    if (spectators.isEmpty()) {
+        logStale = true;
+        return;
+    }
+
+    deltaBytes += frame.encoded(Protocol::kBinaryVersion).size();
+    if (drawer->isReceivingBulk()) {
+        uploadDeltas.append(frame);
+    } else {
+        commitUploadDeltas();
+        deltas.append(frame);
+    }
+    if (deltaBytes > kKeyframeDeltaBytes)
+        requestKeyframe();
+}
+
+// A snapshot from the drawer replaces the keyframe. Whatever arrived while
+// it was still uploading was drawn after it and stays in the log.
+void GameRoom::setKeyframe(const Protocol::Message &message)
+{
+    keyframe = SharedFrame{ message, {} };
+    logStale = false;
+    deltas = uploadDeltas;
+    uploadDeltas.clear();
+    deltaBytes = 0;
+    for (SharedFrame &delta : deltas)
+        deltaBytes += delta.encoded(Protocol::kBinaryVersion).size();
+    keyframeRequested = false;
+    keyframeAge = 0;
+    stats.keyframes++;
+
+    const QSet<PeerSession *> waiters = catchUpWaiters;
+    catchUpWaiters.clear();
+    for (PeerSession *session : waiters)
+        sendCatchUp(session);
+}
+
+void GameRoom::commitUploadDeltas()
+{
+    deltas.append(uploadDeltas);
+    uploadDeltas.clear();
+}
+
+void GameRoom::resetKeyframe()
+{
+    keyframe = SharedFrame();
+    deltas.clear();
+    uploadDeltas.clear();
+    catchUpWaiters.clear();
+    deltaBytes = 0;
+    logStale = false;
+    keyframeRequested = false;
+    keyframeAge = 0;
+}
+
+// An unanswered request is repeated once the keyframe interval has passed
+// again, so a drawer that sends tile hashes instead cannot stall the log.
+void GameRoom::requestKeyframe()
+{
+    if (!drawer || spectators.isEmpty() || (keyframeRequested && keyframeAge < kKeyframeSeconds))
+        return;
+    keyframeRequested = true;
+    keyframeAge = 0;
+    drawer->send(Protocol::makeText(Protocol::MessageType::RequestImage, "KEYFRAME"));
+}
+
+// Datagrams always carry frames, at the session's version once it has one.
+void GameRoom::deliver(PeerSession *session, SharedFrame &frame, bool droppable)
+{
+    if (droppable && udpRelay && udpRelay->hasEndpoint(session)) {
+        const int version = session->isBinary() ? session->version() : Protocol::kBinaryVersion;
+        if (udpRelay->send(session, frame.encoded(version))) {
+            stats.fanoutFrames++;
+            return;
+        }
+    }
+
+    session->sendEncoded(frame.encoded(session->version()), frame.message.type, droppable);
+    stats.fanoutFrames++;
+}
+
+void GameRoom::broadcast(const Protocol::Message &message, PeerSession *except, bool droppable,
+                         const QSet<PeerSession *> &skip)
+{
+    SharedFrame frame{ message, {} };
+    broadcast(frame, except, droppable, skip);
+}
+
+void GameRoom::broadcast(SharedFrame &frame, PeerSession *except, bool droppable,
+                         const QSet<PeerSession *> &skip)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (PeerSession *session : qAsConst(sessions)) {
+        if (session == except || skip.contains(session)) continue;
+        deliver(session, frame, droppable);
+    }
+    for (PeerSession *session : qAsConst(spectators)) {
+        if (skip.contains(session)) continue;
+        deliver(session, frame, droppable);
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    stats.broadcasts++;
+    stats.fanoutNsecs += elapsed;
+    stats.maxFanoutNsecs = qMax(stats.maxFanoutNsecs, elapsed);
+}
+
+// The first chunk of a snapshot travels in order with the drawer's strokes,
+// so canvas traffic that arrives while the rest is still coming was drawn
+// after the snapshot was taken. Its recipients would have it painted over
+// if it reached them first, so they get it once the snapshot is through.
+void GameRoom::relayCanvas(const Protocol::Message &message, bool droppable)
+{
+    SharedFrame frame{ message, {} };
+    if (drawer->isReceivingBulk()) {
+        if (heldMessages.isEmpty()) {
+            heldFor = snapshotWaiters + pngWaiters;
+            for (PeerSession *requester : qAsConst(tileRequests))
+                heldFor.insert(requester);
+        }
+        if (!heldFor.isEmpty()) {
+            broadcast(frame, drawer, droppable, heldFor);
+            recordDelta(frame);
+            heldMessages.append({ frame, droppable });
+            return;
+        }
+    } else if (!heldMessages.isEmpty()) {
+        releaseHeldMessages();
+    }
+    broadcast(frame, drawer, droppable);
+    recordDelta(frame);
+}
+
+// Text and version 2 peers have no stroke ids and get a fresh snapshot
+// instead. A stroke older than a raster keyframe is baked into it, so
+// spectators are caught up again from a new one.
+void GameRoom::relayUndo(const Protocol::Message &message)
+{
+    const quint32 strokeId = message.text.toUInt();
+    auto contains = [strokeId](const QList<SharedFrame> &log) {
+        for (const SharedFrame &delta : log) {
+            if (delta.message.type == Protocol::MessageType::Stroke && delta.message.stroke.pen.strokeId == strokeId)
+                return true;
+        }
+        return false;
+    };
+    const bool inLog = contains(deltas) || contains(uploadDeltas);
+
+    relayCanvas(message, false);
+    for (PeerSession *session : qAsConst(sessions)) {
+        if (!session->readsStrokeIds())
+            requestSnapshot(session);
+    }
+    if (!inLog && keyframe.message.type == Protocol::MessageType::Image && !spectators.isEmpty()) {
+        for (PeerSession *session : qAsConst(spectators))
+            catchUpWaiters.insert(session);
+        keyframeRequested = false;
+        requestKeyframe();
+    }
+}
+
+// Recipients still waiting for a later snapshot get the messages too: it
+// will contain them, and tile answers only cover part of the canvas.
+void GameRoom::releaseHeldMessages()
+{
+    if (drawer && drawer->isReceivingBulk())
+        return;
+
+    const QList<Held> held = heldMessages;
+    const QSet<PeerSession *> recipients = heldFor;
+    heldMessages.clear();
+    heldFor.clear();
+    for (Held entry : held) {
+        for (PeerSession *session : recipients)
+            deliver(session, entry.frame, entry.droppable);
+    }
+}
+
+void GameRoom::checkGuess(PeerSession *session, const Protocol::Message &message)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const GuessMatcher::Result result = matcher.check(message.text);
+    stats.guesses++;
+    stats.guessNsecs += timer.nsecsElapsed();
+
+    if (result == GuessMatcher::Result::Exact) {
+        const QString word = currentWord;
+        startRound(session);
+        broadcast(Protocol::makeText(Protocol::MessageType::Win, word), nullptr);
+        return;
+    }
+    broadcast(message, session);
+    if (result == GuessMatcher::Result::Close) {
+        stats.closeGuesses++;
+        session->send(Protocol::makeText(Protocol::MessageType::Close, message.text));
+    }
+}
+
+void GameRoom::handleMessage(PeerSession *session, const Protocol::Message &message)
+{
+    const bool fromDrawer = (session == drawer);
+
+    switch (message.type) {
+    case Protocol::MessageType::Draw:
+    case Protocol::MessageType::Stroke:
+        if (fromDrawer)
+            relayCanvas(message, true);
+        break;
+    case Protocol::MessageType::Params:
+    case Protocol::MessageType::Clear:
+        if (fromDrawer)
+            relayCanvas(message, false);
+        break;
+    case Protocol::MessageType::Undo:
+        if (fromDrawer)
+            relayUndo(message);
+        break;
+    case Protocol::MessageType::Image:
+        if (!fromDrawer) break;
+        // A keyframe nobody else waits for is only kept for spectators.
+        if (!snapshotWaiters.isEmpty() || !pngWaiters.isEmpty())
+            sendSnapshot(message);
+        else if (!keyframeRequested)
+            broadcast(message, session);
+        setKeyframe(message);
+        releaseHeldMessages();
+        break;
+    case Protocol::MessageType::StrokeLog:
+    case Protocol::MessageType::TileHashes:
+        if (!fromDrawer) break;
+        if (message.type == Protocol::MessageType::StrokeLog)
+            setKeyframe(message);
+        sendSnapshot(message);
+        requestPng();
+        releaseHeldMessages();
+        break;
+    case Protocol::MessageType::RequestTiles:
+        if (drawer && !fromDrawer)
+            forwardTileRequest(session, message);
+        break;
+    case Protocol::MessageType::Tiles:
+        if (!fromDrawer) break;
+        routeTiles(message);
+        if (!drawer->isReceivingBulk())
+            commitUploadDeltas();
+        releaseHeldMessages();
+        break;
+    case Protocol::MessageType::Chat:
+        if (!fromDrawer && drawer)
+            checkGuess(session, message);
+        else
+            broadcast(message, session);
+        break;
+    case Protocol::MessageType::RequestImage:
+        requestSnapshot(session);
+        break;
+    default:
+        break;
+    }
+}
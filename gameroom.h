@@ -0,0 +1,157 @@
+#ifndef GAMEROOM_H
+#define GAMEROOM_H
+
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QStringList>
+#include "peersession.h"
+#include "guessmatcher.h"
+#include "worddictionary.h"
+
+class QTimer;
+class UdpRelay;
+
+// Game state of one room: players, roles, the current word and the round
+// clock. The room picks the words, none twice until the dictionary is used
+// up, and runs the timer; clients only render what it sends them. Drawing
+// traffic from the drawer is encoded once per wire format and the same
+// buffer is queued on every other session. With a UDP relay set, strokes
+// go out as datagrams to every session that opened the UDP channel and over
+// TCP to the rest. Strokes that reach the room while a snapshot is still
+// arriving from the drawer in chunks are newer than that snapshot and reach
+// its recipients only after it.
+//
+// Spectators receive everything the room broadcasts but never draw, chat or
+// guess. For them the room keeps the last full snapshot of the round as a
+// keyframe plus the canvas messages that followed it; a spectator joining
+// late gets that log replayed from buffers encoded once and shared by every
+// joiner, instead of a snapshot of its own from the drawer. The drawer is
+// asked for a new keyframe when the log grows long or old. The log is only
+// kept while somebody watches; the first spectator after a gap waits for a
+// fresh keyframe.
+//
+// Guesses are checked here, not by the guessers: only the drawer is sent
+// the word, everybody else a blank per letter until the round times out.
+// A chat message that matches the word (see GuessMatcher) wins the round
+// and is not shown to the others, a close one earns its sender a CLOSE
+// hint. WIN goes to everybody after the next round's state, so the winner,
+// who draws next, can tell the win is its own.
+class GameRoom : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int kRoundSeconds = 180;
+    static constexpr int kKeyframeSeconds = 15;
+    static constexpr int kKeyframeDeltaBytes = 256 * 1024;
+
+    struct Stats {
+        quint64 broadcasts = 0;
+        quint64 fanoutFrames = 0;
+        qint64 fanoutNsecs = 0;
+        qint64 maxFanoutNsecs = 0;
+        quint64 catchUps = 0;
+        quint64 catchUpBytes = 0;
+        quint64 keyframes = 0;
+        quint64 guesses = 0;
+        quint64 closeGuesses = 0;
+        qint64 guessNsecs = 0;
+    };
+
+    GameRoom(const QString &name, const WordDictionary *words, QObject *parent = nullptr);
+
+    static QStringList defaultWords();
+
+    QString name() const { return roomName; }
+    int sessionCount() const { return sessions.size() + spectators.size(); }
+    qint64 maxQueuedBytes() const;
+    Stats takeStats();
+
+    // Must be set before the first session is added.
+    void setUdpRelay(UdpRelay *relay) { udpRelay = relay; }
+
+    void addSession(PeerSession *session);
+    void removeSession(PeerSession *session);
+
+public slots:
+    void handleMessage(PeerSession *session, const Protocol::Message &message);
+    void onStrokesLost(PeerSession *session);
+
+private slots:
+    void tick();
+    void onResyncNeeded(PeerSession *session);
+    void handleSpectatorMessage(PeerSession *session, const Protocol::Message &message);
+
+private:
+    // A message sent to several peers, encoded at most once per wire version.
+    // Copies share the encodings made before the copy.
+    struct SharedFrame {
+        Protocol::Message message;
+        QByteArray frames[Protocol::kBinaryVersion + 1];
+
+        const QByteArray &encoded(int version);
+    };
+
+    struct Held {
+        SharedFrame frame;
+        bool droppable;
+    };
+
+    void startRound(PeerSession *newDrawer);
+    void stopRound();
+    void sendRoundState(PeerSession *session);
+    void broadcast(const Protocol::Message &message, PeerSession *except, bool droppable = false,
+                   const QSet<PeerSession *> &skip = QSet<PeerSession *>());
+    void broadcast(SharedFrame &frame, PeerSession *except, bool droppable = false,
+                   const QSet<PeerSession *> &skip = QSet<PeerSession *>());
+    void deliver(PeerSession *session, SharedFrame &frame, bool droppable);
+    void relayCanvas(const Protocol::Message &message, bool droppable);
+    void relayUndo(const Protocol::Message &message);
+    void checkGuess(PeerSession *session, const Protocol::Message &message);
+    void releaseHeldMessages();
+    void requestSnapshot(PeerSession *session);
+    void requestPng();
+    void sendSnapshot(const Protocol::Message &message);
+    void forwardTileRequest(PeerSession *session, const Protocol::Message &message);
+    void routeTiles(const Protocol::Message &message);
+    void addSpectator(PeerSession *session);
+    void sendCatchUp(PeerSession *session);
+    void recordDelta(SharedFrame &frame);
+    void setKeyframe(const Protocol::Message &message);
+    void commitUploadDeltas();
+    void resetKeyframe();
+    void requestKeyframe();
+    QString pickWord();
+    static QString maskWord(const QString &word);
+
+    QString roomName;
+    const WordDictionary *words;
+    WordSampler sampler;
+    QTimer *roundTimer;
+    UdpRelay *udpRelay;
+    QList<PeerSession *> sessions;
+    QList<PeerSession *> spectators;
+    PeerSession *drawer;
+    QSet<PeerSession *> snapshotWaiters;   // take a stroke log, tiles or an image in any format
+    QSet<PeerSession *> pngWaiters;        // text and version 2 peers, take a PNG only
+    bool pngRequested;
+    QHash<quint32, PeerSession *> tileRequests;
+    quint32 lastTileRequest;
+    QSet<PeerSession *> heldFor;        // snapshot recipients while the drawer uploads one
+    QList<Held> heldMessages;
+    SharedFrame keyframe;               // Invalid: the canvas was blank
+    QList<SharedFrame> deltas;
+    QList<SharedFrame> uploadDeltas;    // arrived while the drawer uploads a snapshot
+    QSet<PeerSession *> catchUpWaiters; // spectators to catch up from the next keyframe
+    qint64 deltaBytes;
+    bool logStale;                      // canvas messages went unlogged without spectators
+    bool keyframeRequested;
+    int keyframeAge;
+    QString currentWord;
+    GuessMatcher matcher;
+    int secondsLeft;
+    Stats stats;
+};
+
+#endif // GAMEROOM_H
@@ -0,0 +1,126 @@
+#include "guessmatcher.h"
+#include <algorithm>
+
+namespace {
+
+int slotOf(ushort key)
+{
+    return int((key * 2654435761u) >> 25) & 127;
+}
+
+}
+
+int GuessMatcher::normalize(const QString &text, QChar *out, int capacity)
+{
+    int length = 0;
+    for (QChar c : text) {
+        if (!c.isLetterOrNumber())
+            continue;
+        c = c.toLower();
+        if (c == QChar(0x0451))     // ё
+            c = QChar(0x0435);      // е
+        if (length == capacity)
+            return -1;
+        out[length++] = c;
+    }
+    return length;
+}
+
+QString GuessMatcher::normalized(const QString &text)
+{
+    QChar buffer[kMaxLength];
+    const int length = normalize(text, buffer, kMaxLength);
+    return length < 0 ? QString() : QString(buffer, length);
+}
+
+void GuessMatcher::setWord(const QString &newWord)
+{
+    std::fill(std::begin(keys), std::end(keys), ushort(0));
+    std::fill(std::begin(masks), std::end(masks), quint64(0));
+    wordLength = qMax(0, normalize(newWord, word, kMaxLength));
+
+    for (int i = 0; i < wordLength; ++i) {
+        const ushort key = word[i].unicode();
+        int slot = slotOf(key);
+        while (keys[slot] != 0 && keys[slot] != key)
+            slot = (slot + 1) & (kTableSize - 1);
+        keys[slot] = key;
+        masks[slot] |= quint64(1) << i;
+    }
+}
+
+quint64 GuessMatcher::matchMask(QChar c) const
+{
+    const ushort key = c.unicode();
+    for (int slot = slotOf(key); keys[slot] != 0; slot = (slot + 1) & (kTableSize - 1)) {
+        if (keys[slot] == key)
+            return masks[slot];
+    }
+    return 0;
+}
+
+// Short words tolerate one typo, long ones two; words under four letters
+// are too easy to hit by accident.
+int GuessMatcher::closeLimit() const
+{
+    if (wordLength < 4)
+        return 0;
+    return wordLength < 8 ? 1 : 2;
+}
+
+// Levenshtein distance between the word (the pattern, one bit per
+// character) and the whole text, as in Hyyrö's formulation of Myers'
+// algorithm: one column of the DP matrix per text character, kept as
+// vertical +1/-1 deltas.
+int GuessMatcher::distance(const QChar *text, int length) const
+{
+    if (wordLength == 0)
+        return length;
+
+    const quint64 high = quint64(1) << (wordLength - 1);
+    quint64 pv = ~quint64(0);
+    quint64 mv = 0;
+    int score = wordLength;
+    for (int i = 0; i < length; ++i) {
+        const quint64 eq = matchMask(text[i]);
+        const quint64 xv = eq | mv;
+        const quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        quint64 ph = mv | ~(xh | pv);
+        quint64 mh = pv & xh;
+        if (ph & high)
+            score++;
+        else if (mh & high)
+            score--;
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+    return score;
+}
+
+int GuessMatcher::distance(const QString &guess) const
+{
+    QChar buffer[kMaxLength];
+    const int length = normalize(guess, buffer, kMaxLength);
+    return length < 0 ? -1 : distance(buffer, length);
+}
+
+GuessMatcher::Result GuessMatcher::check(const QString &guess) const
+{
+    if (wordLength == 0)
+        return Result::Miss;
+
+    QChar buffer[kMaxLength];
+    const int length = normalize(guess, buffer, kMaxLength);
+    if (length <= 0)
+        return Result::Miss;
+    if (length == wordLength && std::equal(buffer, buffer + length, word))
+        return Result::Exact;
+
+    // the distance is at least the difference in length
+    const int limit = closeLimit();
+    if (qAbs(length - wordLength) > limit)
+        return Result::Miss;
+    return distance(buffer, length) <= limit ? Result::Close : Result::Miss;
+}
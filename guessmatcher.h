@@ -0,0 +1,44 @@
+#ifndef GUESSMATCHER_H
+#define GUESSMATCHER_H
+
+#include <QString>
+
+// Checks chat guesses against the word of the round. Both sides are
+// normalized first: case and ё/е are folded, punctuation, spaces, hyphens
+// and dashes are dropped, so "Эйфелева башня", "эйфелева-башня" and
+// "ЭЙФЕЛЕВАБАШНЯ" are the same guess. A guess that is not exact but within
+// a few edits of the word is reported as close; the edit distance is Myers'
+// bit-parallel algorithm over the normalized word (at most kMaxLength
+// characters, one machine word of state).
+//
+// setWord() prepares the word once per round; check() works on a stack
+// buffer and does not allocate.
+class GuessMatcher
+{
+public:
+    enum class Result { Miss, Close, Exact };
+
+    static constexpr int kMaxLength = 64;
+
+    void setWord(const QString &word);
+    Result check(const QString &guess) const;
+    int distance(const QString &guess) const;   // -1: not comparable
+
+    // Returns the normalized length, -1 if it does not fit into capacity.
+    static int normalize(const QString &text, QChar *out, int capacity);
+    static QString normalized(const QString &text);
+
+private:
+    static constexpr int kTableSize = 128;  // open addressing, at most 64 keys
+
+    int distance(const QChar *text, int length) const;
+    quint64 matchMask(QChar c) const;
+    int closeLimit() const;
+
+    QChar word[kMaxLength];
+    int wordLength = 0;
+    ushort keys[kTableSize] = {};
+    quint64 masks[kTableSize] = {};
+};
+
+#endif // GUESSMATCHER_H
@@ -0,0 +1,102 @@
+#include "imagecodec.h"
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+namespace {
+
+struct EncodeResult {
+    QByteArray data;
+    qint64 msecs = 0;
+};
+
+struct DecodeResult {
+    QImage image;
+    qint64 msecs = 0;
+};
+
+}
+
+ImageCodec::ImageCodec(QObject *parent)
+    : QObject(parent),
+      encodeGeneration(0),
+      decodeGeneration(0),
+      encodePending(false),
+      decodePending(false),
+      inFlight(0),
+      stale(0)
+{
+}
+
+quint64 ImageCodec::encode(const QImage &image, SnapshotCodec::Format format)
+{
+    const quint64 generation = ++encodeGeneration;
+    encodePending = true;
+    inFlight++;
+
+    auto *watcher = new QFutureWatcher<EncodeResult>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        inFlight--;
+        if (generation != encodeGeneration) {
+            stale++;
+            return;
+        }
+        encodePending = false;
+        const EncodeResult result = watcher->result();
+        emit encoded(result.data, result.msecs);
+    });
+
+    // QImage is implicitly shared: the worker keeps this version alive while
+    // the canvas detaches on the next stroke.
+    watcher->setFuture(QtConcurrent::run([image, format]() {
+        Metrics::ScopedTimer probe(Metrics::Timing::Encode);
+        QElapsedTimer timer;
+        timer.start();
+        EncodeResult result;
+        result.data = SnapshotCodec::encode(image, format);
+        result.msecs = timer.elapsed();
+        return result;
+    }));
+    return generation;
+}
+
+quint64 ImageCodec::decode(const QByteArray &data)
+{
+    const quint64 generation = ++decodeGeneration;
+    decodePending = true;
+    inFlight++;
+
+    auto *watcher = new QFutureWatcher<DecodeResult>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        inFlight--;
+        if (generation != decodeGeneration) {
+            stale++;
+            return;
+        }
+        decodePending = false;
+        const DecodeResult result = watcher->result();
+        emit decoded(result.image, result.msecs);
+    });
+
+    watcher->setFuture(QtConcurrent::run([data]() {
+        Metrics::ScopedTimer probe(Metrics::Timing::Decode);
+        QElapsedTimer timer;
+        timer.start();
+        DecodeResult result;
+        SnapshotCodec::decode(data, &result.image);
+        result.msecs = timer.elapsed();
+        return result;
+    }));
+    return generation;
+}
+
+void ImageCodec::cancel()
+{
+    ++encodeGeneration;
+    ++decodeGeneration;
+    encodePending = false;
+    decodePending = false;
+}
@@ -0,0 +1,41 @@
+#ifndef IMAGECODEC_H
+#define IMAGECODEC_H
+
+#include <QObject>
+#include <QImage>
+#include <QByteArray>
+#include "snapshotcodec.h"
+
+// Snapshot encoding and decoding on the global thread pool. Every request gets a
+// generation number; only the result of the newest encode and the newest
+// decode is delivered, older ones are dropped when they finish. cancel()
+// invalidates whatever is still in flight.
+class ImageCodec : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ImageCodec(QObject *parent = nullptr);
+
+    quint64 encode(const QImage &image, SnapshotCodec::Format format = SnapshotCodec::Format::Png);
+    quint64 decode(const QByteArray &data);
+    void cancel();
+
+    bool isEncodePending() const { return encodePending; }
+    bool isDecodePending() const { return decodePending; }
+    int jobsInFlight() const { return inFlight; }
+    quint64 staleResults() const { return stale; }
+
+signals:
+    void encoded(const QByteArray &data, qint64 msecs);
+    void decoded(const QImage &image, qint64 msecs);
+
+private:
+    quint64 encodeGeneration;
+    quint64 decodeGeneration;
+    bool encodePending;
+    bool decodePending;
+    int inFlight;
+    quint64 stale;
+};
+
+#endif // IMAGECODEC_H
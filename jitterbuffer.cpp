@@ -0,0 +1,206 @@
+#include "jitterbuffer.h"
+#include <QtMath>
+
+JitterBuffer::JitterBuffer(QObject *parent)
+    : QObject(parent),
+      active(true),
+      smoothing(false),
+      haveOffset(false),
+      offset(0),
+      delayMean(0),
+      delayDeviation(0),
+      depth(kMinDepth),
+      lastPlayAt(0),
+      haveTail(false)
+{
+    clock.start();
+    playTimer.setTimerType(Qt::PreciseTimer);
+    playTimer.setInterval(kTickInterval);
+    connect(&playTimer, &QTimer::timeout, this, &JitterBuffer::play);
+}
+
+void JitterBuffer::push(const Protocol::Stroke &stroke)
+{
+    if (stroke.points.isEmpty())
+        return;
+    counters.strokes++;
+
+    if (!active || stroke.times.size() != stroke.points.size()) {
+        flush();
+        recordDirect(stroke);
+        emit strokesReady(QVector<Protocol::Stroke>() << stroke);
+        return;
+    }
+
+    const qint64 now = clock.elapsed();
+    updateOffset(stroke, now);
+
+    // How much later than the fastest delivery the oldest point arrived;
+    // includes the drawer's batching interval as well as network jitter.
+    const double delay = double(now - qint64(stroke.times.first()) - offset);
+    delayMean += (delay - delayMean) / 16.0;
+    delayDeviation += (qAbs(delay - delayMean) - delayDeviation) / 16.0;
+    depth = qBound(kMinDepth, int(delayMean + 2.0 * delayDeviation), kMaxDepth);
+
+    const bool continues = (haveTail || !queue.isEmpty())
+                           && stroke.pen == (queue.isEmpty() ? tailPen : queue.last().pen)
+                           && stroke.points.first() == (queue.isEmpty() ? tail[1] : queue.last().pos);
+
+    const int first = continues ? 1 : 0;
+    for (int i = first; i < stroke.points.size(); ++i) {
+        Point point;
+        point.pos = stroke.points[i];
+        point.pen = stroke.pen;
+        point.startsStroke = (i == 0);
+        point.sentAt = i == stroke.points.size() - 1 ? qint64(stroke.times[i]) + offset : -1;
+        point.playAt = qMax(lastPlayAt, qint64(stroke.times[i]) + offset + depth);
+        lastPlayAt = point.playAt;
+        queue.append(point);
+    }
+    if (first < stroke.points.size() && qint64(stroke.times[first]) + offset + depth <= now)
+        counters.late++;
+
+    if (!playTimer.isActive())
+        playTimer.start();
+    play();
+}
+
+void JitterBuffer::recordDirect(const Protocol::Stroke &stroke)
+{
+    if (stroke.points.isEmpty() || stroke.times.size() != stroke.points.size())
+        return;
+    const qint64 now = clock.elapsed();
+    updateOffset(stroke, now);
+    latency.record(now - qint64(stroke.times.last()) - offset);
+}
+
+void JitterBuffer::updateOffset(const Protocol::Stroke &stroke, qint64 now)
+{
+    const qint64 transit = now - qint64(stroke.times.last());
+    if (!haveOffset || transit < offset) {
+        offset = transit;
+        haveOffset = true;
+    }
+}
+
+void JitterBuffer::play()
+{
+    const qint64 now = clock.elapsed();
+    int due = 0;
+    while (due < queue.size() && queue[due].playAt <= now)
+        ++due;
+    emitPoints(due);
+
+    if (queue.isEmpty())
+        playTimer.stop();
+}
+
+void JitterBuffer::flush()
+{
+    emitPoints(queue.size());
+    playTimer.stop();
+}
+
+void JitterBuffer::reset()
+{
+    queue.clear();
+    playTimer.stop();
+    haveOffset = false;
+    offset = 0;
+    delayMean = 0;
+    delayDeviation = 0;
+    depth = kMinDepth;
+    haveTail = false;
+    lastPlayAt = 0;
+}
+
+JitterBuffer::Stats JitterBuffer::stats() const
+{
+    Stats result = counters;
+    result.depth = depth;
+    result.buffered = queue.size();
+    return result;
+}
+
+JitterBuffer::Latency JitterBuffer::takeLatency()
+{
+    Latency taken;
+    taken.strokes = latency.count();
+    taken.mean = latency.mean();
+    taken.p99 = latency.percentile(0.99);
+    taken.max = latency.max();
+    latency.reset();
+    return taken;
+}
+
+void JitterBuffer::emitPoints(int count)
+{
+    if (count == 0)
+        return;
+
+    const qint64 now = clock.elapsed();
+    QVector<Protocol::Stroke> strokes;
+    for (int i = 0; i < count; ++i) {
+        const Point &point = queue[i];
+        if (point.sentAt >= 0)
+            latency.record(now - point.sentAt);
+        if (point.startsStroke || !haveTail) {
+            Protocol::Stroke stroke;
+            stroke.pen = point.pen;
+            stroke.points.append(point.pos);
+            strokes.append(stroke);
+            tail[0] = tail[1] = point.pos;
+            tailPen = point.pen;
+            haveTail = true;
+            continue;
+        }
+
+        if (strokes.isEmpty()) {
+            Protocol::Stroke stroke;
+            stroke.pen = point.pen;
+            stroke.points.append(tail[1]);
+            strokes.append(stroke);
+        }
+        Protocol::Stroke &stroke = strokes.last();
+
+        // the point after this one, if it already arrived and continues the stroke
+        const bool haveNext = i + 1 < queue.size() && !queue[i + 1].startsStroke;
+        const QPoint next = haveNext ? queue[i + 1].pos : point.pos;
+        if (smoothing)
+            appendSmoothed(&stroke, tail[0], tail[1], point.pos, next);
+        else
+            stroke.points.append(point.pos);
+
+        tail[0] = tail[1];
+        tail[1] = point.pos;
+    }
+    queue.remove(0, count);
+
+    // a dot is a stroke of one point; draw it as a zero-length segment
+    for (Protocol::Stroke &stroke : strokes) {
+        if (stroke.points.size() == 1)
+            stroke.points.append(stroke.points.first());
+    }
+    emit strokesReady(strokes);
+}
+
+void JitterBuffer::appendSmoothed(Protocol::Stroke *out, const QPoint &p0, const QPoint &p1,
+                                  const QPoint &p2, const QPoint &p3) const
+{
+    const double length = qSqrt(double(QPoint::dotProduct(p2 - p1, p2 - p1)));
+    const int steps = qBound(1, int(length / 6.0), 8);
+    for (int step = 1; step < steps; ++step) {
+        const double t = double(step) / steps;
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        const auto spline = [&](double a, double b, double c, double d) {
+            return 0.5 * (2.0 * b + (c - a) * t + (2.0 * a - 5.0 * b + 4.0 * c - d) * t2
+                          + (3.0 * b - a - 3.0 * c + d) * t3);
+        };
+        const QPoint point(qRound(spline(p0.x(), p1.x(), p2.x(), p3.x())),
+                           qRound(spline(p0.y(), p1.y(), p2.y(), p3.y())));
+        if (point != out->points.last())
+            out->points.append(point);
+    }
+    out->points.append(p2);
+}
@@ -0,0 +1,98 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include "metrics.h"
+#include "protocol.h"
+
+// Plays remote strokes back at the pace they were drawn. Points carry the
+// drawer's timestamps; each is scheduled at its timestamp plus the smallest
+// transit seen so far plus an adaptive depth that follows the delay
+// variation. Segments can be smoothed with Catmull-Rom splines on the way
+// out; that is off by default, as the curve then depends on which points
+// have arrived and no longer matches what the drawer painted. Strokes
+// without timestamps are passed through untouched.
+//
+// The same offset gives each timed stroke a send-to-paint latency: from
+// the drawer's timestamp of its last point to when that point is handed
+// out, less the fastest transit seen. Between processes on one machine
+// the fastest transit is close to zero.
+class JitterBuffer : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int kMinDepth = 20;
+    static constexpr int kMaxDepth = 250;
+    static constexpr int kTickInterval = 8;
+
+    struct Stats {
+        int depth = 0;          // ms
+        int buffered = 0;       // points waiting
+        quint64 strokes = 0;
+        quint64 late = 0;       // strokes whose first point was already due on arrival
+    };
+
+    struct Latency {
+        quint64 strokes = 0;
+        double mean = 0;        // ms
+        qint64 p99 = 0;
+        qint64 max = 0;
+    };
+
+    explicit JitterBuffer(QObject *parent = nullptr);
+
+    void setEnabled(bool enabled) { active = enabled; }
+    bool isEnabled() const { return active; }
+    void setSmoothing(bool enabled) { smoothing = enabled; }
+    bool isSmoothing() const { return smoothing; }
+
+    void push(const Protocol::Stroke &stroke);
+    // For strokes painted without going through the buffer.
+    void recordDirect(const Protocol::Stroke &stroke);
+    void flush();
+    void reset();
+    Stats stats() const;
+    Latency takeLatency();
+
+signals:
+    void strokesReady(const QVector<Protocol::Stroke> &strokes);
+
+private slots:
+    void play();
+
+private:
+    struct Point {
+        QPoint pos;
+        qint64 playAt;
+        Protocol::PenParams pen;
+        bool startsStroke;
+        qint64 sentAt;          // last point of a pushed stroke: its timestamp + offset, else -1
+    };
+
+    void updateOffset(const Protocol::Stroke &stroke, qint64 now);
+    void emitPoints(int count);
+    void appendSmoothed(Protocol::Stroke *out, const QPoint &p0, const QPoint &p1,
+                        const QPoint &p2, const QPoint &p3) const;
+
+    QElapsedTimer clock;
+    QTimer playTimer;
+    QVector<Point> queue;
+    bool active;
+    bool smoothing;
+    bool haveOffset;
+    qint64 offset;          // local time - drawer time, minimum seen
+    double delayMean;
+    double delayDeviation;
+    int depth;
+    qint64 lastPlayAt;
+    bool haveTail;
+    QPoint tail[2];         // last two points played, for the spline
+    Protocol::PenParams tailPen;
+    Metrics::Histogram latency;     // ms
+    Stats counters;
+};
+
+#endif // JITTERBUFFER_H
@@ -1,9 +1,74 @@
 #include "drawgame.h"
+#include "metricsexporter.h"
+#include "sessionreplay.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+// Replays a recording made with DRAWGAME_RECORD. Without --realtime it runs
+// as fast as possible and reports timings, which works with
+// -platform offscreen; with it the canvas is shown at the recorded pace.
+static int replaySession(QApplication &app, const QString &path, bool realtime, double speed, const QString &savePath)
+{
+    SessionLog::Reader log;
+    if (!log.open(path)) {
+        qCritical().noquote() << "Cannot open recording" << path << ":" << log.errorString();
+        return 1;
+    }
+
+    DrawingArea area;
+    area.setDrawingEnabled(false);
+    area.resize(800, 600);
+    SessionReplay replay(&log, &area);
+    QObject::connect(&replay, &SessionReplay::finished, &app, [&]() {
+        const SessionReplay::Stats stats = replay.stats();
+        qInfo().noquote() << QString("replay: %1 messages (%2 canvas), %3 segments, %4 snapshots, "
+                                     "%5 ms applying, recording spans %6 s, %7 bytes mapped")
+                                 .arg(stats.messages).arg(stats.canvasMessages).arg(stats.segments)
+                                 .arg(stats.snapshots).arg(stats.nsecs / 1000000.0, 0, 'f', 2)
+                                 .arg(log.durationUsecs() / 1000000.0, 0, 'f', 1).arg(log.mappedBytes());
+        if (!savePath.isEmpty() && !area.getImage().save(savePath))
+            qWarning().noquote() << "Cannot save" << savePath;
+        if (!realtime)
+            QMetaObject::invokeMethod(&app, "quit", Qt::QueuedConnection);
+    });
+
+    if (realtime) {
+        area.setWindowTitle(QString("Повтор: %1").arg(path));
+        area.show();
+        replay.start(speed);
+    } else {
+        replay.runFast();
+    }
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    // The canvas batches pointer samples itself, so let every one through.
+    QCoreApplication::setAttribute(Qt::AA_CompressHighFrequencyEvents, false);
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption replayOption("replay", "Replay a session recorded with DRAWGAME_RECORD.", "file");
+    QCommandLineOption realtimeOption("realtime", "Replay at the recorded pace instead of as fast as possible.");
+    QCommandLineOption speedOption("speed", "Playback speed factor for --realtime.", "factor", "1");
+    QCommandLineOption saveOption("save", "Save the replayed canvas to an image file.", "file");
+    parser.addOption(replayOption);
+    parser.addOption(realtimeOption);
+    parser.addOption(speedOption);
+    parser.addOption(saveOption);
+    parser.process(a);
+
+    if (parser.isSet(replayOption)) {
+        return replaySession(a, parser.value(replayOption), parser.isSet(realtimeOption),
+                             parser.value(speedOption).toDouble(), parser.value(saveOption));
+    }
+
+    MetricsExporter metrics;
+    metrics.configureFromEnvironment();
+
     DrawGame w;
     w.show();
     return a.exec();
@@ -0,0 +1,217 @@
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QtAlgorithms>
+
+Q_LOGGING_CATEGORY(lcStats, "drawgame.stats", QtInfoMsg)
+
+namespace Metrics {
+
+std::atomic<bool> enabledFlag { true };
+std::atomic<bool> tracingFlag { false };
+
+namespace {
+
+constexpr int kTypeSlots = 32;
+constexpr int kMaxTraceEvents = 1 << 20;
+
+struct Counter {
+    QAtomicInteger<quint64> messages;
+    QAtomicInteger<quint64> bytes;
+};
+
+Counter counters[2][kTypeSlots];
+Histogram timings[int(Timing::Count)];
+Histogram queue;
+
+QElapsedTimer startClock()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+const QElapsedTimer clock = startClock();
+
+QMutex traceMutex;
+QVector<TraceEvent> traceEvents;
+bool traceFull = false;
+
+QJsonObject summary(const Histogram &histogram, double scale)
+{
+    QJsonObject object;
+    object["count"] = double(histogram.count());
+    object["mean"] = histogram.mean() / scale;
+    object["p50"] = histogram.percentile(0.50) / scale;
+    object["p90"] = histogram.percentile(0.90) / scale;
+    object["p99"] = histogram.percentile(0.99) / scale;
+    object["max"] = histogram.max() / scale;
+    return object;
+}
+
+}
+
+int Histogram::bucketOf(qint64 value)
+{
+    const quint64 clamped = quint64(qBound<qint64>(0, value, (qint64(1) << kMaxBits) - 1));
+    const int top = 63 - qCountLeadingZeroBits(clamped | 1);
+    const int shift = qMax(0, top - kSubBits);
+    return shift * kSubBuckets + int(clamped >> shift);
+}
+
+// The highest value that falls into the bucket.
+qint64 Histogram::bucketValue(int bucket)
+{
+    if (bucket < 2 * kSubBuckets)
+        return bucket;
+    const int shift = bucket / kSubBuckets - 1;
+    const qint64 mantissa = bucket - shift * kSubBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void Histogram::record(qint64 value)
+{
+    buckets[bucketOf(value)].fetchAndAddRelaxed(1);
+    total.fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(quint64(qMax<qint64>(value, 0)));
+
+    qint64 seen = maximum.loadRelaxed();
+    while (value > seen && !maximum.testAndSetRelaxed(seen, value, seen)) {}
+}
+
+void Histogram::reset()
+{
+    for (QAtomicInteger<quint64> &bucket : buckets)
+        bucket.storeRelaxed(0);
+    total.storeRelaxed(0);
+    sum.storeRelaxed(0);
+    maximum.storeRelaxed(0);
+}
+
+double Histogram::mean() const
+{
+    const quint64 samples = count();
+    return samples ? double(sum.loadRelaxed()) / samples : 0;
+}
+
+qint64 Histogram::percentile(double fraction) const
+{
+    const quint64 samples = count();
+    if (samples == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(1, quint64(fraction * samples + 0.5));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += buckets[bucket].loadRelaxed();
+        if (seen >= rank)
+            return qMin(bucketValue(bucket), max());
+    }
+    return max();
+}
+
+void setEnabled(bool enabled)
+{
+    enabledFlag.store(enabled, std::memory_order_relaxed);
+}
+
+void setTracing(bool tracing)
+{
+    if (tracing)
+        setEnabled(true);
+    tracingFlag.store(tracing, std::memory_order_relaxed);
+}
+
+qint64 now()
+{
+    return clock.nsecsElapsed();
+}
+
+void count(Direction direction, Protocol::MessageType type, qint64 bytes)
+{
+    if (!enabled())
+        return;
+    Counter &counter = counters[int(direction)][quint8(type) % kTypeSlots];
+    counter.messages.fetchAndAddRelaxed(1);
+    counter.bytes.fetchAndAddRelaxed(quint64(bytes));
+}
+
+void record(Timing timing, qint64 startNsecs, qint64 nsecs)
+{
+    timings[int(timing)].record(nsecs);
+    if (!tracingFlag.load(std::memory_order_relaxed))
+        return;
+
+    QMutexLocker locker(&traceMutex);
+    if (traceEvents.size() >= kMaxTraceEvents) {
+        traceFull = true;
+        return;
+    }
+    traceEvents.append({timing, startNsecs, nsecs, quint64(quintptr(QThread::currentThreadId()))});
+}
+
+void queueDepth(qint64 bytes)
+{
+    if (enabled())
+        queue.record(bytes);
+}
+
+const char *timingName(Timing timing)
+{
+    switch (timing) {
+    case Timing::Encode: return "encode";
+    case Timing::Decode: return "decode";
+    case Timing::Paint: return "paint";
+    case Timing::Send: return "send";
+    default: return "?";
+    }
+}
+
+// Totals since the process started; times in microseconds.
+QByteArray toJson()
+{
+    QJsonObject messages;
+    const char *directions[] = {"in", "out"};
+    for (int direction = 0; direction < 2; ++direction) {
+        QJsonObject types;
+        for (int type = 0; type < kTypeSlots; ++type) {
+            const Counter &counter = counters[direction][type];
+            const quint64 sent = counter.messages.loadRelaxed();
+            if (sent == 0)
+                continue;
+            QJsonObject entry;
+            entry["messages"] = double(sent);
+            entry["bytes"] = double(counter.bytes.loadRelaxed());
+            types[Protocol::typeName(Protocol::MessageType(type))] = entry;
+        }
+        messages[directions[direction]] = types;
+    }
+
+    QJsonObject times;
+    for (int timing = 0; timing < int(Timing::Count); ++timing)
+        times[timingName(Timing(timing))] = summary(timings[timing], 1000.0);
+
+    QJsonObject root;
+    root["uptimeSeconds"] = clock.elapsed() / 1000.0;
+    root["messages"] = messages;
+    root["timingsUs"] = times;
+    root["queueDepthBytes"] = summary(queue, 1.0);
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+QVector<TraceEvent> takeTraceEvents()
+{
+    QMutexLocker locker(&traceMutex);
+    QVector<TraceEvent> taken;
+    taken.swap(traceEvents);
+    if (traceFull) {
+        traceFull = false;
+        qWarning("Metrics: trace buffer was full, events were dropped");
+    }
+    return taken;
+}
+
+}
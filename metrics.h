@@ -0,0 +1,105 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QLoggingCategory>
+#include <QVector>
+#include <atomic>
+#include "protocol.h"
+
+// Process-wide counters and latency histograms for the network and render
+// paths, shared by every thread. Counting is on from the start and can be
+// switched off with setEnabled(false), which leaves one relaxed load and a
+// branch per probe. Recording is lock-free (relaxed atomic increments),
+// except for trace events, which are only collected while a Chrome trace
+// is being written (see MetricsExporter).
+// The periodic traffic, input and snapshot lines of the client and the
+// workers. Off by default; QT_LOGGING_RULES="drawgame.stats.debug=true"
+// turns them on.
+Q_DECLARE_LOGGING_CATEGORY(lcStats)
+
+namespace Metrics {
+
+enum class Timing : quint8 {
+    Encode,     // snapshot, tile and frame encoding
+    Decode,     // frame and snapshot decoding
+    Paint,      // DrawingArea::paintEvent
+    Send,       // handing frames to the socket
+    Count
+};
+
+enum class Direction : quint8 { In, Out };
+
+// Log-linear buckets in the manner of HdrHistogram: values below 32 are
+// exact, every power of two above is split into 32 buckets, so any recorded
+// value is off by at most 1/32. Values are clamped to 2^41 - 1.
+class Histogram
+{
+public:
+    static constexpr int kSubBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxBits = 41;
+    static constexpr int kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+    void record(qint64 value);
+    void reset();
+
+    quint64 count() const { return total.loadRelaxed(); }
+    qint64 max() const { return maximum.loadRelaxed(); }
+    double mean() const;
+    qint64 percentile(double fraction) const;
+
+    static int bucketOf(qint64 value);
+    static qint64 bucketValue(int bucket);
+
+private:
+    QAtomicInteger<quint64> buckets[kBuckets];
+    QAtomicInteger<quint64> total;
+    QAtomicInteger<quint64> sum;
+    QAtomicInteger<qint64> maximum;
+};
+
+struct TraceEvent {
+    Timing timing;
+    qint64 startNsecs;
+    qint64 nsecs;
+    quint64 thread;
+};
+
+extern std::atomic<bool> enabledFlag;
+extern std::atomic<bool> tracingFlag;
+
+inline bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+void setTracing(bool tracing);
+
+// Monotonic nanoseconds since the process started.
+qint64 now();
+
+void count(Direction direction, Protocol::MessageType type, qint64 bytes);
+void record(Timing timing, qint64 startNsecs, qint64 nsecs);
+void queueDepth(qint64 bytes);
+
+const char *timingName(Timing timing);
+QByteArray toJson();
+QVector<TraceEvent> takeTraceEvents();
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Timing timing) : timing(timing), start(enabled() ? now() : -1) {}
+    ~ScopedTimer()
+    {
+        if (start >= 0)
+            record(timing, start, now() - start);
+    }
+
+private:
+    Timing timing;
+    qint64 start;
+};
+
+}
+
+#endif // METRICS_H
@@ -0,0 +1,146 @@
+#include "metricsexporter.h"
+#include "metrics.h"
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDebug>
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent),
+      httpServer(nullptr),
+      firstTraceEvent(true)
+{
+    timer.setInterval(1000);
+    connect(&timer, &QTimer::timeout, this, &MetricsExporter::tick);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    tick();
+    if (traceFile.isOpen()) {
+        traceFile.write("\n]\n");
+        Metrics::setTracing(false);
+    }
+}
+
+void MetricsExporter::start()
+{
+    Metrics::setEnabled(true);
+    if (!timer.isActive())
+        timer.start();
+}
+
+bool MetricsExporter::setDumpFile(const QString &path)
+{
+    dumpPath = path;
+    start();
+    return true;
+}
+
+bool MetricsExporter::listen(quint16 port)
+{
+    if (!httpServer) {
+        httpServer = new QTcpServer(this);
+        connect(httpServer, &QTcpServer::newConnection, this, &MetricsExporter::onConnection);
+    }
+    if (!httpServer->listen(QHostAddress::LocalHost, port)) {
+        error = httpServer->errorString();
+        return false;
+    }
+    start();
+    return true;
+}
+
+bool MetricsExporter::setTraceFile(const QString &path)
+{
+    traceFile.setFileName(path);
+    if (!traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error = traceFile.errorString();
+        return false;
+    }
+    traceFile.write("[\n");
+    firstTraceEvent = true;
+    Metrics::setTracing(true);
+    start();
+    return true;
+}
+
+void MetricsExporter::configureFromEnvironment()
+{
+    if (qEnvironmentVariable("DRAWGAME_METRICS") == "0")
+        Metrics::setEnabled(false);
+    if (qEnvironmentVariableIsSet("DRAWGAME_METRICS_FILE"))
+        setDumpFile(qEnvironmentVariable("DRAWGAME_METRICS_FILE"));
+    if (qEnvironmentVariableIsSet("DRAWGAME_METRICS_PORT")
+        && !listen(quint16(qEnvironmentVariableIntValue("DRAWGAME_METRICS_PORT"))))
+        qWarning().noquote() << "Metrics: cannot listen:" << error;
+    if (qEnvironmentVariableIsSet("DRAWGAME_TRACE") && !setTraceFile(qEnvironmentVariable("DRAWGAME_TRACE")))
+        qWarning().noquote() << "Metrics: cannot write trace:" << error;
+}
+
+void MetricsExporter::tick()
+{
+    if (!dumpPath.isEmpty()) {
+        // readers never see a half-written file
+        QSaveFile file(dumpPath);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(Metrics::toJson());
+            file.write("\n");
+            file.commit();
+        }
+    }
+    if (traceFile.isOpen())
+        writeTrace();
+}
+
+void MetricsExporter::writeTrace()
+{
+    const QVector<Metrics::TraceEvent> events = Metrics::takeTraceEvents();
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out;
+    for (const Metrics::TraceEvent &event : events) {
+        if (!firstTraceEvent)
+            out += ",\n";
+        firstTraceEvent = false;
+        out += QString("{\"name\":\"%1\",\"ph\":\"X\",\"ts\":%2,\"dur\":%3,\"pid\":%4,\"tid\":%5}")
+                   .arg(Metrics::timingName(event.timing))
+                   .arg(event.startNsecs / 1000.0, 0, 'f', 3).arg(event.nsecs / 1000.0, 0, 'f', 3)
+                   .arg(pid).arg(event.thread).toLatin1();
+    }
+    traceFile.write(out);
+    traceFile.flush();
+}
+
+void MetricsExporter::onConnection()
+{
+    while (QTcpSocket *socket = httpServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { respond(socket); });
+    }
+}
+
+// Answers once the request head is complete; the body of the request, if
+// any, is ignored.
+void MetricsExporter::respond(QTcpSocket *socket)
+{
+    if (!socket->peek(socket->bytesAvailable()).contains("\r\n\r\n")) {
+        if (socket->bytesAvailable() > 8192)
+            socket->abort();
+        return;
+    }
+
+    const QByteArray request = socket->readAll();
+    QByteArray status = "200 OK";
+    QByteArray body;
+    if (request.startsWith("GET ")) {
+        body = Metrics::toJson();
+    } else {
+        status = "405 Method Not Allowed";
+    }
+    socket->write("HTTP/1.1 " + status + "\r\n"
+                  "Content-Type: application/json\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                  "Connection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
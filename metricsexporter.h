@@ -0,0 +1,49 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+
+class QTcpServer;
+class QTcpSocket;
+
+// Gets Metrics out of the process: a JSON snapshot rewritten to a file on a
+// timer, the same JSON over HTTP on a loopback-only port (any GET), and a
+// Chrome trace ("chrome://tracing", Perfetto) of every timed section. The
+// trace uses the JSON array form, which may be left unterminated, so events
+// are appended as they come and a killed process still leaves a usable
+// file. Configuring any of them enables Metrics.
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+    ~MetricsExporter();
+
+    bool setDumpFile(const QString &path);
+    bool listen(quint16 port);
+    bool setTraceFile(const QString &path);
+    QString errorString() const { return error; }
+
+    // DRAWGAME_METRICS_FILE, DRAWGAME_METRICS_PORT and DRAWGAME_TRACE.
+    void configureFromEnvironment();
+
+private slots:
+    void tick();
+    void onConnection();
+
+private:
+    void start();
+    void respond(QTcpSocket *socket);
+    void writeTrace();
+
+    QString dumpPath;
+    QTcpServer *httpServer;
+    QFile traceFile;
+    bool firstTraceEvent;
+    QTimer timer;
+    QString error;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,59 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free multi-producer / single-consumer queue (Vyukov's
+// node-based design). push() may be called from any thread, pop() only from
+// the consumer's thread. pop() can report empty while a concurrent push is
+// half done. Producers therefore set a wake flag after pushing and post a
+// wakeup only if it was clear; the consumer clears it with an exchange
+// (not a plain store, which the following pops could overtake) before
+// draining, so a push that raced with the drain always gets a new one.
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(&value)) {}
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node;
+        node->value = std::move(value);
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T *value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        *value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node *> next { nullptr };
+        T value {};
+    };
+
+    std::atomic<Node *> head;
+    Node *tail;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,131 @@
+#include "peersession.h"
+#include "metrics.h"
+#include <QTcpSocket>
+#include <QDebug>
+
+QAtomicInteger<quint32> PeerSession::sequenceCounter;
+
+PeerSession::PeerSession(QTcpSocket *socket, QObject *parent)
+    : QObject(parent),
+      tcpSocket(socket),
+      wireVersion(Protocol::kTextVersion),
+      needsResync(false),
+      suspended(false),
+      spectator(false)
+{
+    tcpSocket->setParent(this);
+    connect(tcpSocket, &QTcpSocket::readyRead, this, &PeerSession::readData);
+    connect(tcpSocket, &QTcpSocket::bytesWritten, this, &PeerSession::drain);
+    connect(tcpSocket, &QTcpSocket::disconnected, this, [this]() { emit closed(this); });
+
+    send(Protocol::makeText(Protocol::MessageType::Proto, QString::number(Protocol::kBinaryVersion)));
+}
+
+QByteArray PeerSession::encode(const Protocol::Message &message, int version)
+{
+    Metrics::ScopedTimer timer(Metrics::Timing::Encode);
+    return version >= Protocol::kMinBinaryVersion
+               ? Protocol::encodeFrame(message, sequenceCounter.fetchAndAddRelaxed(1), version)
+               : Protocol::encodeText(message);
+}
+
+void PeerSession::send(const Protocol::Message &message)
+{
+    sendEncoded(encode(message, wireVersion), message.type);
+}
+
+// The frame must have been encoded for this session's current version.
+void PeerSession::sendEncoded(const QByteArray &frame, Protocol::MessageType type, bool droppable)
+{
+    if (frame.isEmpty() || tcpSocket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    Metrics::count(Metrics::Direction::Out, type, frame.size());
+    outbox.enqueue(frame, SendQueue::priorityOf(type), droppable, isBinary());
+    if (outbox.bytes() > SendQueue::kMaxQueuedBytes)
+        dropBacklog();
+    drain();
+}
+
+void PeerSession::drain()
+{
+    {
+        Metrics::ScopedTimer timer(Metrics::Timing::Send);
+        QByteArray frame;
+        while (outbox.takeNext(tcpSocket->bytesToWrite(), &frame))
+            tcpSocket->write(frame);
+    }
+    Metrics::queueDepth(tcpSocket->bytesToWrite() + outbox.bytes());
+
+    if (outbox.isEmpty() && needsResync) {
+        needsResync = false;
+        emit resyncNeeded(this);
+    }
+}
+
+// Frames queued in text mode must reach the peer before the BINARY line.
+void PeerSession::flushOutbox()
+{
+    QByteArray frame;
+    while (outbox.takeNext(0, &frame))
+        tcpSocket->write(frame);
+}
+
+void PeerSession::dropBacklog()
+{
+    qint64 dropped = outbox.dropDroppable();
+    qDebug() << "PeerSession: slow peer" << tcpSocket->peerAddress().toString()
+             << "dropped" << dropped << "queued bytes";
+    needsResync = true;
+
+    if (outbox.bytes() > SendQueue::kMaxQueuedBytes) {
+        qWarning() << "PeerSession: peer cannot keep up with non-droppable traffic, disconnecting";
+        tcpSocket->abort();
+    }
+}
+
+void PeerSession::resume()
+{
+    suspended = false;
+    while (!deferred.isEmpty() && !suspended)
+        emit messageReceived(this, deferred.takeFirst());
+    readData();
+}
+
+void PeerSession::readData()
+{
+    do {
+        if (suspended) return;
+
+        FrameDecoder::Frame frame;
+        FrameDecoder::Status status;
+        while ((status = decoder.next(&frame)) == FrameDecoder::Status::Ready) {
+            Protocol::Message message;
+            {
+                Metrics::ScopedTimer timer(Metrics::Timing::Decode);
+                if (!FrameDecoder::decode(frame, &message)) continue;
+            }
+            Metrics::count(Metrics::Direction::In, message.type,
+                           frame.size + (frame.mode == FrameDecoder::Mode::Binary ? Protocol::kFrameHeaderSize : 1));
+
+            if (message.type == Protocol::MessageType::Binary) {
+                decoder.setMode(FrameDecoder::Mode::Binary);
+                if (!isBinary()) {
+                    const int version = qMax(Protocol::commonVersion(message.text), Protocol::kMinBinaryVersion);
+                    flushOutbox();
+                    send(Protocol::makeText(Protocol::MessageType::Binary, QString::number(version)));
+                    wireVersion = version;
+                }
+            } else if (message.type != Protocol::MessageType::Proto) {
+                emit messageReceived(this, message);
+                if (suspended) return;
+            }
+        }
+
+        if (status == FrameDecoder::Status::Error) {
+            qWarning() << "PeerSession: dropping peer:" << decoder.errorString();
+            tcpSocket->abort();
+            return;
+        }
+    } while (tcpSocket->bytesAvailable() > 0 && decoder.readFrom(tcpSocket) > 0);
+}
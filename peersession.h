@@ -0,0 +1,69 @@
+#ifndef PEERSESSION_H
+#define PEERSESSION_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include "framedecoder.h"
+#include "sendqueue.h"
+
+class QTcpSocket;
+
+// One connected client on the server side: owns the socket, its receive
+// decoder and a prioritized outgoing queue (see SendQueue) that is written
+// out as the socket's buffer drains; a peer that falls more than
+// SendQueue::kMaxQueuedBytes behind loses its queued strokes and is flagged
+// for a snapshot resync once the queue drains.
+class PeerSession : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PeerSession(QTcpSocket *socket, QObject *parent = nullptr);
+
+    // Text below Protocol::kMinBinaryVersion, frames of that version above.
+    static QByteArray encode(const Protocol::Message &message, int version);
+
+    QTcpSocket *socket() const { return tcpSocket; }
+    int version() const { return wireVersion; }
+    bool isBinary() const { return wireVersion >= Protocol::kMinBinaryVersion; }
+    bool readsStrokeIds() const { return wireVersion >= Protocol::kStrokeIdVersion; }
+    bool isReceivingBulk() const { return decoder.isAssembling(); }
+    bool isSpectator() const { return spectator; }
+    void setSpectator(bool watching) { spectator = watching; }
+    qint64 queuedBytes() const { return outbox.bytes(); }
+
+    void send(const Protocol::Message &message);
+    void sendEncoded(const QByteArray &frame, Protocol::MessageType type, bool droppable = false);
+
+    // Used while handing a session over to another thread: suspend() stops
+    // delivery after the current message, pushBack() re-queues a message that
+    // was already delivered, and resume() replays those and continues reading.
+    void suspend() { suspended = true; }
+    void pushBack(const Protocol::Message &message) { deferred.append(message); }
+    void resume();
+
+signals:
+    void messageReceived(PeerSession *session, const Protocol::Message &message);
+    void resyncNeeded(PeerSession *session);
+    void closed(PeerSession *session);
+
+private slots:
+    void readData();
+    void drain();
+
+private:
+    void dropBacklog();
+    void flushOutbox();
+
+    static QAtomicInteger<quint32> sequenceCounter;
+
+    QTcpSocket *tcpSocket;
+    FrameDecoder decoder;
+    int wireVersion;            // what the session sends, Protocol::kTextVersion until BINARY
+    SendQueue outbox;
+    bool needsResync;
+    bool suspended;
+    bool spectator;
+    QList<Protocol::Message> deferred;
+};
+
+#endif // PEERSESSION_H
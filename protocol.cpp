@@ -0,0 +1,521 @@
+#include "protocol.h"
+#include <QtEndian>
+#include <QDebug>
+
+namespace Protocol {
+
+namespace {
+
+struct CommandName {
+    MessageType type;
+    const char *name;
+};
+
+const CommandName kCommandNames[] = {
+    { MessageType::Draw, "DRAW" },
+    { MessageType::Params, "PARAMS" },
+    { MessageType::Clear, "CLEAR" },
+    { MessageType::Word, "WORD" },
+    { MessageType::Role, "ROLE" },
+    { MessageType::Chat, "CHAT" },
+    { MessageType::Win, "WIN" },
+    { MessageType::Image, "IMAGE" },
+    { MessageType::RequestImage, "REQUEST_IMAGE" },
+    { MessageType::Proto, "PROTO" },
+    { MessageType::Binary, "BINARY" },
+    { MessageType::Stroke, "STROKE" },
+    { MessageType::Join, "JOIN" },
+    { MessageType::Time, "TIME" },
+    { MessageType::StrokeLog, "STROKE_LOG" },
+    { MessageType::TileHashes, "TILE_HASHES" },
+    { MessageType::RequestTiles, "REQUEST_TILES" },
+    { MessageType::Tiles, "TILES" },
+    { MessageType::Udp, "UDP" },
+    { MessageType::Part, "PART" },
+    { MessageType::Watch, "WATCH" },
+    { MessageType::Undo, "UNDO" },
+    { MessageType::Close, "CLOSE" }
+};
+
+void writeHeader(char *out, MessageType type, int length, quint32 sequence)
+{
+    uchar *header = reinterpret_cast<uchar *>(out);
+    header[0] = uchar(type);
+    header[1] = uchar(length);
+    header[2] = uchar(length >> 8);
+    header[3] = uchar(length >> 16);
+    qToLittleEndian<quint32>(sequence, header + 4);
+}
+
+const char *commandName(MessageType type)
+{
+    for (const CommandName &command : kCommandNames) {
+        if (command.type == type)
+            return command.name;
+    }
+    return nullptr;
+}
+
+MessageType commandType(const char *data, int size)
+{
+    for (const CommandName &command : kCommandNames) {
+        if (qstrlen(command.name) == uint(size) && qstrncmp(command.name, data, size) == 0)
+            return command.type;
+    }
+    return MessageType::Invalid;
+}
+
+void appendTextPen(QByteArray &out, const PenParams &pen)
+{
+    out += QByteArray::number(pen.color.red()) + ','
+           + QByteArray::number(pen.color.green()) + ','
+           + QByteArray::number(pen.color.blue()) + ','
+           + (pen.eraser ? '1' : '0');
+    if (pen.width >= 0)
+        out += ',' + QByteArray::number(pen.width);
+}
+
+bool parseTextPen(const QList<QByteArray> &params, PenParams *pen)
+{
+    if (params.size() < 4)
+        return false;
+    pen->color = QColor(params[0].toInt(), params[1].toInt(), params[2].toInt());
+    pen->eraser = params[3].toInt();
+    pen->width = params.size() > 4 ? params[4].toInt() : -1;
+    return true;
+}
+
+}
+
+void writeVarint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+void writeSigned(QByteArray &out, qint32 value)
+{
+    writeVarint(out, (quint32(value) << 1) ^ quint32(value >> 31));
+}
+
+void writePen(QByteArray &out, const PenParams &pen, int version)
+{
+    const bool withStrokeId = pen.strokeId && version >= kStrokeIdVersion;
+    out.append(char(pen.color.red()));
+    out.append(char(pen.color.green()));
+    out.append(char(pen.color.blue()));
+    quint8 flags = (pen.eraser ? 0x01 : 0) | (pen.width >= 0 ? 0x02 : 0) | (withStrokeId ? 0x04 : 0);
+    out.append(char(flags));
+    if (pen.width >= 0)
+        writeVarint(out, quint32(pen.width));
+    if (withStrokeId)
+        writeVarint(out, pen.strokeId);
+}
+
+bool Reader::readByte(quint8 *value)
+{
+    if (pos >= size)
+        return false;
+    *value = quint8(data[pos++]);
+    return true;
+}
+
+bool Reader::readVarint(quint32 *value)
+{
+    quint32 result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        quint8 byte;
+        if (!readByte(&byte))
+            return false;
+        result |= quint32(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Reader::readSigned(qint32 *value)
+{
+    quint32 raw;
+    if (!readVarint(&raw))
+        return false;
+    *value = qint32(raw >> 1) ^ -qint32(raw & 1);
+    return true;
+}
+
+bool Reader::skip(int bytes)
+{
+    if (bytes < 0 || bytes > size - pos)
+        return false;
+    pos += bytes;
+    return true;
+}
+
+bool Reader::readPen(PenParams *pen)
+{
+    quint8 r, g, b, flags;
+    if (!readByte(&r) || !readByte(&g) || !readByte(&b) || !readByte(&flags))
+        return false;
+    pen->color = QColor(r, g, b);
+    pen->eraser = flags & 0x01;
+    pen->width = -1;
+    if (flags & 0x02) {
+        quint32 width;
+        if (!readVarint(&width))
+            return false;
+        pen->width = int(width);
+    }
+    pen->strokeId = 0;
+    if (flags & 0x04)
+        return readVarint(&pen->strokeId);
+    return true;
+}
+
+const char *typeName(MessageType type)
+{
+    const char *name = commandName(type);
+    return name ? name : "?";
+}
+
+Message makeText(MessageType type, const QString &text)
+{
+    Message message;
+    message.type = type;
+    message.text = text;
+    return message;
+}
+
+Message makeDraw(const DrawSegment &segment)
+{
+    Message message;
+    message.type = MessageType::Draw;
+    message.segment = segment;
+    return message;
+}
+
+Message makeParams(const PenParams &pen)
+{
+    Message message;
+    message.type = MessageType::Params;
+    message.pen = pen;
+    return message;
+}
+
+Message makeImage(const QByteArray &png)
+{
+    Message message;
+    message.type = MessageType::Image;
+    message.image = png;
+    return message;
+}
+
+Message makeStroke(const Stroke &stroke)
+{
+    Message message;
+    message.type = MessageType::Stroke;
+    message.stroke = stroke;
+    return message;
+}
+
+Message makeStrokeLog(const QByteArray &log)
+{
+    Message message;
+    message.type = MessageType::StrokeLog;
+    message.strokeLog = log;
+    return message;
+}
+
+Message makeTiles(MessageType type, const QByteArray &data)
+{
+    Message message;
+    message.type = type;
+    message.tiles = data;
+    return message;
+}
+
+QByteArray encodeText(const Message &message)
+{
+    const char *name = commandName(message.type);
+    if (!name)
+        return QByteArray();
+
+    QByteArray out(name);
+    out += ':';
+    switch (message.type) {
+    case MessageType::Draw: {
+        const DrawSegment &segment = message.segment;
+        out += QByteArray::number(segment.from.x()) + ',' + QByteArray::number(segment.from.y()) + ';'
+               + QByteArray::number(segment.to.x()) + ',' + QByteArray::number(segment.to.y()) + ';';
+        appendTextPen(out, segment.pen);
+        break;
+    }
+    case MessageType::Params:
+        appendTextPen(out, message.pen);
+        break;
+    case MessageType::Stroke:
+        appendTextPen(out, message.stroke.pen);
+        for (const QPoint &point : message.stroke.points)
+            out += ';' + QByteArray::number(point.x()) + ',' + QByteArray::number(point.y());
+        break;
+    case MessageType::Image:
+        out += message.image.toBase64();
+        break;
+    case MessageType::StrokeLog:
+        out += message.strokeLog.toBase64();
+        break;
+    case MessageType::TileHashes:
+    case MessageType::RequestTiles:
+    case MessageType::Tiles:
+        out += message.tiles.toBase64();
+        break;
+    default:
+        out += message.text.toUtf8();
+        break;
+    }
+    out += '\n';
+    return out;
+}
+
+bool decodeText(const QByteArray &line, Message *message)
+{
+    int separatorIndex = line.indexOf(':');
+    if (separatorIndex == -1)
+        return false;
+
+    message->type = commandType(line.constData(), separatorIndex);
+    const QByteArray dataPart = line.mid(separatorIndex + 1);
+
+    switch (message->type) {
+    case MessageType::Invalid:
+        return false;
+    case MessageType::Draw: {
+        QList<QByteArray> parts = dataPart.split(';');
+        if (parts.size() < 3)
+            return false;
+        QList<QByteArray> start = parts[0].split(',');
+        QList<QByteArray> end = parts[1].split(',');
+        if (start.size() != 2 || end.size() != 2)
+            return false;
+        message->segment.from = QPoint(start[0].toInt(), start[1].toInt());
+        message->segment.to = QPoint(end[0].toInt(), end[1].toInt());
+        return parseTextPen(parts[2].split(','), &message->segment.pen);
+    }
+    case MessageType::Params:
+        return parseTextPen(dataPart.split(','), &message->pen);
+    case MessageType::Stroke: {
+        QList<QByteArray> parts = dataPart.split(';');
+        if (!parseTextPen(parts[0].split(','), &message->stroke.pen))
+            return false;
+        message->stroke.points.clear();
+        message->stroke.points.reserve(parts.size() - 1);
+        for (int i = 1; i < parts.size(); ++i) {
+            QList<QByteArray> point = parts[i].split(',');
+            if (point.size() != 2)
+                return false;
+            message->stroke.points.append(QPoint(point[0].toInt(), point[1].toInt()));
+        }
+        return true;
+    }
+    case MessageType::Image:
+        message->image = QByteArray::fromBase64(dataPart);
+        return true;
+    case MessageType::StrokeLog:
+        message->strokeLog = QByteArray::fromBase64(dataPart);
+        return true;
+    case MessageType::TileHashes:
+    case MessageType::RequestTiles:
+    case MessageType::Tiles:
+        message->tiles = QByteArray::fromBase64(dataPart);
+        return true;
+    default:
+        message->text = QString::fromUtf8(dataPart);
+        return true;
+    }
+}
+
+int commonVersion(const QString &announced)
+{
+    return qMin(announced.toInt(), kBinaryVersion);
+}
+
+QByteArray encodeFrame(const Message &message, quint32 sequence, int version)
+{
+    QByteArray out(kFrameHeaderSize, Qt::Uninitialized);
+
+    switch (message.type) {
+    case MessageType::Invalid:
+        return QByteArray();
+    case MessageType::Draw: {
+        const DrawSegment &segment = message.segment;
+        writeSigned(out, segment.from.x());
+        writeSigned(out, segment.from.y());
+        writeSigned(out, segment.to.x() - segment.from.x());
+        writeSigned(out, segment.to.y() - segment.from.y());
+        writePen(out, segment.pen, version);
+        break;
+    }
+    case MessageType::Params:
+        writePen(out, message.pen, version);
+        break;
+    case MessageType::Stroke: {
+        const QVector<QPoint> &points = message.stroke.points;
+        writePen(out, message.stroke.pen, version);
+        writeVarint(out, quint32(points.size()));
+        QPoint previous;
+        for (const QPoint &point : points) {
+            writeSigned(out, point.x() - previous.x());
+            writeSigned(out, point.y() - previous.y());
+            previous = point;
+        }
+        const QVector<quint32> &times = message.stroke.times;
+        if (!times.isEmpty() && times.size() == points.size()) {
+            writeVarint(out, times.first());
+            for (int i = 1; i < times.size(); ++i)
+                writeVarint(out, times[i] - times[i - 1]);
+        }
+        break;
+    }
+    case MessageType::Image:
+        out += message.image;
+        break;
+    case MessageType::StrokeLog:
+        out += message.strokeLog;
+        break;
+    case MessageType::TileHashes:
+    case MessageType::RequestTiles:
+    case MessageType::Tiles:
+        out += message.tiles;
+        break;
+    default:
+        out += message.text.toUtf8();
+        break;
+    }
+
+    const int length = out.size() - kFrameHeaderSize;
+    if (length > kMaxPayloadSize) {
+        qWarning() << "Protocol: payload too large for a frame:" << length;
+        return QByteArray();
+    }
+
+    writeHeader(out.data(), message.type, length, sequence);
+    return out;
+}
+
+QByteArray encodePart(quint32 transfer, bool last, const char *data, int size, quint32 sequence)
+{
+    QByteArray out(kFrameHeaderSize, Qt::Uninitialized);
+    writeVarint(out, transfer);
+    out += char(last ? kPartLast : 0);
+    out.append(data, size);
+    writeHeader(out.data(), MessageType::Part, out.size() - kFrameHeaderSize, sequence);
+    return out;
+}
+
+bool decodePart(const char *data, int size, quint32 *transfer, bool *last, int *offset)
+{
+    Reader reader(data, size);
+    quint8 flags;
+    if (!reader.readVarint(transfer) || !reader.readByte(&flags))
+        return false;
+    *last = flags & kPartLast;
+    *offset = size - reader.remaining();
+    return true;
+}
+
+FrameHeader decodeFrameHeader(const char *data)
+{
+    const uchar *header = reinterpret_cast<const uchar *>(data);
+    FrameHeader result;
+    result.type = MessageType(header[0]);
+    result.length = header[1] | (header[2] << 8) | (header[3] << 16);
+    result.sequence = qFromLittleEndian<quint32>(header + 4);
+    return result;
+}
+
+bool decodeFramePayload(MessageType type, const char *data, int size, Message *message)
+{
+    message->type = type;
+    Reader reader(data, size);
+
+    switch (type) {
+    case MessageType::Draw: {
+        qint32 x, y, dx, dy;
+        if (!reader.readSigned(&x) || !reader.readSigned(&y)
+            || !reader.readSigned(&dx) || !reader.readSigned(&dy))
+            return false;
+        message->segment.from = QPoint(x, y);
+        message->segment.to = QPoint(x + dx, y + dy);
+        return reader.readPen(&message->segment.pen);
+    }
+    case MessageType::Params:
+        return reader.readPen(&message->pen);
+    case MessageType::Stroke: {
+        quint32 count;
+        if (!reader.readPen(&message->stroke.pen) || !reader.readVarint(&count))
+            return false;
+        // every point takes at least two bytes, so a bogus count cannot over-allocate
+        if (count > quint32(size) / 2)
+            return false;
+        QVector<QPoint> &points = message->stroke.points;
+        points.resize(int(count));
+        QPoint previous;
+        for (QPoint &point : points) {
+            qint32 dx, dy;
+            if (!reader.readSigned(&dx) || !reader.readSigned(&dy))
+                return false;
+            point = QPoint(previous.x() + dx, previous.y() + dy);
+            previous = point;
+        }
+        // older peers end the payload here
+        message->stroke.times.clear();
+        if (reader.atEnd() || count == 0)
+            return true;
+        message->stroke.times.resize(int(count));
+        quint32 time = 0;
+        for (quint32 &pointTime : message->stroke.times) {
+            quint32 delta;
+            if (!reader.readVarint(&delta))
+                return false;
+            time += delta;
+            pointTime = time;
+        }
+        return true;
+    }
+    case MessageType::Image:
+        message->image = QByteArray(data, size);
+        return true;
+    case MessageType::StrokeLog:
+        message->strokeLog = QByteArray(data, size);
+        return true;
+    case MessageType::TileHashes:
+    case MessageType::RequestTiles:
+    case MessageType::Tiles:
+        message->tiles = QByteArray(data, size);
+        return true;
+    case MessageType::Clear:
+    case MessageType::RequestImage:
+    case MessageType::Word:
+    case MessageType::Role:
+    case MessageType::Chat:
+    case MessageType::Win:
+    case MessageType::Proto:
+    case MessageType::Binary:
+    case MessageType::Join:
+    case MessageType::Watch:
+    case MessageType::Undo:
+    case MessageType::Close:
+    case MessageType::Time:
+    case MessageType::Udp:
+        message->text = QString::fromUtf8(data, size);
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
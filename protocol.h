@@ -0,0 +1,171 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QColor>
+#include <QPoint>
+#include <QVector>
+
+// Wire format shared by both peers.
+//
+// Version 1 is the original text protocol: "CMD:payload\n" in UTF-8, images
+// as base64 PNG. Version 2 frames every message with a fixed 8-byte header
+//
+//     type:u8 | payload length:u24 LE | sequence:u32 LE
+//
+// followed by a compact binary payload. Peers start in text mode; the server
+// announces "PROTO:<version>" and each side switches its outgoing stream
+// with a "BINARY:<version>" line once it knows the other side understands
+// frames. Both sides then encode at the lower of the two versions.
+//
+// Large binary frames may be cut into PART frames so other traffic can be
+// interleaved with them. A PART payload is
+//
+//     transfer:varint | flags:u8 | slice of the original frame
+//
+// and the slice flagged kPartLast completes it; the receiver reassembles
+// the original frame, header included, before decoding it.
+//
+// Version 3 pens carry the id of the stroke they draw (pen flag 0x04), so
+// UNDO can name a stroke by that id on every peer however its points were
+// split into messages. Version 2 peers get their pens without it. CLEAR
+// names the last stroke id drawn before it, so strokes that overtake it on
+// the UDP channel can be told apart; peers that ignore it lose nothing.
+namespace Protocol {
+
+constexpr int kTextVersion = 1;
+constexpr int kMinBinaryVersion = 2;
+constexpr int kBinaryVersion = 3;
+constexpr int kStrokeIdVersion = 3;
+constexpr int kFrameHeaderSize = 8;
+constexpr int kMaxPayloadSize = 0xFFFFFF;
+constexpr quint8 kPartLast = 0x01;
+
+enum class MessageType : quint8 {
+    Invalid = 0,
+    Draw,
+    Params,
+    Clear,
+    Word,
+    Role,
+    Chat,
+    Win,
+    Image,
+    RequestImage,
+    Proto,
+    Binary,
+    Stroke,
+    Join,
+    Time,
+    StrokeLog,
+    TileHashes,
+    RequestTiles,
+    Tiles,
+    Udp,
+    Part,
+    Watch,
+    Undo,
+    Close
+};
+
+struct PenParams {
+    QColor color = Qt::black;
+    bool eraser = false;
+    int width = -1;     // -1: not transmitted, keep the current width
+    quint32 strokeId = 0;   // 0: not part of an undoable stroke
+
+    bool operator==(const PenParams &other) const
+    {
+        return color == other.color && eraser == other.eraser && width == other.width
+               && strokeId == other.strokeId;
+    }
+    bool operator!=(const PenParams &other) const { return !(*this == other); }
+};
+
+struct DrawSegment {
+    QPoint from;
+    QPoint to;
+    PenParams pen;
+};
+
+// A polyline drawn with one pen: points[i - 1] -> points[i] are the segments.
+// times, when present, holds the drawer's clock in ms for every point; it is
+// a trailing block in binary frames and is not sent in text mode.
+struct Stroke {
+    PenParams pen;
+    QVector<QPoint> points;
+    QVector<quint32> times;
+};
+
+struct Message {
+    MessageType type = MessageType::Invalid;
+    QString text;           // WORD, ROLE, CHAT, WIN, PROTO, BINARY, JOIN, WATCH, TIME, REQUEST_IMAGE, UDP, UNDO, CLOSE, CLEAR
+    DrawSegment segment;    // DRAW
+    PenParams pen;          // PARAMS
+    Stroke stroke;          // STROKE
+    QByteArray image;       // IMAGE, PNG bytes
+    QByteArray strokeLog;   // STROKE_LOG, StrokeLog::encode() bytes
+    QByteArray tiles;       // TILE_HASHES, REQUEST_TILES, TILES, TileSync encoded
+};
+
+struct FrameHeader {
+    MessageType type = MessageType::Invalid;
+    int length = 0;
+    quint32 sequence = 0;
+};
+
+// Compact integer helpers used by the binary payloads: unsigned LEB128
+// varints, zigzag for signed values.
+void writeVarint(QByteArray &out, quint32 value);
+void writeSigned(QByteArray &out, qint32 value);
+void writePen(QByteArray &out, const PenParams &pen, int version = kBinaryVersion);
+
+class Reader
+{
+public:
+    Reader(const char *data, int size) : data(data), size(size), pos(0) {}
+
+    bool atEnd() const { return pos == size; }
+    int remaining() const { return size - pos; }
+
+    bool readByte(quint8 *value);
+    bool readVarint(quint32 *value);
+    bool readSigned(qint32 *value);
+    bool readPen(PenParams *pen);
+    bool skip(int bytes);
+
+private:
+    const char *data;
+    int size;
+    int pos;
+};
+
+// The command name used in text mode, e.g. "STROKE"; "?" for unknown types.
+const char *typeName(MessageType type);
+
+Message makeText(MessageType type, const QString &text = QString());
+Message makeDraw(const DrawSegment &segment);
+Message makeParams(const PenParams &pen);
+Message makeImage(const QByteArray &png);
+Message makeStroke(const Stroke &stroke);
+Message makeStrokeLog(const QByteArray &log);
+Message makeTiles(MessageType type, const QByteArray &data);
+
+QByteArray encodeText(const Message &message);
+bool decodeText(const QByteArray &line, Message *message);
+
+// The binary version to speak with a peer that announced `announced` in
+// PROTO or BINARY; below kMinBinaryVersion the peer only knows text.
+int commonVersion(const QString &announced);
+
+QByteArray encodeFrame(const Message &message, quint32 sequence, int version = kBinaryVersion);
+FrameHeader decodeFrameHeader(const char *data);
+bool decodeFramePayload(MessageType type, const char *data, int size, Message *message);
+
+QByteArray encodePart(quint32 transfer, bool last, const char *data, int size, quint32 sequence);
+bool decodePart(const char *data, int size, quint32 *transfer, bool *last, int *offset);
+
+}
+
+#endif // PROTOCOL_H
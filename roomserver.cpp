@@ -0,0 +1,142 @@
+#include "roomserver.h"
+#include "roomworker.h"
+#include "gameroom.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QDebug>
+
+const QString RoomServer::kDefaultRoom = QStringLiteral("default");
+
+RoomServer::RoomServer(QObject *parent)
+    : QObject(parent),
+      tcpServer(new QTcpServer(this)),
+      workerCount(qMax(1, QThread::idealThreadCount())),
+      udpEnabled(false),
+      wakePending(false)
+{
+    words.setWords(GameRoom::defaultWords());
+    connect(tcpServer, &QTcpServer::newConnection, this, &RoomServer::newConnection);
+}
+
+RoomServer::~RoomServer()
+{
+    tcpServer->close();
+    for (QThread *thread : qAsConst(threads)) {
+        thread->quit();
+        thread->wait();
+    }
+}
+
+void RoomServer::startWorkers(const QHostAddress &address)
+{
+    for (int i = 0; i < workerCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("room-worker-%1").arg(i));
+
+        RoomWorker *worker = new RoomWorker(i, &words, this);
+        if (udpEnabled)
+            worker->enableUdp(address);
+        worker->moveToThread(thread);
+        connect(thread, &QThread::started, worker, &RoomWorker::start);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+
+        threads.append(thread);
+        workers.append(worker);
+        thread->start();
+    }
+}
+
+bool RoomServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!tcpServer->listen(address, port))
+        return false;
+    if (workers.isEmpty())
+        startWorkers(address);
+    return true;
+}
+
+quint16 RoomServer::serverPort() const
+{
+    return tcpServer->serverPort();
+}
+
+QString RoomServer::errorString() const
+{
+    return tcpServer->errorString();
+}
+
+void RoomServer::newConnection()
+{
+    while (QTcpSocket *socket = tcpServer->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        PeerSession *session = new PeerSession(socket, this);
+        connect(session, &PeerSession::messageReceived, this, &RoomServer::onLobbyMessage);
+        connect(session, &PeerSession::closed, this, &RoomServer::onLobbyClosed);
+    }
+}
+
+void RoomServer::onLobbyMessage(PeerSession *session, const Protocol::Message &message)
+{
+    // Stop the session mid-read: whatever else is buffered is handled by the
+    // room once the session has moved to the worker thread.
+    session->suspend();
+    disconnect(session, nullptr, this, nullptr);
+
+    const bool isJoin = (message.type == Protocol::MessageType::Join || message.type == Protocol::MessageType::Watch);
+    const QString room = (isJoin && !message.text.trimmed().isEmpty()) ? message.text.trimmed() : kDefaultRoom;
+    if (!isJoin)
+        session->pushBack(message);
+    session->setSpectator(message.type == Protocol::MessageType::Watch);
+
+    QMetaObject::invokeMethod(this, [this, session, room]() { handOver(session, room); }, Qt::QueuedConnection);
+}
+
+void RoomServer::handOver(PeerSession *session, const QString &room)
+{
+    RoomAssignment &assignment = roomWorkers[room];
+    if (!assignment.worker) {
+        assignment.worker = workers.first();
+        for (RoomWorker *worker : qAsConst(workers)) {
+            if (worker->load() < assignment.worker->load())
+                assignment.worker = worker;
+        }
+    }
+    assignment.assigned++;
+
+    session->setParent(nullptr);
+    session->moveToThread(assignment.worker->thread());
+    assignment.worker->assign(session, room);
+}
+
+void RoomServer::onLobbyClosed(PeerSession *session)
+{
+    session->deleteLater();
+}
+
+void RoomServer::roomClosed(RoomWorker *worker, const QString &room, quint64 adopted)
+{
+    events.push({ worker, room, adopted });
+    if (!wakePending.exchange(true, std::memory_order_acq_rel))
+        QMetaObject::invokeMethod(this, "drainEvents", Qt::QueuedConnection);
+}
+
+void RoomServer::drainEvents()
+{
+    wakePending.exchange(false, std::memory_order_acq_rel);
+
+    RoomEvent event;
+    while (events.pop(&event)) {
+        auto it = roomWorkers.find(event.room);
+        if (it == roomWorkers.end() || it->worker != event.worker)
+            continue;
+
+        // Sessions handed over after the worker closed the room will
+        // recreate it there, so keep the mapping until they are gone too.
+        if (it->assigned <= event.adopted)
+            roomWorkers.erase(it);
+        else
+            it->assigned -= event.adopted;
+    }
+}
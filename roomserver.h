@@ -0,0 +1,81 @@
+#ifndef ROOMSERVER_H
+#define ROOMSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QHostAddress>
+#include <QStringList>
+#include <atomic>
+#include "peersession.h"
+#include "mpscqueue.h"
+#include "worddictionary.h"
+
+class QTcpServer;
+class QThread;
+class RoomWorker;
+
+// Accepts connections and sorts them into rooms. A new session waits in the
+// lobby (the server's own thread) until its first message: JOIN names the
+// room and WATCH joins it as a read-only spectator, anything else (older
+// clients never send JOIN) puts it into the default room. Every room lives
+// on one RoomWorker thread; new rooms go to the least loaded worker and
+// later joiners follow the room. Lobby and
+// workers talk through lock-free queues only. All rooms draw their words
+// from one read-only dictionary owned by the server.
+class RoomServer : public QObject
+{
+    Q_OBJECT
+public:
+    static const QString kDefaultRoom;
+
+    explicit RoomServer(QObject *parent = nullptr);
+    ~RoomServer();
+
+    // All must be called before listen().
+    void setWorkerCount(int count) { workerCount = qMax(1, count); }
+    void setWordList(const QStringList &list) { words.setWords(list); }
+    WordDictionary *dictionary() { return &words; }
+    void setUdpEnabled(bool enabled) { udpEnabled = enabled; }
+
+    bool listen(const QHostAddress &address, quint16 port);
+    quint16 serverPort() const;
+    QString errorString() const;
+    int roomCount() const { return roomWorkers.size(); }
+
+    // Called from worker threads.
+    void roomClosed(RoomWorker *worker, const QString &room, quint64 adopted);
+
+private slots:
+    void newConnection();
+    void onLobbyMessage(PeerSession *session, const Protocol::Message &message);
+    void onLobbyClosed(PeerSession *session);
+    void drainEvents();
+
+private:
+    struct RoomEvent {
+        RoomWorker *worker = nullptr;
+        QString room;
+        quint64 adopted = 0;
+    };
+
+    struct RoomAssignment {
+        RoomWorker *worker = nullptr;
+        quint64 assigned = 0;
+    };
+
+    void startWorkers(const QHostAddress &address);
+    void handOver(PeerSession *session, const QString &room);
+
+    QTcpServer *tcpServer;
+    int workerCount;
+    WordDictionary words;
+    bool udpEnabled;
+    QList<QThread *> threads;
+    QList<RoomWorker *> workers;
+    QHash<QString, RoomAssignment> roomWorkers;
+    MpscQueue<RoomEvent> events;
+    std::atomic<bool> wakePending;
+};
+
+#endif // ROOMSERVER_H
@@ -0,0 +1,152 @@
+#include "roomworker.h"
+#include "metrics.h"
+#include "roomserver.h"
+#include "udprelay.h"
+#include <QTimer>
+#include <QTcpSocket>
+#include <QDebug>
+
+RoomWorker::RoomWorker(int id, const WordDictionary *words, RoomServer *server)
+    : workerId(id),
+      words(words),
+      server(server),
+      statsTimer(new QTimer(this)),
+      udpRelay(nullptr),
+      wakePending(false),
+      sessionLoad(0)
+{
+    statsTimer->setInterval(1000);
+    connect(statsTimer, &QTimer::timeout, this, &RoomWorker::reportStats);
+}
+
+void RoomWorker::start()
+{
+    statsTimer->start();
+
+    if (udpAddress.isNull())
+        return;
+    udpRelay = new UdpRelay(this);
+    if (!udpRelay->bind(udpAddress)) {
+        qWarning() << "worker" << workerId << ": cannot bind UDP relay, strokes stay on TCP";
+        delete udpRelay;
+        udpRelay = nullptr;
+        return;
+    }
+    connect(udpRelay, &UdpRelay::messageReceived, this, &RoomWorker::onUdpMessage);
+    connect(udpRelay, &UdpRelay::strokesLost, this, &RoomWorker::onUdpLoss);
+    qDebug() << "worker" << workerId << ": UDP relay on port" << udpRelay->port();
+}
+
+void RoomWorker::assign(PeerSession *session, const QString &room)
+{
+    sessionLoad.fetch_add(1, std::memory_order_relaxed);
+    inbox.push({ session, room });
+    if (!wakePending.exchange(true, std::memory_order_acq_rel))
+        QMetaObject::invokeMethod(this, "drainInbox", Qt::QueuedConnection);
+}
+
+void RoomWorker::drainInbox()
+{
+    wakePending.exchange(false, std::memory_order_acq_rel);
+
+    Assignment assignment;
+    while (inbox.pop(&assignment)) {
+        PeerSession *session = assignment.session;
+        session->setParent(this);
+        connect(session, &PeerSession::closed, this, &RoomWorker::onClosed);
+
+        GameRoom *&room = rooms[assignment.room];
+        if (!room) {
+            room = new GameRoom(assignment.room, words, this);
+            room->setUdpRelay(udpRelay);
+        }
+        adopted[assignment.room]++;
+        sessionRooms.insert(session, room);
+        room->addSession(session);
+        session->resume();
+
+        // The peer may have hung up while it waited in the lobby.
+        if (sessionRooms.contains(session) && session->socket()->state() == QAbstractSocket::UnconnectedState)
+            onClosed(session);
+    }
+}
+
+void RoomWorker::onClosed(PeerSession *session)
+{
+    GameRoom *room = sessionRooms.take(session);
+    session->deleteLater();
+    sessionLoad.fetch_sub(1, std::memory_order_relaxed);
+    if (!room)
+        return;
+
+    room->removeSession(session);
+    if (room->sessionCount() == 0) {
+        const QString name = room->name();
+        rooms.remove(name);
+        room->deleteLater();
+        server->roomClosed(this, name, adopted.take(name));
+    }
+}
+
+void RoomWorker::onUdpMessage(PeerSession *session, const Protocol::Message &message)
+{
+    GameRoom *room = sessionRooms.value(session);
+    if (room)
+        room->handleMessage(session, message);
+}
+
+void RoomWorker::onUdpLoss(PeerSession *session)
+{
+    GameRoom *room = sessionRooms.value(session);
+    if (room)
+        room->onStrokesLost(session);
+}
+
+void RoomWorker::reportStats()
+{
+    GameRoom::Stats total;
+    qint64 maxQueued = 0;
+    for (GameRoom *room : qAsConst(rooms)) {
+        GameRoom::Stats stats = room->takeStats();
+        total.broadcasts += stats.broadcasts;
+        total.fanoutFrames += stats.fanoutFrames;
+        total.fanoutNsecs += stats.fanoutNsecs;
+        total.maxFanoutNsecs = qMax(total.maxFanoutNsecs, stats.maxFanoutNsecs);
+        total.catchUps += stats.catchUps;
+        total.catchUpBytes += stats.catchUpBytes;
+        total.keyframes += stats.keyframes;
+        total.guesses += stats.guesses;
+        total.closeGuesses += stats.closeGuesses;
+        total.guessNsecs += stats.guessNsecs;
+        maxQueued = qMax(maxQueued, room->maxQueuedBytes());
+    }
+    if (total.broadcasts == 0) return;
+
+    qCDebug(lcStats).noquote() << QString("worker %1: %2 rooms, %3 sessions, %4 broadcasts/s, %5 frames/s, "
+                                          "fan-out avg %6 us, max %7 us, max queued %8 B")
+                                      .arg(workerId)
+                                      .arg(rooms.size())
+                                      .arg(sessionRooms.size())
+                                      .arg(total.broadcasts)
+                                      .arg(total.fanoutFrames)
+                                      .arg(total.fanoutNsecs / qint64(total.broadcasts) / 1000)
+                                      .arg(total.maxFanoutNsecs / 1000)
+                                      .arg(maxQueued);
+
+    if (total.catchUps > 0 || total.keyframes > 0) {
+        qCDebug(lcStats).noquote() << QString("worker %1 spectators: %2 catch-ups, %3 B, %4 keyframes")
+                                          .arg(workerId).arg(total.catchUps).arg(total.catchUpBytes).arg(total.keyframes);
+    }
+
+    if (total.guesses > 0) {
+        qCDebug(lcStats).noquote() << QString("worker %1 guesses: %2/s, %3 close, check avg %4 us")
+                                          .arg(workerId).arg(total.guesses).arg(total.closeGuesses)
+                                          .arg(total.guessNsecs / 1000.0 / total.guesses, 0, 'f', 2);
+    }
+
+    if (udpRelay) {
+        const UdpRelay::Stats udp = udpRelay->takeStats();
+        qCDebug(lcStats).noquote() << QString("worker %1 udp: %2 in/s, %3 out/s, %4 lost, %5 stale")
+                                          .arg(workerId).arg(udp.received).arg(udp.sent).arg(udp.lost).arg(udp.stale);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef ROOMWORKER_H
+#define ROOMWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QHostAddress>
+#include <atomic>
+#include "gameroom.h"
+#include "mpscqueue.h"
+
+class QTimer;
+class RoomServer;
+class UdpRelay;
+
+// Runs a share of the server's rooms on one thread. The lobby hands over
+// sessions through a lock-free inbox; the worker adopts each socket into
+// its thread, creates rooms on demand and reports rooms it closes back to
+// the lobby through the server's own queue. With UDP enabled the worker also
+// runs the relay its rooms use for live strokes.
+class RoomWorker : public QObject
+{
+    Q_OBJECT
+public:
+    RoomWorker(int id, const WordDictionary *words, RoomServer *server);
+
+    // Called before the worker's thread starts.
+    void enableUdp(const QHostAddress &address) { udpAddress = address; }
+
+    int load() const { return sessionLoad.load(std::memory_order_relaxed); }
+
+    // Called from the lobby thread; the session must already live in this
+    // worker's thread.
+    void assign(PeerSession *session, const QString &room);
+
+public slots:
+    void start();
+
+private slots:
+    void drainInbox();
+    void onClosed(PeerSession *session);
+    void onUdpMessage(PeerSession *session, const Protocol::Message &message);
+    void onUdpLoss(PeerSession *session);
+    void reportStats();
+
+private:
+    struct Assignment {
+        PeerSession *session = nullptr;
+        QString room;
+    };
+
+    int workerId;
+    const WordDictionary *words;
+    RoomServer *server;
+    QTimer *statsTimer;
+    QHostAddress udpAddress;
+    UdpRelay *udpRelay;
+    MpscQueue<Assignment> inbox;
+    std::atomic<bool> wakePending;
+    std::atomic<int> sessionLoad;
+    QHash<QString, GameRoom *> rooms;
+    QHash<PeerSession *, GameRoom *> sessionRooms;
+    QHash<QString, quint64> adopted;
+};
+
+#endif // ROOMWORKER_H
@@ -0,0 +1,112 @@
+#include "sendqueue.h"
+
+SendQueue::SendQueue()
+    : queuedBytes(0),
+      lastTransfer(0)
+{
+}
+
+SendQueue::Priority SendQueue::priorityOf(Protocol::MessageType type)
+{
+    switch (type) {
+    case Protocol::MessageType::Draw:
+    case Protocol::MessageType::Stroke:
+    case Protocol::MessageType::Params:
+    case Protocol::MessageType::Clear:
+    case Protocol::MessageType::Undo:
+    case Protocol::MessageType::Role:
+    case Protocol::MessageType::Word:
+    case Protocol::MessageType::Time:
+    case Protocol::MessageType::Win:
+        return Priority::Stroke;
+    case Protocol::MessageType::Chat:
+    case Protocol::MessageType::Close:
+        return Priority::Chat;
+    case Protocol::MessageType::Image:
+    case Protocol::MessageType::StrokeLog:
+    case Protocol::MessageType::TileHashes:
+    case Protocol::MessageType::Tiles:
+        return Priority::Bulk;
+    default:
+        return Priority::Control;
+    }
+}
+
+void SendQueue::enqueue(const QByteArray &frame, Priority priority, bool droppable, bool splittable)
+{
+    if (frame.isEmpty())
+        return;
+
+    Entry entry;
+    entry.frame = frame;
+    entry.droppable = droppable;
+    if (priority == Priority::Bulk) {
+        if (splittable && frame.size() > kChunkSize) {
+            if (++lastTransfer == 0)
+                ++lastTransfer;
+            entry.transfer = lastTransfer;
+        }
+        priority = Priority::Stroke;
+    }
+    queues[int(priority)].enqueue(entry);
+    queuedBytes += frame.size();
+}
+
+bool SendQueue::takeNext(qint64 backlog, QByteArray *frame)
+{
+    for (int priority = 0; priority < kPriorities; ++priority) {
+        QQueue<Entry> &queue = queues[priority];
+        if (queue.isEmpty())
+            continue;
+
+        const bool bulk = (priority == int(Priority::Bulk));
+        if (backlog >= (bulk ? kBulkWatermark : kHighWatermark))
+            return false;
+
+        Entry &entry = queue.head();
+        if (entry.transfer == 0) {
+            *frame = queue.dequeue().frame;
+            queuedBytes -= frame->size();
+            return true;
+        }
+
+        const quint32 sequence = Protocol::decodeFrameHeader(entry.frame.constData()).sequence;
+        const int size = qMin(kChunkSize, entry.frame.size() - entry.offset);
+        const bool last = (entry.offset + size == entry.frame.size());
+        *frame = Protocol::encodePart(entry.transfer, last, entry.frame.constData() + entry.offset, size, sequence);
+        entry.offset += size;
+        queuedBytes -= size;
+
+        // After its first chunk a transfer continues in the bulk class.
+        if (last)
+            queue.dequeue();
+        else if (!bulk)
+            queues[int(Priority::Bulk)].enqueue(queue.dequeue());
+        return true;
+    }
+    return false;
+}
+
+qint64 SendQueue::dropDroppable()
+{
+    qint64 dropped = 0;
+    for (QQueue<Entry> &queue : queues) {
+        QQueue<Entry> kept;
+        for (const Entry &entry : queue) {
+            if (entry.droppable)
+                dropped += entry.frame.size() - entry.offset;
+            else
+                kept.enqueue(entry);
+        }
+        queue.swap(kept);
+    }
+    queuedBytes -= dropped;
+    return dropped;
+}
+
+void SendQueue::clear()
+{
+    for (QQueue<Entry> &queue : queues)
+        queue.clear();
+    queuedBytes = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QByteArray>
+#include <QQueue>
+#include "protocol.h"
+
+// Outgoing frames of one connection, sorted into priority classes. The
+// owner writes whatever takeNext() hands out while the socket's own buffer
+// is short, so a snapshot queued before a burst of strokes no longer holds
+// them back.
+//
+// Messages whose order matters for the canvas (strokes, CLEAR, PARAMS and
+// the round state, since a new role resets the canvas) share the Stroke
+// class and stay in order. Bulk frames too large for one chunk are cut into
+// PART frames: the first one keeps its place among the strokes, so the
+// receiver can tell that whatever arrives beside the remaining chunks is
+// newer than the snapshot; the rest only goes out when nothing else is
+// waiting. Bulk frames that cannot be cut (text mode, or small ones) take
+// their place among the strokes whole.
+class SendQueue
+{
+public:
+    enum class Priority { Control, Stroke, Chat, Bulk };
+
+    static constexpr int kPriorities = 4;
+    static constexpr int kChunkSize = 16 * 1024;
+    static constexpr qint64 kHighWatermark = 256 * 1024;
+    static constexpr qint64 kBulkWatermark = 2 * kChunkSize;
+    static constexpr qint64 kMaxQueuedBytes = 4 * 1024 * 1024;
+
+    SendQueue();
+
+    static Priority priorityOf(Protocol::MessageType type);
+
+    bool isEmpty() const { return queuedBytes == 0; }
+    qint64 bytes() const { return queuedBytes; }
+
+    // splittable: the frame is a binary frame and may be sent as PART frames.
+    void enqueue(const QByteArray &frame, Priority priority, bool droppable, bool splittable);
+
+    // The next frame to write given the bytes the socket still holds, or
+    // false if nothing may go out yet.
+    bool takeNext(qint64 backlog, QByteArray *frame);
+
+    // Drops every droppable frame and returns how many bytes that freed.
+    qint64 dropDroppable();
+    void clear();
+
+private:
+    struct Entry {
+        QByteArray frame;
+        bool droppable = false;
+        quint32 transfer = 0;   // non-zero: sent as PART frames
+        int offset = 0;
+    };
+
+    QQueue<Entry> queues[kPriorities];
+    qint64 queuedBytes;
+    quint32 lastTransfer;
+};
+
+#endif // SENDQUEUE_H
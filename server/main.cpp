@@ -0,0 +1,95 @@
+#include "roomserver.h"
+#include "metricsexporter.h"
+#include "worddictionary.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("drawgame-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless room server for the drawing game.");
+    parser.addHelpOption();
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                  "TCP port to listen on.", "port", "12345");
+    QCommandLineOption addressOption(QStringList() << "a" << "address",
+                                     "Address to bind to (all interfaces by default).", "address");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+                                     "Number of room worker threads (one per core by default).", "count");
+    QCommandLineOption udpOption("udp", "Offer clients a UDP channel for live strokes.");
+    parser.addOption(portOption);
+    parser.addOption(addressOption);
+    parser.addOption(threadsOption);
+    QCommandLineOption metricsFileOption("metrics-file", "Rewrite this file with metrics as JSON every second.",
+                                         "file");
+    QCommandLineOption metricsPortOption("metrics-port", "Serve metrics as JSON over HTTP on localhost.", "port");
+    QCommandLineOption wordsOption(QStringList() << "w" << "words",
+                                   "Compiled word dictionary shared by all rooms.", "file");
+    QCommandLineOption compileOption("compile-words", "Compile a word list (word[<tab>category[<tab>difficulty]] "
+                                                      "per line) into the --words file and exit.", "source");
+    QCommandLineOption traceOption("trace", "Write a Chrome trace of encode, decode and send times.", "file");
+    parser.addOption(udpOption);
+    parser.addOption(metricsFileOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(traceOption);
+    parser.addOption(wordsOption);
+    parser.addOption(compileOption);
+    parser.process(a);
+
+    if (parser.isSet(compileOption)) {
+        QString error;
+        if (!parser.isSet(wordsOption)) {
+            qCritical().noquote() << "--compile-words needs --words for the output file";
+            return 1;
+        }
+        if (!WordDictionary::compile(parser.value(compileOption), parser.value(wordsOption), &error)) {
+            qCritical().noquote() << "Cannot compile" << parser.value(compileOption) << ":" << error;
+            return 1;
+        }
+        return 0;
+    }
+
+    QHostAddress address = parser.isSet(addressOption) ? QHostAddress(parser.value(addressOption))
+                                                       : QHostAddress(QHostAddress::Any);
+    quint16 port = quint16(parser.value(portOption).toUInt());
+
+    MetricsExporter metrics;
+    metrics.configureFromEnvironment();
+    if (parser.isSet(metricsFileOption))
+        metrics.setDumpFile(parser.value(metricsFileOption));
+    if (parser.isSet(metricsPortOption) && !metrics.listen(quint16(parser.value(metricsPortOption).toUInt()))) {
+        qCritical().noquote() << "Cannot serve metrics:" << metrics.errorString();
+        return 1;
+    }
+    if (parser.isSet(traceOption) && !metrics.setTraceFile(parser.value(traceOption))) {
+        qCritical().noquote() << "Cannot write trace:" << metrics.errorString();
+        return 1;
+    }
+
+    RoomServer server;
+    if (parser.isSet(wordsOption)) {
+        WordDictionary *dictionary = server.dictionary();
+        if (!dictionary->open(parser.value(wordsOption))) {
+            qCritical().noquote() << "Cannot read" << parser.value(wordsOption) << ":" << dictionary->errorString();
+            return 1;
+        }
+        if (dictionary->count() == 0) {
+            qCritical().noquote() << "No words in" << parser.value(wordsOption);
+            return 1;
+        }
+        qInfo().noquote() << "Words:" << dictionary->count() << "in" << dictionary->categoryCount() << "categories";
+    }
+    if (parser.isSet(threadsOption))
+        server.setWorkerCount(parser.value(threadsOption).toInt());
+    server.setUdpEnabled(parser.isSet(udpOption));
+    if (!server.listen(address, port)) {
+        qCritical().noquote() << "Cannot listen on" << address.toString() << port << ":" << server.errorString();
+        return 1;
+    }
+    qInfo().noquote() << "Listening on" << address.toString() << server.serverPort();
+
+    return a.exec();
+}
@@ -0,0 +1,18 @@
+# Headless room server: QCoreApplication only, no widgets and no display
+# connection. QtGui is linked for QColor/QImage, which work without a
+# QGuiApplication.
+QT = core gui network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = drawgame-server
+
+include(../shared.pri)
+
+SOURCES += \
+    main.cpp
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,91 @@
+#include "sessionlog.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace SessionLog {
+
+bool Record::decode(Protocol::Message *message) const
+{
+    return Protocol::decodeFramePayload(type, payload, size, message);
+}
+
+bool Recorder::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    written = file.write(kMagic, sizeof(kMagic));
+    clock.start();
+    return true;
+}
+
+void Recorder::record(Direction direction, const Protocol::Message &message)
+{
+    if (!file.isOpen())
+        return;
+
+    const QByteArray frame = Protocol::encodeFrame(message, 0);
+    if (frame.isEmpty())
+        return;
+
+    char header[kRecordHeaderSize];
+    qToLittleEndian<quint64>(quint64(clock.nsecsElapsed() / 1000), header);
+    header[8] = char(direction);
+    qToLittleEndian<quint32>(quint32(frame.size()), header + 9);
+    written += file.write(header, sizeof(header));
+    written += file.write(frame);
+}
+
+Reader::~Reader()
+{
+    if (map)
+        file.unmap(map);
+}
+
+bool Reader::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(kMagic))) {
+        error = "not a session recording";
+        return false;
+    }
+    map = file.map(0, size);
+    if (!map) {
+        error = file.errorString();
+        return false;
+    }
+    if (std::memcmp(map, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a session recording";
+        return false;
+    }
+
+    const char *data = reinterpret_cast<const char *>(map);
+    qint64 pos = sizeof(kMagic);
+    while (size - pos >= kRecordHeaderSize) {
+        const quint32 length = qFromLittleEndian<quint32>(data + pos + 9);
+        if (length < quint32(Protocol::kFrameHeaderSize) || size - pos - kRecordHeaderSize < qint64(length))
+            break;
+
+        const char *frame = data + pos + kRecordHeaderSize;
+        const Protocol::FrameHeader header = Protocol::decodeFrameHeader(frame);
+        if (header.length != int(length) - Protocol::kFrameHeaderSize)
+            break;
+
+        Record record;
+        record.usecs = qint64(qFromLittleEndian<quint64>(data + pos));
+        record.direction = Direction(quint8(data[pos + 8]));
+        record.type = header.type;
+        record.payload = frame + Protocol::kFrameHeaderSize;
+        record.size = header.length;
+        records.append(record);
+        pos += kRecordHeaderSize + length;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QVector>
+#include "protocol.h"
+
+// Append-only recording of the messages a client sent and received, for
+// reproducing a game and benchmarking against real traffic:
+//
+//     "DGREC1\n\0" | record*
+//     record: usecs:u64 LE | direction:u8 | length:u32 LE | frame
+//
+// Every message is stored as a protocol v2 frame whatever the wire mode;
+// snapshots keep the bytes they were sent with. The reader maps the file
+// and ignores a record cut short by a crash.
+namespace SessionLog {
+
+constexpr char kMagic[8] = { 'D', 'G', 'R', 'E', 'C', '1', '\n', '\0' };
+constexpr int kRecordHeaderSize = 13;
+
+enum class Direction : quint8 { Out = 0, In = 1 };
+
+struct Record {
+    qint64 usecs = 0;
+    Direction direction = Direction::In;
+    Protocol::MessageType type = Protocol::MessageType::Invalid;
+    const char *payload = nullptr;      // points into the mapping
+    int size = 0;
+
+    bool decode(Protocol::Message *message) const;
+};
+
+class Recorder
+{
+public:
+    bool open(const QString &path);
+    bool isOpen() const { return file.isOpen(); }
+    QString errorString() const { return file.errorString(); }
+    qint64 bytesWritten() const { return written; }
+
+    void record(Direction direction, const Protocol::Message &message);
+    void flush() { file.flush(); }
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+    qint64 written = 0;
+};
+
+class Reader
+{
+public:
+    ~Reader();
+
+    bool open(const QString &path);
+    QString errorString() const { return error; }
+
+    int count() const { return records.size(); }
+    const Record &at(int index) const { return records[index]; }
+    qint64 durationUsecs() const { return records.isEmpty() ? 0 : records.last().usecs; }
+    qint64 mappedBytes() const { return file.size(); }
+
+private:
+    QFile file;
+    uchar *map = nullptr;
+    QVector<Record> records;
+    QString error;
+};
+
+}
+
+#endif // SESSIONLOG_H
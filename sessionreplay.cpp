@@ -0,0 +1,138 @@
+#include "sessionreplay.h"
+#include "drawgame.h"
+#include "snapshotcodec.h"
+#include "tilesync.h"
+
+SessionReplay::SessionReplay(const SessionLog::Reader *log, DrawingArea *area, QObject *parent)
+    : QObject(parent),
+      log(log),
+      area(area),
+      speed(1.0),
+      position(0)
+{
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, this, &SessionReplay::playDue);
+}
+
+void SessionReplay::runFast()
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (; position < log->count(); ++position)
+        apply(log->at(position));
+    flushStrokes();
+    counters.nsecs += elapsed.nsecsElapsed();
+    emit finished();
+}
+
+void SessionReplay::start(double playbackSpeed)
+{
+    speed = playbackSpeed > 0 ? playbackSpeed : 1.0;
+    clock.start();
+    playDue();
+}
+
+void SessionReplay::playDue()
+{
+    const qint64 now = qint64(clock.nsecsElapsed() / 1000 * speed);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (position < log->count() && log->at(position).usecs <= now)
+        apply(log->at(position++));
+    flushStrokes();
+    counters.nsecs += elapsed.nsecsElapsed();
+
+    if (position == log->count()) {
+        emit finished();
+        return;
+    }
+    const qint64 wait = qint64((log->at(position).usecs - now) / speed / 1000);
+    timer.start(int(qBound<qint64>(0, wait, 60 * 1000)));
+}
+
+void SessionReplay::apply(const SessionLog::Record &record)
+{
+    counters.messages++;
+
+    Protocol::Message message;
+    switch (record.type) {
+    case Protocol::MessageType::Draw:
+    case Protocol::MessageType::Stroke:
+    case Protocol::MessageType::Clear:
+    case Protocol::MessageType::Image:
+    case Protocol::MessageType::StrokeLog:
+    case Protocol::MessageType::Tiles:
+    case Protocol::MessageType::Undo:
+        if (!record.decode(&message))
+            return;
+        break;
+    default:
+        return;
+    }
+    counters.canvasMessages++;
+
+    switch (message.type) {
+    case Protocol::MessageType::Draw:
+        DrawingArea::appendSegment(&pending, message.segment);
+        counters.segments++;
+        return;
+    case Protocol::MessageType::Stroke:
+        if (message.stroke.points.isEmpty())
+            return;
+        pending.append(message.stroke);
+        counters.segments += message.stroke.points.size() - 1;
+        return;
+    default:
+        break;
+    }
+
+    flushStrokes();
+    switch (message.type) {
+    case Protocol::MessageType::Clear:
+        area->clear();
+        break;
+    case Protocol::MessageType::Undo:
+        area->removeStroke(message.text.toUInt());
+        break;
+    case Protocol::MessageType::Image: {
+        QImage image;
+        if (SnapshotCodec::decode(message.image, &image)) {
+            area->setImage(image);
+            counters.snapshots++;
+        }
+        break;
+    }
+    case Protocol::MessageType::StrokeLog: {
+        StrokeLog strokeLog;
+        if (StrokeLog::decode(message.strokeLog, &strokeLog)) {
+            area->setStrokeLog(strokeLog);
+            counters.snapshots++;
+        }
+        break;
+    }
+    case Protocol::MessageType::Tiles: {
+        TileSync::TileSet set;
+        if (!TileSync::decodeTileSet(message.tiles, &set) || set.tileSize != TileSync::kTileSize)
+            break;
+        area->resizeCanvas(set.size);
+        for (const TileSync::Tile &tile : set.tiles) {
+            QImage image;
+            if (SnapshotCodec::decode(tile.data, &image))
+                area->setTile(tile.index, image, tile.hash);
+        }
+        counters.snapshots++;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void SessionReplay::flushStrokes()
+{
+    if (pending.isEmpty())
+        return;
+    area->applyStrokes(pending);
+    pending.clear();
+}
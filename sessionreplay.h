@@ -0,0 +1,56 @@
+#ifndef SESSIONREPLAY_H
+#define SESSIONREPLAY_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include "sessionlog.h"
+
+class DrawingArea;
+
+// Plays a recording back onto a DrawingArea without a connection. Canvas
+// messages of both directions are applied the way DrawGame applies received
+// ones, strokes batched per burst, so a drawer's and a guesser's recording
+// both rebuild the picture. runFast() replays everything at once for
+// benchmarks; start() follows the recorded timestamps for watching a game
+// again.
+class SessionReplay : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        int messages = 0;
+        int canvasMessages = 0;
+        qint64 segments = 0;
+        int snapshots = 0;
+        qint64 nsecs = 0;       // spent applying messages
+    };
+
+    SessionReplay(const SessionLog::Reader *log, DrawingArea *area, QObject *parent = nullptr);
+
+    void runFast();
+    void start(double speed = 1.0);
+    Stats stats() const { return counters; }
+
+signals:
+    void finished();
+
+private slots:
+    void playDue();
+
+private:
+    void apply(const SessionLog::Record &record);
+    void flushStrokes();
+
+    const SessionLog::Reader *log;
+    DrawingArea *area;
+    QTimer timer;
+    QElapsedTimer clock;
+    double speed;
+    int position;
+    QVector<Protocol::Stroke> pending;
+    Stats counters;
+};
+
+#endif // SESSIONREPLAY_H
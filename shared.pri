@@ -0,0 +1,39 @@
+# Protocol and room server sources shared by the GUI client and the
+# headless server.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/framedecoder.cpp \
+    $$PWD/gameroom.cpp \
+    $$PWD/guessmatcher.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/metricsexporter.cpp \
+    $$PWD/peersession.cpp \
+    $$PWD/protocol.cpp \
+    $$PWD/roomserver.cpp \
+    $$PWD/roomworker.cpp \
+    $$PWD/sendqueue.cpp \
+    $$PWD/snapshotcodec.cpp \
+    $$PWD/tilesync.cpp \
+    $$PWD/udpchannel.cpp \
+    $$PWD/udprelay.cpp \
+    $$PWD/worddictionary.cpp
+
+HEADERS += \
+    $$PWD/framedecoder.h \
+    $$PWD/gameroom.h \
+    $$PWD/guessmatcher.h \
+    $$PWD/metrics.h \
+    $$PWD/metricsexporter.h \
+    $$PWD/mpscqueue.h \
+    $$PWD/peersession.h \
+    $$PWD/protocol.h \
+    $$PWD/roomserver.h \
+    $$PWD/roomworker.h \
+    $$PWD/sendqueue.h \
+    $$PWD/snapshotcodec.h \
+    $$PWD/tilesync.h \
+    $$PWD/udpchannel.h \
+    $$PWD/udprelay.h \
+    $$PWD/worddictionary.h
@@ -0,0 +1,239 @@
+#include "snapshotcodec.h"
+#include <QBuffer>
+#include <QImage>
+#include <QtEndian>
+
+namespace SnapshotCodec {
+
+namespace {
+
+constexpr char kQoiMagic[] = "qoif";
+constexpr char kDeflateMagic[] = "qoiz";
+constexpr int kHeaderSize = 14;
+constexpr int kPaddingSize = 8;
+constexpr int kMaxDimension = 8192;
+// what encodeQoi() can produce at most: four bytes per pixel
+constexpr quint32 kMaxEncodedSize = kHeaderSize + quint32(kMaxDimension) * kMaxDimension * 4 + kPaddingSize;
+
+constexpr quint8 kOpIndex = 0x00;
+constexpr quint8 kOpDiff = 0x40;
+constexpr quint8 kOpLuma = 0x80;
+constexpr quint8 kOpRun = 0xc0;
+constexpr quint8 kOpRgb = 0xfe;
+constexpr quint8 kOpRgba = 0xff;
+constexpr quint8 kMask = 0xc0;
+
+inline int indexOf(QRgb pixel)
+{
+    return (qRed(pixel) * 3 + qGreen(pixel) * 5 + qBlue(pixel) * 7 + qAlpha(pixel) * 11) % 64;
+}
+
+}
+
+Format detect(const QByteArray &data)
+{
+    if (data.startsWith(kQoiMagic))
+        return Format::Qoi;
+    if (data.startsWith(kDeflateMagic))
+        return Format::QoiDeflate;
+    return Format::Png;
+}
+
+Format formatFromName(const QString &name, Format fallback)
+{
+    if (name == QLatin1String("png"))
+        return Format::Png;
+    if (name == QLatin1String("qoi"))
+        return Format::Qoi;
+    if (name == QLatin1String("qoiz"))
+        return Format::QoiDeflate;
+    return fallback;
+}
+
+const char *formatName(Format format)
+{
+    switch (format) {
+    case Format::Qoi:
+        return "qoi";
+    case Format::QoiDeflate:
+        return "qoiz";
+    default:
+        return "png";
+    }
+}
+
+QByteArray encode(const QImage &image, Format format)
+{
+    switch (format) {
+    case Format::Qoi:
+        return encodeQoi(image);
+    case Format::QoiDeflate:
+        return QByteArray(kDeflateMagic, 4) + qCompress(encodeQoi(image), 1);
+    default: {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+        return png;
+    }
+    }
+}
+
+bool decode(const QByteArray &data, QImage *image)
+{
+    switch (detect(data)) {
+    case Format::Qoi:
+        return decodeQoi(data, image);
+    case Format::QoiDeflate:
+        // qUncompress allocates the size the stream claims before inflating
+        if (data.size() < 8 || qFromBigEndian<quint32>(data.constData() + 4) > kMaxEncodedSize)
+            return false;
+        return decodeQoi(qUncompress(data.mid(4)), image);
+    default:
+        return image->loadFromData(data, "PNG");
+    }
+}
+
+QByteArray encodeQoi(const QImage &source)
+{
+    const QImage image = source.format() == QImage::Format_RGB32 ? source
+                                                                  : source.convertToFormat(QImage::Format_RGB32);
+    const int width = image.width();
+    const int height = image.height();
+
+    // worst case is four bytes per pixel (QOI_OP_RGB)
+    QByteArray out(kHeaderSize + width * height * 4 + kPaddingSize, Qt::Uninitialized);
+    uchar *data = reinterpret_cast<uchar *>(out.data());
+    memcpy(data, kQoiMagic, 4);
+    qToBigEndian<quint32>(quint32(width), data + 4);
+    qToBigEndian<quint32>(quint32(height), data + 8);
+    data[12] = 3;   // RGB
+    data[13] = 0;   // sRGB
+    int pos = kHeaderSize;
+
+    QRgb index[64] = {};
+    QRgb previous = qRgba(0, 0, 0, 255);
+    int run = 0;
+
+    for (int y = 0; y < height; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            const QRgb pixel = line[x] | 0xff000000;
+            if (pixel == previous) {
+                if (++run == 62) {
+                    data[pos++] = kOpRun | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                data[pos++] = kOpRun | (run - 1);
+                run = 0;
+            }
+
+            const int slot = indexOf(pixel);
+            if (index[slot] == pixel) {
+                data[pos++] = kOpIndex | slot;
+            } else {
+                index[slot] = pixel;
+                const int dr = qRed(pixel) - qRed(previous);
+                const int dg = qGreen(pixel) - qGreen(previous);
+                const int db = qBlue(pixel) - qBlue(previous);
+                const int drg = dr - dg;
+                const int dbg = db - dg;
+                // differences wrap around like the 8-bit channels do
+                const auto wrap = [](int value) { return qint8(quint8(value)); };
+
+                if (wrap(dr) >= -2 && wrap(dr) <= 1 && wrap(dg) >= -2 && wrap(dg) <= 1
+                    && wrap(db) >= -2 && wrap(db) <= 1) {
+                    data[pos++] = kOpDiff | ((wrap(dr) + 2) << 4) | ((wrap(dg) + 2) << 2) | (wrap(db) + 2);
+                } else if (wrap(dg) >= -32 && wrap(dg) <= 31 && wrap(drg) >= -8 && wrap(drg) <= 7
+                           && wrap(dbg) >= -8 && wrap(dbg) <= 7) {
+                    data[pos++] = kOpLuma | (wrap(dg) + 32);
+                    data[pos++] = ((wrap(drg) + 8) << 4) | (wrap(dbg) + 8);
+                } else {
+                    data[pos++] = kOpRgb;
+                    data[pos++] = qRed(pixel);
+                    data[pos++] = qGreen(pixel);
+                    data[pos++] = qBlue(pixel);
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if (run > 0)
+        data[pos++] = kOpRun | (run - 1);
+
+    memset(data + pos, 0, kPaddingSize - 1);
+    data[pos + kPaddingSize - 1] = 1;
+    out.resize(pos + kPaddingSize);
+    return out;
+}
+
+bool decodeQoi(const QByteArray &bytes, QImage *image)
+{
+    if (bytes.size() < kHeaderSize + kPaddingSize || !bytes.startsWith(kQoiMagic))
+        return false;
+
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    const quint32 width = qFromBigEndian<quint32>(data + 4);
+    const quint32 height = qFromBigEndian<quint32>(data + 8);
+    if (width == 0 || height == 0 || width > kMaxDimension || height > kMaxDimension)
+        return false;
+
+    QImage result(int(width), int(height), QImage::Format_RGB32);
+    if (result.isNull())
+        return false;
+
+    const int end = bytes.size() - kPaddingSize;
+    int pos = kHeaderSize;
+    QRgb index[64] = {};
+    QRgb pixel = qRgba(0, 0, 0, 255);
+    int run = 0;
+
+    for (int y = 0; y < int(height); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(result.scanLine(y));
+        for (int x = 0; x < int(width); ++x) {
+            if (run > 0) {
+                run--;
+            } else {
+                if (pos >= end)
+                    return false;
+                const quint8 op = data[pos++];
+                if (op == kOpRgb || op == kOpRgba) {
+                    const int size = op == kOpRgb ? 3 : 4;
+                    if (end - pos < size)
+                        return false;
+                    pixel = qRgba(data[pos], data[pos + 1], data[pos + 2],
+                                  op == kOpRgba ? data[pos + 3] : qAlpha(pixel));
+                    pos += size;
+                } else if ((op & kMask) == kOpIndex) {
+                    pixel = index[op];
+                } else if ((op & kMask) == kOpDiff) {
+                    pixel = qRgba(quint8(qRed(pixel) + ((op >> 4) & 3) - 2),
+                                  quint8(qGreen(pixel) + ((op >> 2) & 3) - 2),
+                                  quint8(qBlue(pixel) + (op & 3) - 2),
+                                  qAlpha(pixel));
+                } else if ((op & kMask) == kOpLuma) {
+                    if (pos >= end)
+                        return false;
+                    const quint8 next = data[pos++];
+                    const int dg = (op & 0x3f) - 32;
+                    pixel = qRgba(quint8(qRed(pixel) + dg - 8 + ((next >> 4) & 0x0f)),
+                                  quint8(qGreen(pixel) + dg),
+                                  quint8(qBlue(pixel) + dg - 8 + (next & 0x0f)),
+                                  qAlpha(pixel));
+                } else {
+                    run = op & 0x3f;
+                }
+                index[indexOf(pixel)] = pixel;
+            }
+            line[x] = pixel | 0xff000000;
+        }
+    }
+
+    *image = result;
+    return true;
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef SNAPSHOTCODEC_H
+#define SNAPSHOTCODEC_H
+
+#include <QByteArray>
+#include <QString>
+
+class QImage;
+
+// Canvas snapshot formats other than PNG. The canvas is mostly long white
+// runs and a handful of flat colors, which QOI (https://qoiformat.org)
+// encodes in a single pass without entropy coding. QoiDeflate wraps the
+// QOI stream in qCompress at level 1 for slow links.
+namespace SnapshotCodec {
+
+enum class Format {
+    Png,
+    Qoi,
+    QoiDeflate
+};
+
+Format detect(const QByteArray &data);
+Format formatFromName(const QString &name, Format fallback = Format::Png);
+const char *formatName(Format format);
+
+QByteArray encode(const QImage &image, Format format);
+bool decode(const QByteArray &data, QImage *image);
+
+QByteArray encodeQoi(const QImage &image);
+bool decodeQoi(const QByteArray &data, QImage *image);
+
+}
+
+#endif // SNAPSHOTCODEC_H
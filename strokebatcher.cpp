@@ -0,0 +1,119 @@
+#include "strokebatcher.h"
+#include <QPair>
+
+StrokeBatcher::StrokeBatcher(QObject *parent)
+    : QObject(parent),
+      lastTime(0),
+      maxPoints(kDefaultMaxPoints)
+{
+    clock.start();
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(kDefaultFlushInterval);
+    connect(&flushTimer, &QTimer::timeout, this, &StrokeBatcher::flush);
+}
+
+void StrokeBatcher::addSegment(const QPoint &from, const QPoint &to, const Protocol::PenParams &pen)
+{
+    if (!pending.points.isEmpty() && (pending.pen != pen || pending.points.last() != from))
+        flush();
+
+    const quint32 now = quint32(clock.elapsed());
+    if (pending.points.isEmpty()) {
+        pending.pen = pen;
+        pending.points.reserve(maxPoints);
+        pending.times.reserve(maxPoints);
+        pending.points.append(from);
+        pending.times.append(from == lastPoint ? lastTime : now);
+        flushTimer.start();
+    }
+    pending.points.append(to);
+    pending.times.append(now);
+    lastPoint = to;
+    lastTime = now;
+
+    if (pending.points.size() >= maxPoints)
+        flush();
+}
+
+void StrokeBatcher::flush()
+{
+    flushTimer.stop();
+    if (pending.points.isEmpty())
+        return;
+
+    Protocol::Stroke stroke;
+    stroke.pen = pending.pen;
+    stroke.points.swap(pending.points);
+    stroke.times.swap(pending.times);
+    emit strokeReady(stroke);
+}
+
+QVector<int> StrokeBatcher::simplify(const QVector<QPoint> &points, double tolerance)
+{
+    const int count = points.size();
+    if (count <= 2) {
+        QVector<int> all(count);
+        for (int i = 0; i < count; ++i)
+            all[i] = i;
+        return all;
+    }
+
+    // Radial distance pass at half the tolerance, so the two passes together
+    // stay close to the requested bound.
+    const double tolerance2 = tolerance * tolerance;
+    QVector<int> radial;
+    radial.reserve(count);
+    radial.append(0);
+    for (int i = 1; i < count - 1; ++i) {
+        const QPoint delta = points[i] - points[radial.last()];
+        if (QPoint::dotProduct(delta, delta) * 4.0 > tolerance2)
+            radial.append(i);
+    }
+    radial.append(count - 1);
+
+    // Ramer-Douglas-Peucker over the survivors, iteratively
+    QVector<bool> keep(radial.size(), false);
+    keep.first() = true;
+    keep.last() = true;
+    QVector<QPair<int, int>> ranges;
+    ranges.append(qMakePair(0, radial.size() - 1));
+    while (!ranges.isEmpty()) {
+        const QPair<int, int> range = ranges.takeLast();
+        const QPoint a = points[radial[range.first]];
+        const QPoint b = points[radial[range.second]];
+        const double dx = b.x() - a.x();
+        const double dy = b.y() - a.y();
+        const double length2 = dx * dx + dy * dy;
+
+        double worst = 0.0;
+        int worstIndex = -1;
+        for (int i = range.first + 1; i < range.second; ++i) {
+            const QPoint p = points[radial[i]];
+            // to the segment, not the line through it: a point past either
+            // end is as far as it looks
+            double t = 0.0;
+            if (length2 > 0.0)
+                t = qBound(0.0, ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / length2, 1.0);
+            const double ex = p.x() - a.x() - t * dx;
+            const double ey = p.y() - a.y() - t * dy;
+            const double distance2 = ex * ex + ey * ey;
+            if (distance2 > worst) {
+                worst = distance2;
+                worstIndex = i;
+            }
+        }
+        if (worstIndex >= 0 && worst > tolerance2) {
+            keep[worstIndex] = true;
+            ranges.append(qMakePair(range.first, worstIndex));
+            ranges.append(qMakePair(worstIndex, range.second));
+        }
+    }
+
+    QVector<int> kept;
+    kept.reserve(radial.size());
+    for (int i = 0; i < radial.size(); ++i) {
+        if (keep[i])
+            kept.append(radial[i]);
+    }
+    return kept;
+}
@@ -0,0 +1,53 @@
+#ifndef STROKEBATCHER_H
+#define STROKEBATCHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "protocol.h"
+
+// Collects consecutive segments drawn with the same pen into one polyline and
+// hands it out as a single STROKE once the flush interval elapses or the
+// polyline reaches maxPoints. Every point is stamped with the time it was
+// drawn so receivers can play the stroke back at the drawer's pace.
+//
+// The points are sent as they come; the drawer simplifies them before they
+// are drawn (see DrawingArea), so peers get exactly what it painted.
+// simplify() keeps the polyline within about tolerance pixels of the input:
+// samples closer than half that to the previous kept one are dropped, then
+// Ramer-Douglas-Peucker removes points that deviate less than that from the
+// segment between their neighbours. The first and last points always stay,
+// so consecutive polylines still join up.
+class StrokeBatcher : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int kDefaultFlushInterval = 16;
+    static constexpr int kDefaultMaxPoints = 64;
+    static constexpr double kDefaultTolerance = 1.0;
+
+    explicit StrokeBatcher(QObject *parent = nullptr);
+
+    void setFlushInterval(int msec) { flushTimer.setInterval(msec); }
+    int flushInterval() const { return flushTimer.interval(); }
+    void setMaxPoints(int points) { maxPoints = qMax(2, points); }
+    int getMaxPoints() const { return maxPoints; }
+
+    static QVector<int> simplify(const QVector<QPoint> &points, double tolerance);
+
+    void addSegment(const QPoint &from, const QPoint &to, const Protocol::PenParams &pen);
+    void flush();
+
+signals:
+    void strokeReady(const Protocol::Stroke &stroke);
+
+private:
+    Protocol::Stroke pending;
+    QTimer flushTimer;
+    QElapsedTimer clock;
+    QPoint lastPoint;
+    quint32 lastTime;
+    int maxPoints;
+};
+
+#endif // STROKEBATCHER_H
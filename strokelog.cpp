@@ -0,0 +1,185 @@
+#include "strokelog.h"
+#include "strokeraster.h"
+#include <QImage>
+
+void StrokeLog::clear()
+{
+    xs.clear();
+    ys.clear();
+    strokeStart.clear();
+    colors.clear();
+    widths.clear();
+    erasers.clear();
+    ids.clear();
+}
+
+qint64 StrokeLog::memoryBytes() const
+{
+    return qint64(xs.size() + ys.size()) * sizeof(qint16)
+           + qint64(strokeStart.size()) * (sizeof(int) + sizeof(QRgb) + sizeof(quint16) + sizeof(bool) + sizeof(quint32));
+}
+
+int StrokeLog::strokeEnd(int index) const
+{
+    return index + 1 < strokeStart.size() ? strokeStart[index + 1] : xs.size();
+}
+
+bool StrokeLog::continuesLast(const QPoint &from, const QColor &color, bool eraser, int width, quint32 strokeId) const
+{
+    return !strokeStart.isEmpty()
+           && colors.last() == color.rgb() && erasers.last() == eraser && widths.last() == width
+           && ids.last() == strokeId && xs.last() == from.x() && ys.last() == from.y();
+}
+
+void StrokeLog::addSegment(const QPoint &from, const QPoint &to, const QColor &color, bool eraser, int width,
+                           quint32 strokeId)
+{
+    if (!continuesLast(from, color, eraser, width, strokeId)) {
+        strokeStart.append(xs.size());
+        colors.append(color.rgb());
+        widths.append(quint16(qBound(0, width, 0xFFFF)));
+        erasers.append(eraser);
+        ids.append(strokeId);
+        xs.append(qint16(from.x()));
+        ys.append(qint16(from.y()));
+    }
+    xs.append(qint16(to.x()));
+    ys.append(qint16(to.y()));
+}
+
+Protocol::Stroke StrokeLog::stroke(int index) const
+{
+    Protocol::Stroke stroke;
+    stroke.pen.color = QColor::fromRgb(colors[index]);
+    stroke.pen.eraser = erasers[index];
+    stroke.pen.width = widths[index];
+    stroke.pen.strokeId = ids[index];
+    const int end = strokeEnd(index);
+    stroke.points.reserve(end - strokeStart[index]);
+    for (int i = strokeStart[index]; i < end; ++i)
+        stroke.points.append(QPoint(xs[i], ys[i]));
+    return stroke;
+}
+
+int StrokeLog::indexOf(quint32 strokeId) const
+{
+    return ids.indexOf(strokeId);
+}
+
+QVector<Protocol::Stroke> StrokeLog::takeStrokes(quint32 strokeId)
+{
+    QVector<Protocol::Stroke> taken;
+    StrokeLog kept;
+    for (int index = 0; index < strokeStart.size(); ++index) {
+        if (ids[index] == strokeId) {
+            taken.append(stroke(index));
+            continue;
+        }
+        kept.strokeStart.append(kept.xs.size());
+        kept.colors.append(colors[index]);
+        kept.widths.append(widths[index]);
+        kept.erasers.append(erasers[index]);
+        kept.ids.append(ids[index]);
+        for (int i = strokeStart[index]; i < strokeEnd(index); ++i) {
+            kept.xs.append(xs[i]);
+            kept.ys.append(ys[i]);
+        }
+    }
+    if (!taken.isEmpty())
+        *this = kept;
+    return taken;
+}
+
+QRect StrokeLog::bounds(int firstStroke) const
+{
+    QRect united;
+    for (int stroke = firstStroke; stroke < strokeStart.size(); ++stroke) {
+        const int start = strokeStart[stroke];
+        int left = xs[start], right = xs[start], top = ys[start], bottom = ys[start];
+        for (int i = start + 1; i < strokeEnd(stroke); ++i) {
+            left = qMin<int>(left, xs[i]);
+            right = qMax<int>(right, xs[i]);
+            top = qMin<int>(top, ys[i]);
+            bottom = qMax<int>(bottom, ys[i]);
+        }
+        // the rasterizer reaches half the width plus a pixel of coverage
+        const int reach = widths[stroke] / 2 + 2;
+        united |= QRect(QPoint(left - reach, top - reach), QPoint(right + reach, bottom + reach));
+    }
+    return united;
+}
+
+void StrokeLog::paint(QImage *image, int firstStroke) const
+{
+    for (int stroke = firstStroke; stroke < strokeStart.size(); ++stroke) {
+        const QRgb color = erasers[stroke] ? qRgb(255, 255, 255) : colors[stroke];
+        const int start = strokeStart[stroke];
+        StrokeRaster::drawPolyline(image, xs.constData() + start, ys.constData() + start,
+                                   strokeEnd(stroke) - start, color, widths[stroke]);
+    }
+}
+
+// Encoded as: stroke count, then per stroke the pen (Protocol::writePen),
+// the point count and zigzag deltas from the previous point in the log.
+QByteArray StrokeLog::encode(int version) const
+{
+    QByteArray out;
+    out.reserve(8 + strokeStart.size() * 8 + xs.size() * 2);
+    Protocol::writeVarint(out, quint32(strokeStart.size()));
+
+    int previousX = 0;
+    int previousY = 0;
+    for (int stroke = 0; stroke < strokeStart.size(); ++stroke) {
+        Protocol::PenParams pen;
+        pen.color = QColor::fromRgb(colors[stroke]);
+        pen.eraser = erasers[stroke];
+        pen.width = widths[stroke];
+        pen.strokeId = ids[stroke];
+        Protocol::writePen(out, pen, version);
+
+        const int end = strokeEnd(stroke);
+        Protocol::writeVarint(out, quint32(end - strokeStart[stroke]));
+        for (int i = strokeStart[stroke]; i < end; ++i) {
+            Protocol::writeSigned(out, xs[i] - previousX);
+            Protocol::writeSigned(out, ys[i] - previousY);
+            previousX = xs[i];
+            previousY = ys[i];
+        }
+    }
+    return out;
+}
+
+bool StrokeLog::decode(const QByteArray &data, StrokeLog *log)
+{
+    log->clear();
+    Protocol::Reader reader(data.constData(), data.size());
+
+    quint32 strokes;
+    if (!reader.readVarint(&strokes) || strokes > quint32(reader.remaining()))
+        return false;
+
+    int x = 0;
+    int y = 0;
+    for (quint32 stroke = 0; stroke < strokes; ++stroke) {
+        Protocol::PenParams pen;
+        quint32 points;
+        if (!reader.readPen(&pen) || !reader.readVarint(&points) || points > quint32(reader.remaining()) / 2)
+            return false;
+
+        log->strokeStart.append(log->xs.size());
+        log->colors.append(pen.color.rgb());
+        log->widths.append(quint16(qBound(0, pen.width, 0xFFFF)));
+        log->erasers.append(pen.eraser);
+        log->ids.append(pen.strokeId);
+        for (quint32 i = 0; i < points; ++i) {
+            qint32 dx, dy;
+            if (!reader.readSigned(&dx) || !reader.readSigned(&dy))
+                return false;
+            x += dx;
+            y += dy;
+            log->xs.append(qint16(x));
+            log->ys.append(qint16(y));
+        }
+    }
+    return reader.atEnd();
+}
@@ -0,0 +1,57 @@
+#ifndef STROKELOG_H
+#define STROKELOG_H
+
+#include <QVector>
+#include <QRgb>
+#include <QRect>
+#include "protocol.h"
+
+class QImage;
+
+// Everything drawn on a canvas since it was last cleared, kept as columns:
+// the points of all strokes back to back plus one entry per stroke for its
+// first point, color, width, eraser flag and stroke id. The raster image is
+// a cache of replaying this log onto a white canvas.
+class StrokeLog
+{
+public:
+    void clear();
+    bool isEmpty() const { return strokeStart.isEmpty(); }
+    int strokeCount() const { return strokeStart.size(); }
+    int pointCount() const { return xs.size(); }
+    int segmentCount() const { return pointCount() - strokeCount(); }
+    qint64 memoryBytes() const;
+
+    // Extends the last stroke when the segment continues it with the same
+    // pen, starts a new stroke otherwise.
+    void addSegment(const QPoint &from, const QPoint &to, const QColor &color, bool eraser, int width,
+                    quint32 strokeId = 0);
+    bool continuesLast(const QPoint &from, const QColor &color, bool eraser, int width, quint32 strokeId) const;
+
+    Protocol::Stroke stroke(int index) const;
+    quint32 strokeId(int index) const { return ids[index]; }
+    int indexOf(quint32 strokeId) const;
+    // Removes every stroke with that id and returns them in order.
+    QVector<Protocol::Stroke> takeStrokes(quint32 strokeId);
+    // What painting the strokes from firstStroke on touches.
+    QRect bounds(int firstStroke) const;
+
+    void paint(QImage *image, int firstStroke = 0) const;
+
+    // Version 2 peers get the log without stroke ids.
+    QByteArray encode(int version = Protocol::kBinaryVersion) const;
+    static bool decode(const QByteArray &data, StrokeLog *log);
+
+private:
+    int strokeEnd(int index) const;
+
+    QVector<qint16> xs;
+    QVector<qint16> ys;
+    QVector<int> strokeStart;
+    QVector<QRgb> colors;
+    QVector<quint16> widths;
+    QVector<bool> erasers;
+    QVector<quint32> ids;
+};
+
+#endif // STROKELOG_H
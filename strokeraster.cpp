@@ -0,0 +1,276 @@
+#include "strokeraster.h"
+#include <QImage>
+#include <QPainter>
+#include <QString>
+#include <QVarLengthArray>
+#include <QVector>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STROKERASTER_SSE2
+#endif
+
+namespace StrokeRaster {
+
+namespace {
+
+#ifdef STROKERASTER_SSE2
+Backend currentBackend = Backend::Simd;
+#else
+Backend currentBackend = Backend::Scalar;
+#endif
+
+// Segment relative to its start point, with everything the per-pixel
+// distance needs precomputed.
+struct Capsule {
+    int ax, ay;
+    float dx, dy;
+    float invLength2;   // 0 for a dot
+    float edge;         // radius + 0.5: coverage falls from 1 to 0 over one pixel
+};
+
+inline quint8 coverage(const Capsule &capsule, float fx, float fy)
+{
+    float t = (fx * capsule.dx + fy * capsule.dy) * capsule.invLength2;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    const float ex = fx - t * capsule.dx;
+    const float ey = fy - t * capsule.dy;
+    float c = capsule.edge - std::sqrt(ex * ex + ey * ey);
+    c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+    return quint8(int(c * 255.0f + 0.5f));
+}
+
+void coverRowScalar(quint8 *cov, int x, int count, int y, const Capsule &capsule)
+{
+    const float fy = float(y - capsule.ay);
+    for (int i = 0; i < count; ++i) {
+        const quint8 value = coverage(capsule, float(x + i - capsule.ax), fy);
+        if (value > cov[i])
+            cov[i] = value;
+    }
+}
+
+inline quint8 blendChannel(int src, int dst, int alpha)
+{
+    const int value = src * alpha + dst * (255 - alpha) + 128;
+    return quint8((value + (value >> 8)) >> 8);
+}
+
+void blendRowScalar(QRgb *dst, const quint8 *cov, int count, QRgb color)
+{
+    for (int i = 0; i < count; ++i) {
+        const int alpha = cov[i];
+        if (alpha == 0)
+            continue;
+        dst[i] = qRgb(blendChannel(qRed(color), qRed(dst[i]), alpha),
+                      blendChannel(qGreen(color), qGreen(dst[i]), alpha),
+                      blendChannel(qBlue(color), qBlue(dst[i]), alpha));
+    }
+}
+
+#ifdef STROKERASTER_SSE2
+void coverRowSse2(quint8 *cov, int x, int count, int y, const Capsule &capsule)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 dx = _mm_set1_ps(capsule.dx);
+    const __m128 dy = _mm_set1_ps(capsule.dy);
+    const __m128 invLength2 = _mm_set1_ps(capsule.invLength2);
+    const __m128 edge = _mm_set1_ps(capsule.edge);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 fy = _mm_set1_ps(float(y - capsule.ay));
+    const __m128 fyDy = _mm_mul_ps(fy, dy);
+    const __m128 step = _mm_set1_ps(4.0f);
+    __m128 fx = _mm_add_ps(_mm_set1_ps(float(x - capsule.ax)), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(fx, dx), fyDy), invLength2);
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        const __m128 ex = _mm_sub_ps(fx, _mm_mul_ps(t, dx));
+        const __m128 ey = _mm_sub_ps(fy, _mm_mul_ps(t, dy));
+        __m128 c = _mm_sub_ps(edge, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey))));
+        c = _mm_min_ps(_mm_max_ps(c, zero), one);
+        const __m128i value = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, scale), half));
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(value, value), _mm_setzero_si128());
+
+        int existing;
+        memcpy(&existing, cov + i, 4);
+        const int merged = _mm_cvtsi128_si32(_mm_max_epu8(bytes, _mm_cvtsi32_si128(existing)));
+        memcpy(cov + i, &merged, 4);
+        fx = _mm_add_ps(fx, step);
+    }
+    if (i < count)
+        coverRowScalar(cov + i, x + i, count - i, y, capsule);
+}
+
+void blendRowSse2(QRgb *dst, const quint8 *cov, int count, QRgb color)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i rounding = _mm_set1_epi16(128);
+    const __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32(int(color)), zero);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int alphas;
+        memcpy(&alphas, cov + i, 4);
+        if (alphas == 0)
+            continue;
+
+        __m128i alpha = _mm_cvtsi32_si128(alphas);
+        alpha = _mm_unpacklo_epi8(alpha, alpha);
+        alpha = _mm_unpacklo_epi16(alpha, alpha);
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+
+        __m128i result[2];
+        for (int half = 0; half < 2; ++half) {
+            const __m128i a = half ? _mm_unpackhi_epi8(alpha, zero) : _mm_unpacklo_epi8(alpha, zero);
+            const __m128i d = half ? _mm_unpackhi_epi8(pixels, zero) : _mm_unpacklo_epi8(pixels, zero);
+            __m128i value = _mm_add_epi16(_mm_mullo_epi16(src, a), _mm_mullo_epi16(d, _mm_sub_epi16(full, a)));
+            value = _mm_add_epi16(value, rounding);
+            result[half] = _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(result[0], result[1]));
+    }
+    if (i < count)
+        blendRowScalar(dst + i, cov + i, count - i, color);
+}
+#endif
+
+QRect drawWithPainter(QImage *image, const qint16 *xs, const qint16 *ys, int count, QRgb color, int width)
+{
+    QPainter painter(image);
+    painter.setPen(QPen(QColor(color), width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+    QRect bounds;
+    for (int i = 1; i < count; ++i) {
+        const QPoint from(xs[i - 1], ys[i - 1]);
+        const QPoint to(xs[i], ys[i]);
+        painter.drawLine(from, to);
+        bounds |= QRect(from, to).normalized();
+    }
+    return bounds.adjusted(-width, -width, width, width).intersected(image->rect());
+}
+
+}
+
+Backend backend()
+{
+    return currentBackend;
+}
+
+void setBackend(Backend backend)
+{
+#ifndef STROKERASTER_SSE2
+    if (backend == Backend::Simd)
+        backend = Backend::Scalar;
+#endif
+    currentBackend = backend;
+}
+
+Backend backendFromName(const QString &name, Backend fallback)
+{
+    if (name == QLatin1String("qpainter"))
+        return Backend::QPainter;
+    if (name == QLatin1String("scalar"))
+        return Backend::Scalar;
+    if (name == QLatin1String("simd"))
+        return Backend::Simd;
+    return fallback;
+}
+
+const char *backendName(Backend backend)
+{
+    switch (backend) {
+    case Backend::QPainter:
+        return "qpainter";
+    case Backend::Scalar:
+        return "scalar";
+    default:
+        return "simd";
+    }
+}
+
+QRect drawPolyline(QImage *image, const qint16 *xs, const qint16 *ys, int count, QRgb color, int width)
+{
+    if (count < 2 || image->isNull())
+        return QRect();
+    if (currentBackend == Backend::QPainter || image->format() != QImage::Format_RGB32)
+        return drawWithPainter(image, xs, ys, count, color, width);
+
+    const float radius = qMax(width, 1) * 0.5f;
+    const int reach = int(std::ceil(radius + 0.5f));
+
+    int left = xs[0], right = xs[0], top = ys[0], bottom = ys[0];
+    for (int i = 1; i < count; ++i) {
+        left = qMin<int>(left, xs[i]);
+        right = qMax<int>(right, xs[i]);
+        top = qMin<int>(top, ys[i]);
+        bottom = qMax<int>(bottom, ys[i]);
+    }
+    const QRect bounds = QRect(QPoint(left - reach, top - reach), QPoint(right + reach, bottom + reach))
+                             .intersected(image->rect());
+    if (bounds.isEmpty())
+        return QRect();
+
+    const int stride = bounds.width();
+    static thread_local QVector<quint8> coverageBuffer;
+    coverageBuffer.fill(0, stride * bounds.height());
+    quint8 *cov = coverageBuffer.data();
+
+#ifdef STROKERASTER_SSE2
+    const bool simd = currentBackend == Backend::Simd;
+    const auto coverRow = simd ? coverRowSse2 : coverRowScalar;
+    const auto blendRow = simd ? blendRowSse2 : blendRowScalar;
+#else
+    const auto coverRow = coverRowScalar;
+    const auto blendRow = blendRowScalar;
+#endif
+
+    for (int i = 1; i < count; ++i) {
+        Capsule capsule;
+        capsule.ax = xs[i - 1];
+        capsule.ay = ys[i - 1];
+        capsule.dx = float(xs[i] - xs[i - 1]);
+        capsule.dy = float(ys[i] - ys[i - 1]);
+        const float length2 = capsule.dx * capsule.dx + capsule.dy * capsule.dy;
+        capsule.invLength2 = length2 > 0.0f ? 1.0f / length2 : 0.0f;
+        capsule.edge = radius + 0.5f;
+
+        const QRect box = QRect(QPoint(qMin<int>(xs[i - 1], xs[i]) - reach, qMin<int>(ys[i - 1], ys[i]) - reach),
+                                QPoint(qMax<int>(xs[i - 1], xs[i]) + reach, qMax<int>(ys[i - 1], ys[i]) + reach))
+                              .intersected(bounds);
+        for (int y = box.top(); y <= box.bottom(); ++y) {
+            quint8 *row = cov + (y - bounds.top()) * stride + (box.left() - bounds.left());
+            coverRow(row, box.left(), box.width(), y, capsule);
+        }
+    }
+
+    for (int y = bounds.top(); y <= bounds.bottom(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image->scanLine(y)) + bounds.left();
+        blendRow(line, cov + (y - bounds.top()) * stride, stride, color | 0xff000000);
+    }
+    return bounds;
+}
+
+QRect drawPolyline(QImage *image, const QPoint *points, int count, QRgb color, int width)
+{
+    QVarLengthArray<qint16, 256> xs(count);
+    QVarLengthArray<qint16, 256> ys(count);
+    for (int i = 0; i < count; ++i) {
+        xs[i] = qint16(points[i].x());
+        ys[i] = qint16(points[i].y());
+    }
+    return drawPolyline(image, xs.constData(), ys.constData(), count, color, width);
+}
+
+QRect drawSegment(QImage *image, const QPoint &from, const QPoint &to, QRgb color, int width)
+{
+    const qint16 xs[2] = { qint16(from.x()), qint16(to.x()) };
+    const qint16 ys[2] = { qint16(from.y()), qint16(to.y()) };
+    return drawPolyline(image, xs, ys, 2, color, width);
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef STROKERASTER_H
+#define STROKERASTER_H
+
+#include <QRect>
+#include <QRgb>
+#include <QString>
+
+class QImage;
+
+// Round-cap stroke rasterizer for Format_RGB32 canvases. Every segment is a
+// capsule; per-pixel coverage is the distance to the segment, taken as the
+// maximum over all segments of a polyline so joints are not blended twice,
+// and the whole polyline is blended in one pass over its bounding box. The
+// SSE2 and scalar paths produce identical pixels, so canvas hashes agree
+// between peers whichever path they run.
+namespace StrokeRaster {
+
+enum class Backend {
+    QPainter,   // reference path, one QPainter::drawLine per segment
+    Scalar,
+    Simd
+};
+
+Backend backend();
+void setBackend(Backend backend);
+Backend backendFromName(const QString &name, Backend fallback);
+const char *backendName(Backend backend);
+
+// Returns the rectangle that was touched.
+QRect drawPolyline(QImage *image, const qint16 *xs, const qint16 *ys, int count, QRgb color, int width);
+QRect drawPolyline(QImage *image, const QPoint *points, int count, QRgb color, int width);
+QRect drawSegment(QImage *image, const QPoint &from, const QPoint &to, QRgb color, int width);
+
+}
+
+#endif // STROKERASTER_H
@@ -0,0 +1,11 @@
+QT = core gui network testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_framedecoder
+
+include(../../shared.pri)
+
+SOURCES += \
+    tst_framedecoder.cpp
@@ -0,0 +1,187 @@
+#include "framedecoder.h"
+#include "sendqueue.h"
+#include <QRandomGenerator>
+#include <QtTest>
+
+// Byte streams as a peer would send them, fed to the decoder in random
+// chunk sizes: every split must give back the same messages.
+class TestFrameDecoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void textInRandomChunks();
+    void binaryWithPartsInRandomChunks();
+    void switchToBinaryMidStream();
+    void oversizedFrameFails();
+    void tooManyTransfersFail();
+
+private:
+    static QList<Protocol::Message> sampleMessages();
+    static QList<Protocol::Message> replay(const QByteArray &stream, quint32 seed, int maxChunk);
+    static void compare(const QList<Protocol::Message> &actual, const QList<Protocol::Message> &expected);
+};
+
+QList<Protocol::Message> TestFrameDecoder::sampleMessages()
+{
+    QList<Protocol::Message> messages;
+    messages << Protocol::makeText(Protocol::MessageType::Join, "комната");
+    messages << Protocol::makeText(Protocol::MessageType::Chat, "Привет, это жираф?");
+
+    Protocol::DrawSegment segment;
+    segment.from = QPoint(10, 20);
+    segment.to = QPoint(-3, 400);
+    segment.pen.color = Qt::red;
+    segment.pen.width = 7;
+    messages << Protocol::makeDraw(segment);
+
+    Protocol::Stroke stroke;
+    stroke.pen.width = 3;
+    for (int i = 0; i < 200; ++i)
+        stroke.points << QPoint(i * 3, 300 + (i % 17) * 5);
+    messages << Protocol::makeStroke(stroke);
+
+    QByteArray image(200 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < image.size(); ++i)
+        image[i] = char((i * 131) ^ (i >> 7));
+    messages << Protocol::makeImage(image);
+    messages << Protocol::makeText(Protocol::MessageType::Win, "жираф");
+    return messages;
+}
+
+QList<Protocol::Message> TestFrameDecoder::replay(const QByteArray &stream, quint32 seed, int maxChunk)
+{
+    QRandomGenerator random(seed);
+    FrameDecoder decoder;
+    QList<Protocol::Message> messages;
+    int pos = 0;
+    while (pos < stream.size()) {
+        const int chunk = qMin(stream.size() - pos, int(random.bounded(1, maxChunk + 1)));
+        decoder.append(stream.constData() + pos, chunk);
+        pos += chunk;
+
+        FrameDecoder::Frame frame;
+        FrameDecoder::Status status;
+        while ((status = decoder.next(&frame)) == FrameDecoder::Status::Ready) {
+            Protocol::Message message;
+            if (!FrameDecoder::decode(frame, &message))
+                return messages;
+            if (message.type == Protocol::MessageType::Binary)
+                decoder.setMode(FrameDecoder::Mode::Binary);
+            messages << message;
+        }
+        if (status == FrameDecoder::Status::Error)
+            return messages;
+    }
+    return messages;
+}
+
+void TestFrameDecoder::compare(const QList<Protocol::Message> &actual, const QList<Protocol::Message> &expected)
+{
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < actual.size(); ++i) {
+        QCOMPARE(int(actual[i].type), int(expected[i].type));
+        QCOMPARE(actual[i].text, expected[i].text);
+        QCOMPARE(actual[i].image, expected[i].image);
+        QCOMPARE(actual[i].segment.from, expected[i].segment.from);
+        QCOMPARE(actual[i].segment.to, expected[i].segment.to);
+        QCOMPARE(actual[i].stroke.points, expected[i].stroke.points);
+    }
+}
+
+void TestFrameDecoder::textInRandomChunks()
+{
+    const QList<Protocol::Message> messages = sampleMessages();
+    QByteArray stream;
+    for (const Protocol::Message &message : messages)
+        stream += Protocol::encodeText(message);
+
+    for (quint32 seed = 1; seed <= 50; ++seed) {
+        compare(replay(stream, seed, 7), messages);
+        compare(replay(stream, seed, 4096), messages);
+    }
+}
+
+// The image goes out as PART frames with the other messages in between.
+void TestFrameDecoder::binaryWithPartsInRandomChunks()
+{
+    const QList<Protocol::Message> messages = sampleMessages();
+    SendQueue queue;
+    quint32 sequence = 0;
+    for (const Protocol::Message &message : messages) {
+        queue.enqueue(Protocol::encodeFrame(message, sequence++), SendQueue::priorityOf(message.type),
+                      false, true);
+    }
+    QByteArray stream = Protocol::encodeText(Protocol::makeText(Protocol::MessageType::Binary, "2"));
+    QByteArray frame;
+    while (queue.takeNext(0, &frame))
+        stream += frame;
+
+    const QList<Protocol::Message> first = replay(stream, 1, 1);
+    QCOMPARE(first.size(), messages.size() + 1);
+    for (quint32 seed = 2; seed <= 50; ++seed) {
+        compare(replay(stream, seed, 3), first);
+        compare(replay(stream, seed, 8192), first);
+    }
+    // the queue may reorder by priority, but every message arrives intact
+    for (const Protocol::Message &message : messages) {
+        bool found = false;
+        for (const Protocol::Message &received : first)
+            found = found || (received.type == message.type && received.text == message.text
+                              && received.image == message.image);
+        QVERIFY(found);
+    }
+}
+
+void TestFrameDecoder::switchToBinaryMidStream()
+{
+    const QList<Protocol::Message> messages = sampleMessages();
+    QByteArray stream;
+    QList<Protocol::Message> expected;
+    for (int i = 0; i < 2; ++i) {
+        stream += Protocol::encodeText(messages[i]);
+        expected << messages[i];
+    }
+    const Protocol::Message binary = Protocol::makeText(Protocol::MessageType::Binary, "2");
+    stream += Protocol::encodeText(binary);
+    expected << binary;
+    for (int i = 2; i < messages.size(); ++i) {
+        stream += Protocol::encodeFrame(messages[i], quint32(i));
+        expected << messages[i];
+    }
+
+    for (quint32 seed = 1; seed <= 50; ++seed)
+        compare(replay(stream, seed, 64), expected);
+}
+
+void TestFrameDecoder::oversizedFrameFails()
+{
+    FrameDecoder decoder(1024);
+    decoder.setMode(FrameDecoder::Mode::Binary);
+    const QByteArray frame = Protocol::encodeFrame(Protocol::makeImage(QByteArray(2048, 'x')), 1);
+    decoder.append(frame.constData(), Protocol::kFrameHeaderSize);
+    FrameDecoder::Frame out;
+    QCOMPARE(decoder.next(&out), FrameDecoder::Status::Error);
+
+    FrameDecoder text(1024);
+    const QByteArray line(4096, 'a');
+    text.append(line.constData(), line.size());
+    QCOMPARE(text.next(&out), FrameDecoder::Status::Error);
+}
+
+void TestFrameDecoder::tooManyTransfersFail()
+{
+    FrameDecoder decoder;
+    decoder.setMode(FrameDecoder::Mode::Binary);
+    const QByteArray slice(100, 'x');
+    for (quint32 transfer = 1; transfer <= quint32(FrameDecoder::kMaxTransfers) + 1; ++transfer) {
+        const QByteArray part = Protocol::encodePart(transfer, false, slice.constData(), slice.size(), transfer);
+        decoder.append(part.constData(), part.size());
+    }
+    FrameDecoder::Frame out;
+    QCOMPARE(decoder.next(&out), FrameDecoder::Status::Error);
+}
+
+QTEST_APPLESS_MAIN(TestFrameDecoder)
+
+#include "tst_framedecoder.moc"
@@ -0,0 +1,15 @@
+QT = core gui network testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_sessionlog
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+include(../../client.pri)
+
+SOURCES += \
+    tst_sessionlog.cpp
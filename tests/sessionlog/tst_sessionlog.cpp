@@ -0,0 +1,207 @@
+#include "drawgame.h"
+#include "sessionlog.h"
+#include "sessionreplay.h"
+#include "strokelog.h"
+#include "strokeraster.h"
+#include <QApplication>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+
+// A short game written with the Recorder, mapped back with the Reader and
+// replayed onto a canvas: the picture must be what the strokes after the
+// last clear paint, and a record cut short at the end must not change it.
+class TestSessionLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readsBackWhatWasRecorded();
+    void replaysTheCanvas();
+    void ignoresRecordCutShort_data();
+    void ignoresRecordCutShort();
+    void rejectsOtherFiles();
+
+private:
+    static QList<Protocol::Message> sampleGame();
+    static QString writeLog(const QString &path, const QList<Protocol::Message> &messages);
+    static QImage expectedCanvas();
+    static QImage replayed(const SessionLog::Reader &log);
+
+    QTemporaryDir dir;
+};
+
+static Protocol::Stroke sampleStroke(quint32 id, const QColor &color, int width, int x, int y)
+{
+    Protocol::Stroke stroke;
+    stroke.pen.color = color;
+    stroke.pen.width = width;
+    stroke.pen.strokeId = id;
+    for (int i = 0; i < 20; ++i)
+        stroke.points.append(QPoint(x + i * 9, y + (i % 4) * 7));
+    return stroke;
+}
+
+// Strokes in both directions, a clear, chat in between and a snapshot of
+// the second round sent as a stroke log.
+QList<Protocol::Message> TestSessionLog::sampleGame()
+{
+    QList<Protocol::Message> messages;
+    messages << Protocol::makeText(Protocol::MessageType::Join, "комната");
+    messages << Protocol::makeStroke(sampleStroke(1, Qt::red, 5, 30, 40));
+    messages << Protocol::makeText(Protocol::MessageType::Chat, "жираф?");
+    messages << Protocol::makeStroke(sampleStroke(2, Qt::blue, 9, 100, 300));
+    messages << Protocol::makeText(Protocol::MessageType::Clear, "2");
+
+    messages << Protocol::makeStroke(sampleStroke(3, Qt::darkGreen, 3, 200, 100));
+    Protocol::DrawSegment segment;
+    segment.from = QPoint(400, 400);
+    segment.to = QPoint(600, 450);
+    segment.pen.color = Qt::magenta;
+    segment.pen.width = 12;
+    messages << Protocol::makeDraw(segment);
+
+    StrokeLog log;
+    const Protocol::Stroke stroke = sampleStroke(4, Qt::black, 7, 50, 500);
+    for (int i = 1; i < stroke.points.size(); ++i)
+        log.addSegment(stroke.points[i - 1], stroke.points[i], stroke.pen.color, false, stroke.pen.width, 4);
+    messages << Protocol::makeStrokeLog(log.encode());
+    messages << Protocol::makeStroke(sampleStroke(5, Qt::cyan, 4, 300, 200));
+    return messages;
+}
+
+QString TestSessionLog::writeLog(const QString &path, const QList<Protocol::Message> &messages)
+{
+    SessionLog::Recorder recorder;
+    if (!recorder.open(path))
+        return recorder.errorString();
+    for (int i = 0; i < messages.size(); ++i)
+        recorder.record(i % 2 ? SessionLog::Direction::In : SessionLog::Direction::Out, messages[i]);
+    recorder.flush();
+    return QString();
+}
+
+// The stroke log replaces the canvas, so only it and the stroke after it
+// remain.
+QImage TestSessionLog::expectedCanvas()
+{
+    QImage image(800, 600, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    const Protocol::Stroke last = sampleStroke(4, Qt::black, 7, 50, 500);
+    StrokeRaster::drawPolyline(&image, last.points.constData(), last.points.size(), QColor(Qt::black).rgb(), 7);
+    const Protocol::Stroke after = sampleStroke(5, Qt::cyan, 4, 300, 200);
+    StrokeRaster::drawPolyline(&image, after.points.constData(), after.points.size(), QColor(Qt::cyan).rgb(), 4);
+    return image;
+}
+
+QImage TestSessionLog::replayed(const SessionLog::Reader &log)
+{
+    DrawingArea area;
+    area.setDrawingEnabled(false);
+    SessionReplay replay(&log, &area);
+    replay.runFast();
+    return area.getImage().convertToFormat(QImage::Format_RGB32);
+}
+
+void TestSessionLog::readsBackWhatWasRecorded()
+{
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("game.dgrec");
+    const QList<Protocol::Message> messages = sampleGame();
+    QCOMPARE(writeLog(path, messages), QString());
+
+    SessionLog::Reader log;
+    QVERIFY2(log.open(path), qPrintable(log.errorString()));
+    QCOMPARE(log.count(), messages.size());
+    for (int i = 0; i < log.count(); ++i) {
+        const SessionLog::Record &record = log.at(i);
+        QCOMPARE(int(record.type), int(messages[i].type));
+        QCOMPARE(int(record.direction), int(i % 2 ? SessionLog::Direction::In : SessionLog::Direction::Out));
+        if (i > 0)
+            QVERIFY(record.usecs >= log.at(i - 1).usecs);
+
+        Protocol::Message message;
+        QVERIFY(record.decode(&message));
+        QCOMPARE(message.text, messages[i].text);
+        QCOMPARE(message.stroke.points, messages[i].stroke.points);
+        QCOMPARE(message.stroke.pen.strokeId, messages[i].stroke.pen.strokeId);
+        QCOMPARE(message.segment.to, messages[i].segment.to);
+        QCOMPARE(message.strokeLog, messages[i].strokeLog);
+    }
+}
+
+void TestSessionLog::replaysTheCanvas()
+{
+    const QString path = dir.filePath("replay.dgrec");
+    QCOMPARE(writeLog(path, sampleGame()), QString());
+
+    SessionLog::Reader log;
+    QVERIFY2(log.open(path), qPrintable(log.errorString()));
+    QCOMPARE(replayed(log), expectedCanvas());
+}
+
+// Everything a crash can leave behind the last whole record: part of a
+// header, a header without its frame, a frame missing its last bytes.
+void TestSessionLog::ignoresRecordCutShort_data()
+{
+    QTest::addColumn<int>("keep");
+
+    const int frameSize = Protocol::encodeFrame(Protocol::makeStroke(sampleStroke(9, Qt::red, 30, 0, 0)), 0).size();
+    QTest::newRow("header") << 5;
+    QTest::newRow("no frame") << SessionLog::kRecordHeaderSize;
+    QTest::newRow("frame header") << SessionLog::kRecordHeaderSize + Protocol::kFrameHeaderSize;
+    QTest::newRow("frame") << SessionLog::kRecordHeaderSize + frameSize - 1;
+}
+
+void TestSessionLog::ignoresRecordCutShort()
+{
+    QFETCH(int, keep);
+
+    const QString path = dir.filePath(QString("cut%1.dgrec").arg(keep));
+    const QList<Protocol::Message> messages = sampleGame();
+    QCOMPARE(writeLog(path, messages), QString());
+
+    // a wide red stroke across the canvas that would show if it were applied
+    const QByteArray frame = Protocol::encodeFrame(Protocol::makeStroke(sampleStroke(9, Qt::red, 30, 0, 0)), 0);
+    char header[SessionLog::kRecordHeaderSize];
+    qToLittleEndian<quint64>(quint64(60) * 1000 * 1000, header);
+    header[8] = char(SessionLog::Direction::In);
+    qToLittleEndian<quint32>(quint32(frame.size()), header + 9);
+    const QByteArray record = QByteArray(header, sizeof(header)) + frame;
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::Append));
+    QCOMPARE(file.write(record.left(keep)), qint64(keep));
+    file.close();
+
+    SessionLog::Reader log;
+    QVERIFY2(log.open(path), qPrintable(log.errorString()));
+    QCOMPARE(log.count(), messages.size());
+    QVERIFY(log.durationUsecs() < 60 * 1000 * 1000);
+    QCOMPARE(replayed(log), expectedCanvas());
+}
+
+void TestSessionLog::rejectsOtherFiles()
+{
+    const QString path = dir.filePath("other.png");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("\x89PNG\r\n\x1a\n and then some");
+    file.close();
+
+    SessionLog::Reader log;
+    QVERIFY(!log.open(path));
+    QVERIFY(!log.errorString().isEmpty());
+}
+
+// The canvas is a widget, but the test never shows it.
+int main(int argc, char *argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    TestSessionLog test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_sessionlog.moc"
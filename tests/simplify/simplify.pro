@@ -0,0 +1,20 @@
+QT = core gui network testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_simplify
+
+# Same rounding as the client, see untitled12.pro.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+include(../../shared.pri)
+
+SOURCES += \
+    tst_simplify.cpp \
+    ../../strokebatcher.cpp \
+    ../../strokeraster.cpp
+
+HEADERS += \
+    ../../strokebatcher.h \
+    ../../strokeraster.h
@@ -0,0 +1,202 @@
+#include "strokebatcher.h"
+#include "strokeraster.h"
+#include <QImage>
+#include <QRandomGenerator>
+#include <QtMath>
+#include <QtTest>
+
+// Simplified strokes against the samples they came from, as polylines and
+// as pixels: nothing may move further than the tolerance allows.
+class TestSimplify : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void staysWithinTolerance_data();
+    void staysWithinTolerance();
+    void rasterWithinTolerance_data();
+    void rasterWithinTolerance();
+    void smoothStrokesShrink();
+
+private:
+    static QVector<QPoint> makeStroke(int kind, quint32 seed);
+    static QVector<QPoint> simplified(const QVector<QPoint> &points, double tolerance);
+    static double distance(const QPointF &point, const QVector<QPoint> &polyline);
+    static double hausdorff(const QVector<QPoint> &a, const QVector<QPoint> &b);
+    static QImage render(const QVector<QPoint> &points, int width);
+    static int strayInk(const QImage &from, const QImage &to, int radius);
+};
+
+enum Kind { Arc, Wander, Zigzag };
+
+// Pointer samples as a mouse would report them, kept inside a 400x300
+// canvas with room for the widest pen.
+QVector<QPoint> TestSimplify::makeStroke(int kind, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    QVector<QPoint> points;
+    double x = 200;
+    double y = 150;
+    double angle = random.bounded(2 * M_PI);
+    const double phase = random.bounded(2 * M_PI);
+    for (int i = 0; i < 80; ++i) {
+        switch (kind) {
+        case Arc:
+            x = 200 + 100 * qCos(phase + i * 0.05);
+            y = 150 + 80 * qSin(phase + i * 0.05);
+            break;
+        case Wander:
+            angle += random.bounded(0.6) - 0.3;
+            x = qBound(20.0, x + 3 * qCos(angle), 380.0);
+            y = qBound(20.0, y + 3 * qSin(angle), 280.0);
+            break;
+        default:
+            x = qBound(20.0, x + random.bounded(25) - 12, 380.0);
+            y = qBound(20.0, y + random.bounded(25) - 12, 280.0);
+            break;
+        }
+        const QPoint point(qRound(x), qRound(y));
+        if (points.isEmpty() || points.last() != point)
+            points.append(point);
+    }
+    return points;
+}
+
+QVector<QPoint> TestSimplify::simplified(const QVector<QPoint> &points, double tolerance)
+{
+    QVector<QPoint> kept;
+    for (int index : StrokeBatcher::simplify(points, tolerance))
+        kept.append(points[index]);
+    return kept;
+}
+
+double TestSimplify::distance(const QPointF &point, const QVector<QPoint> &polyline)
+{
+    double best = qInf();
+    for (int i = 1; i < polyline.size(); ++i) {
+        const QPointF a = polyline[i - 1];
+        const QPointF d = QPointF(polyline[i]) - a;
+        const double length2 = QPointF::dotProduct(d, d);
+        const double t = length2 > 0 ? qBound(0.0, QPointF::dotProduct(point - a, d) / length2, 1.0) : 0.0;
+        const QPointF e = point - a - t * d;
+        best = qMin(best, qSqrt(QPointF::dotProduct(e, e)));
+    }
+    return best;
+}
+
+// Sampled every quarter pixel along a, the furthest any of it is from b.
+double TestSimplify::hausdorff(const QVector<QPoint> &a, const QVector<QPoint> &b)
+{
+    double worst = 0;
+    for (int i = 1; i < a.size(); ++i) {
+        const QPointF from = a[i - 1];
+        const QPointF to = a[i];
+        const int steps = qMax(1, int(4 * qSqrt(QPointF::dotProduct(to - from, to - from))));
+        for (int step = 0; step <= steps; ++step)
+            worst = qMax(worst, distance(from + (to - from) * step / steps, b));
+    }
+    return worst;
+}
+
+QImage TestSimplify::render(const QVector<QPoint> &points, int width)
+{
+    QImage image(400, 300, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    StrokeRaster::drawPolyline(&image, points.constData(), points.size(), qRgb(0, 0, 0), width);
+    return image;
+}
+
+// Inked pixels of one image with no inked pixel of the other within radius.
+int TestSimplify::strayInk(const QImage &from, const QImage &to, int radius)
+{
+    const auto inked = [](const QImage &image, int x, int y) { return qRed(image.pixel(x, y)) < 128; };
+    int stray = 0;
+    for (int y = 0; y < from.height(); ++y) {
+        for (int x = 0; x < from.width(); ++x) {
+            if (!inked(from, x, y))
+                continue;
+            bool found = false;
+            for (int dy = -radius; dy <= radius && !found; ++dy) {
+                for (int dx = -radius; dx <= radius && !found; ++dx) {
+                    const int nx = x + dx;
+                    const int ny = y + dy;
+                    found = nx >= 0 && ny >= 0 && nx < to.width() && ny < to.height() && inked(to, nx, ny);
+                }
+            }
+            if (!found)
+                stray++;
+        }
+    }
+    return stray;
+}
+
+void TestSimplify::staysWithinTolerance_data()
+{
+    QTest::addColumn<int>("kind");
+    QTest::addColumn<double>("tolerance");
+    for (double tolerance : {0.5, 1.0, 2.0}) {
+        QTest::newRow(qPrintable(QString("arc %1 px").arg(tolerance))) << int(Arc) << tolerance;
+        QTest::newRow(qPrintable(QString("wander %1 px").arg(tolerance))) << int(Wander) << tolerance;
+        QTest::newRow(qPrintable(QString("zigzag %1 px").arg(tolerance))) << int(Zigzag) << tolerance;
+    }
+}
+
+void TestSimplify::staysWithinTolerance()
+{
+    QFETCH(int, kind);
+    QFETCH(double, tolerance);
+
+    for (quint32 seed = 1; seed <= 50; ++seed) {
+        const QVector<QPoint> raw = makeStroke(kind, seed);
+        const QVector<QPoint> kept = simplified(raw, tolerance);
+        QCOMPARE(kept.first(), raw.first());
+        QCOMPARE(kept.last(), raw.last());
+        const double error = qMax(hausdorff(raw, kept), hausdorff(kept, raw));
+        QVERIFY2(error <= 1.5 * tolerance,
+                 qPrintable(QString("seed %1: %2 px off").arg(seed).arg(error)));
+    }
+}
+
+void TestSimplify::rasterWithinTolerance_data()
+{
+    QTest::addColumn<int>("kind");
+    QTest::addColumn<int>("width");
+    for (int width : {1, 3, 8}) {
+        QTest::newRow(qPrintable(QString("arc width %1").arg(width))) << int(Arc) << width;
+        QTest::newRow(qPrintable(QString("wander width %1").arg(width))) << int(Wander) << width;
+        QTest::newRow(qPrintable(QString("zigzag width %1").arg(width))) << int(Zigzag) << width;
+    }
+}
+
+// At the default tolerance the strokes may shift by 1.5 px, plus a pixel
+// for rounding to the grid.
+void TestSimplify::rasterWithinTolerance()
+{
+    QFETCH(int, kind);
+    QFETCH(int, width);
+
+    const double tolerance = StrokeBatcher::kDefaultTolerance;
+    const int radius = qCeil(1.5 * tolerance) + 1;
+    StrokeRaster::setBackend(StrokeRaster::Backend::Scalar);
+    for (quint32 seed = 1; seed <= 10; ++seed) {
+        const QVector<QPoint> raw = makeStroke(kind, seed);
+        const QImage expected = render(raw, width);
+        const QImage actual = render(simplified(raw, tolerance), width);
+        QCOMPARE(strayInk(expected, actual, radius), 0);
+        QCOMPARE(strayInk(actual, expected, radius), 0);
+    }
+}
+
+void TestSimplify::smoothStrokesShrink()
+{
+    for (quint32 seed = 1; seed <= 20; ++seed) {
+        const QVector<QPoint> raw = makeStroke(Arc, seed);
+        const QVector<QPoint> kept = simplified(raw, StrokeBatcher::kDefaultTolerance);
+        QVERIFY2(kept.size() * 2 <= raw.size(),
+                 qPrintable(QString("seed %1: %2 of %3 points kept").arg(seed).arg(kept.size()).arg(raw.size())));
+    }
+}
+
+QTEST_APPLESS_MAIN(TestSimplify)
+
+#include "tst_simplify.moc"
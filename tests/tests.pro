@@ -0,0 +1,7 @@
+# Unit tests; "make check" runs them.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    framedecoder \
+    sessionlog \
+    simplify
@@ -0,0 +1,196 @@
+#include "tilesync.h"
+#include "protocol.h"
+#include <QImage>
+#include <QtEndian>
+
+namespace TileSync {
+
+namespace {
+
+constexpr int kMaxTiles = 1 << 16;
+
+void writeSize(QByteArray &out, const QSize &size, int tileSize)
+{
+    Protocol::writeVarint(out, quint32(size.width()));
+    Protocol::writeVarint(out, quint32(size.height()));
+    Protocol::writeVarint(out, quint32(tileSize));
+}
+
+bool readSize(Protocol::Reader &reader, QSize *size, int *tileSize)
+{
+    quint32 width, height, tile;
+    if (!reader.readVarint(&width) || !reader.readVarint(&height) || !reader.readVarint(&tile))
+        return false;
+    if (width > 0x7FFF || height > 0x7FFF || tile == 0 || tile > 1024)
+        return false;
+    *size = QSize(int(width), int(height));
+    *tileSize = int(tile);
+    return columns(*size, *tileSize) * rows(*size, *tileSize) <= kMaxTiles;
+}
+
+void writeHash(QByteArray &out, quint64 hash)
+{
+    char bytes[8];
+    qToLittleEndian<quint64>(hash, bytes);
+    out.append(bytes, 8);
+}
+
+bool readHash(Protocol::Reader &reader, quint64 *hash)
+{
+    quint64 result = 0;
+    for (int shift = 0; shift < 64; shift += 8) {
+        quint8 byte;
+        if (!reader.readByte(&byte))
+            return false;
+        result |= quint64(byte) << shift;
+    }
+    *hash = result;
+    return true;
+}
+
+}
+
+int columns(const QSize &size, int tileSize)
+{
+    return (size.width() + tileSize - 1) / tileSize;
+}
+
+int rows(const QSize &size, int tileSize)
+{
+    return (size.height() + tileSize - 1) / tileSize;
+}
+
+QRect tileRect(const QSize &size, int index, int tileSize)
+{
+    const int cols = columns(size, tileSize);
+    if (cols == 0)
+        return QRect();
+    QRect rect((index % cols) * tileSize, (index / cols) * tileSize, tileSize, tileSize);
+    return rect.intersected(QRect(QPoint(0, 0), size));
+}
+
+// FNV-1a over whole pixels instead of bytes: deterministic across processes,
+// unlike qHash, and cheap enough to run on every dirty tile.
+quint64 hashTile(const QImage &image, const QRect &rect)
+{
+    quint64 hash = 0xcbf29ce484222325ULL;
+    hash = (hash ^ quint64(rect.width())) * 0x100000001b3ULL;
+    hash = (hash ^ quint64(rect.height())) * 0x100000001b3ULL;
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y)) + rect.left();
+        for (int x = 0; x < rect.width(); ++x)
+            hash = (hash ^ (line[x] & 0xFFFFFF)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+QByteArray encodeManifest(const Manifest &manifest)
+{
+    QByteArray out;
+    out.reserve(8 + manifest.hashes.size() * 8);
+    writeSize(out, manifest.size, manifest.tileSize);
+    for (quint64 hash : manifest.hashes)
+        writeHash(out, hash);
+    return out;
+}
+
+bool decodeManifest(const QByteArray &data, Manifest *manifest)
+{
+    Protocol::Reader reader(data.constData(), data.size());
+    if (!readSize(reader, &manifest->size, &manifest->tileSize))
+        return false;
+
+    const int count = columns(manifest->size, manifest->tileSize) * rows(manifest->size, manifest->tileSize);
+    if (reader.remaining() != count * 8)
+        return false;
+    manifest->hashes.resize(count);
+    for (quint64 &hash : manifest->hashes)
+        readHash(reader, &hash);
+    return true;
+}
+
+QByteArray encodeRequest(const Request &request)
+{
+    QByteArray out;
+    Protocol::writeVarint(out, request.id);
+    Protocol::writeVarint(out, quint32(request.indices.size()));
+    for (int index : request.indices)
+        Protocol::writeVarint(out, quint32(index));
+    return out;
+}
+
+bool decodeRequest(const QByteArray &data, Request *request)
+{
+    Protocol::Reader reader(data.constData(), data.size());
+    quint32 count;
+    if (!reader.readVarint(&request->id) || !reader.readVarint(&count) || count > quint32(reader.remaining()))
+        return false;
+
+    request->indices.resize(int(count));
+    for (int &index : request->indices) {
+        quint32 value;
+        if (!reader.readVarint(&value) || value >= kMaxTiles)
+            return false;
+        index = int(value);
+    }
+    return reader.atEnd();
+}
+
+QByteArray encodeTileSet(const TileSet &set)
+{
+    QByteArray out;
+    Protocol::writeVarint(out, set.id);
+    writeSize(out, set.size, set.tileSize);
+    Protocol::writeVarint(out, quint32(set.tiles.size()));
+    for (const Tile &tile : set.tiles) {
+        Protocol::writeVarint(out, quint32(tile.index));
+        writeHash(out, tile.hash);
+        Protocol::writeVarint(out, quint32(tile.data.size()));
+        out += tile.data;
+    }
+    return out;
+}
+
+bool decodeTileSet(const QByteArray &data, TileSet *set)
+{
+    Protocol::Reader reader(data.constData(), data.size());
+    quint32 count;
+    if (!reader.readVarint(&set->id) || !readSize(reader, &set->size, &set->tileSize)
+        || !reader.readVarint(&count) || count > quint32(reader.remaining()))
+        return false;
+
+    const int total = columns(set->size, set->tileSize) * rows(set->size, set->tileSize);
+    set->tiles.resize(int(count));
+    for (Tile &tile : set->tiles) {
+        quint32 index, length;
+        if (!reader.readVarint(&index) || index >= quint32(total) || !readHash(reader, &tile.hash)
+            || !reader.readVarint(&length) || length > quint32(reader.remaining()))
+            return false;
+        tile.index = int(index);
+        const int offset = data.size() - reader.remaining();
+        tile.data = data.mid(offset, int(length));
+        reader.skip(int(length));
+    }
+    return reader.atEnd();
+}
+
+bool requestId(const QByteArray &data, quint32 *id)
+{
+    Protocol::Reader reader(data.constData(), data.size());
+    return reader.readVarint(id);
+}
+
+QByteArray withRequestId(const QByteArray &data, quint32 id)
+{
+    Protocol::Reader reader(data.constData(), data.size());
+    quint32 oldId;
+    if (!reader.readVarint(&oldId))
+        return QByteArray();
+
+    QByteArray out;
+    Protocol::writeVarint(out, id);
+    out.append(data.constData() + (data.size() - reader.remaining()), reader.remaining());
+    return out;
+}
+
+}
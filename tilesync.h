@@ -0,0 +1,63 @@
+#ifndef TILESYNC_H
+#define TILESYNC_H
+
+#include <QByteArray>
+#include <QSize>
+#include <QRect>
+#include <QVector>
+
+class QImage;
+
+// Incremental canvas snapshots. The canvas is cut into kTileSize squares,
+// each identified by a content hash. The drawer publishes the hashes
+// (TILE_HASHES), a receiver asks only for the tiles whose hash differs from
+// its own (REQUEST_TILES) and the drawer answers with those tiles as small
+// images, PNG or QOI (TILES). The room routes the answer back by request id.
+namespace TileSync {
+
+constexpr int kTileSize = 64;
+
+struct Manifest {
+    QSize size;
+    int tileSize = kTileSize;
+    QVector<quint64> hashes;
+};
+
+struct Request {
+    quint32 id = 0;
+    QVector<int> indices;
+};
+
+struct Tile {
+    int index = 0;
+    quint64 hash = 0;
+    QByteArray data;    // SnapshotCodec encoded
+};
+
+struct TileSet {
+    quint32 id = 0;
+    QSize size;
+    int tileSize = kTileSize;
+    QVector<Tile> tiles;
+};
+
+int columns(const QSize &size, int tileSize = kTileSize);
+int rows(const QSize &size, int tileSize = kTileSize);
+QRect tileRect(const QSize &size, int index, int tileSize = kTileSize);
+quint64 hashTile(const QImage &image, const QRect &rect);
+
+QByteArray encodeManifest(const Manifest &manifest);
+bool decodeManifest(const QByteArray &data, Manifest *manifest);
+QByteArray encodeRequest(const Request &request);
+bool decodeRequest(const QByteArray &data, Request *request);
+QByteArray encodeTileSet(const TileSet &set);
+bool decodeTileSet(const QByteArray &data, TileSet *set);
+
+// REQUEST_TILES and TILES payloads start with the request id, so the room
+// can route them without decoding the rest.
+bool requestId(const QByteArray &data, quint32 *id);
+QByteArray withRequestId(const QByteArray &data, quint32 id);
+
+}
+
+#endif // TILESYNC_H
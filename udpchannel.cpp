@@ -0,0 +1,53 @@
+#include "udpchannel.h"
+#include <QtEndian>
+
+namespace UdpChannel {
+
+QByteArray encodeDatagram(quint32 token, quint32 sequence, const QByteArray &frame)
+{
+    QByteArray out(kHeaderSize, Qt::Uninitialized);
+    qToLittleEndian<quint16>(kMagic, out.data());
+    qToLittleEndian<quint32>(token, out.data() + 2);
+    qToLittleEndian<quint32>(sequence, out.data() + 6);
+    out += frame;
+    return out;
+}
+
+bool decodeDatagram(const QByteArray &datagram, quint32 *token, quint32 *sequence,
+                    Protocol::Message *message)
+{
+    if (datagram.size() < kHeaderSize || qFromLittleEndian<quint16>(datagram.constData()) != kMagic)
+        return false;
+
+    *token = qFromLittleEndian<quint32>(datagram.constData() + 2);
+    *sequence = qFromLittleEndian<quint32>(datagram.constData() + 6);
+    *message = Protocol::Message();
+    if (datagram.size() == kHeaderSize)
+        return true;
+
+    const char *frame = datagram.constData() + kHeaderSize;
+    const int frameSize = datagram.size() - kHeaderSize;
+    if (frameSize < Protocol::kFrameHeaderSize)
+        return false;
+    Protocol::FrameHeader header = Protocol::decodeFrameHeader(frame);
+    if (header.length != frameSize - Protocol::kFrameHeaderSize)
+        return false;
+    return Protocol::decodeFramePayload(header.type, frame + Protocol::kFrameHeaderSize,
+                                        header.length, message);
+}
+
+QString makeOffer(quint16 port, quint32 token)
+{
+    return QString("%1:%2").arg(port).arg(token);
+}
+
+bool parseOffer(const QString &text, quint16 *port, quint32 *token)
+{
+    bool portOk = false;
+    bool tokenOk = false;
+    *port = text.section(':', 0, 0).toUShort(&portOk);
+    *token = text.section(':', 1, 1).toUInt(&tokenOk);
+    return portOk && tokenOk && *port != 0 && *token != 0;
+}
+
+}
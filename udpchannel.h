@@ -0,0 +1,36 @@
+#ifndef UDPCHANNEL_H
+#define UDPCHANNEL_H
+
+#include <QByteArray>
+#include <QString>
+#include "protocol.h"
+
+// Optional unreliable side channel for live strokes. The room server offers
+// it over TCP with "UDP:port:token"; the client then sends a hello datagram
+// from its own socket, the server learns the client's endpoint from it and
+// answers with an empty datagram. From then on STROKE frames travel as
+//
+//     magic:u16 LE | token:u32 LE | sequence:u32 LE | binary frame
+//
+// one frame per datagram, numbered per direction and endpoint starting at 1.
+// Hello and ack datagrams carry sequence 0 and no frame. Nothing is resent:
+// a receiver drops datagrams older than the last one it applied, and a gap
+// means strokes were lost, which it repairs with a snapshot over TCP.
+namespace UdpChannel {
+
+constexpr quint16 kMagic = 0x4744;     // "DG"
+constexpr int kHeaderSize = 10;
+constexpr int kMaxDatagramSize = 1200; // stays below common path MTUs
+
+QByteArray encodeDatagram(quint32 token, quint32 sequence, const QByteArray &frame = QByteArray());
+
+// An empty datagram decodes to a message of type Invalid.
+bool decodeDatagram(const QByteArray &datagram, quint32 *token, quint32 *sequence,
+                    Protocol::Message *message);
+
+QString makeOffer(quint16 port, quint32 token);
+bool parseOffer(const QString &text, quint16 *port, quint32 *token);
+
+}
+
+#endif // UDPCHANNEL_H
@@ -0,0 +1,118 @@
+#include "udprelay.h"
+#include "udpchannel.h"
+#include <QUdpSocket>
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+
+UdpRelay::UdpRelay(QObject *parent)
+    : QObject(parent),
+      socket(new QUdpSocket(this))
+{
+    connect(socket, &QUdpSocket::readyRead, this, &UdpRelay::readDatagrams);
+}
+
+bool UdpRelay::bind(const QHostAddress &address)
+{
+    return socket->bind(address, 0);
+}
+
+quint16 UdpRelay::port() const
+{
+    return socket->localPort();
+}
+
+UdpRelay::Stats UdpRelay::takeStats()
+{
+    Stats taken = stats;
+    stats = Stats();
+    return taken;
+}
+
+quint32 UdpRelay::addSession(PeerSession *session)
+{
+    quint32 token = tokens.value(session);
+    if (token)
+        return token;
+
+    do {
+        token = QRandomGenerator::global()->generate();
+    } while (token == 0 || peers.contains(token));
+
+    Peer peer;
+    peer.session = session;
+    peers.insert(token, peer);
+    tokens.insert(session, token);
+    return token;
+}
+
+void UdpRelay::removeSession(PeerSession *session)
+{
+    peers.remove(tokens.take(session));
+}
+
+bool UdpRelay::hasEndpoint(PeerSession *session) const
+{
+    auto it = peers.constFind(tokens.value(session));
+    return it != peers.constEnd() && it->port != 0;
+}
+
+bool UdpRelay::send(PeerSession *session, const QByteArray &frame)
+{
+    const quint32 token = tokens.value(session);
+    auto it = peers.find(token);
+    if (it == peers.end() || it->port == 0 || frame.size() + UdpChannel::kHeaderSize > UdpChannel::kMaxDatagramSize)
+        return false;
+
+    const QByteArray datagram = UdpChannel::encodeDatagram(token, ++it->sendSequence, frame);
+    if (socket->writeDatagram(datagram, it->address, it->port) != datagram.size())
+        return false;
+    stats.sent++;
+    return true;
+}
+
+void UdpRelay::readDatagrams()
+{
+    while (socket->hasPendingDatagrams()) {
+        const QNetworkDatagram datagram = socket->receiveDatagram();
+        quint32 token, sequence;
+        Protocol::Message message;
+        if (!UdpChannel::decodeDatagram(datagram.data(), &token, &sequence, &message))
+            continue;
+
+        auto it = peers.find(token);
+        if (it == peers.end())
+            continue;
+
+        // The endpoint may change under NAT, so the sender of the latest
+        // accepted datagram wins. A hello only sets it when there is none
+        // yet, and a replayed or stale datagram never moves it.
+        Peer &peer = *it;
+        if (message.type == Protocol::MessageType::Invalid) {
+            if (peer.port == 0) {
+                peer.address = datagram.senderAddress();
+                peer.port = quint16(datagram.senderPort());
+            }
+            socket->writeDatagram(UdpChannel::encodeDatagram(token, 0), datagram.senderAddress(),
+                                  quint16(datagram.senderPort()));
+            continue;
+        }
+
+        if (sequence <= peer.receiveSequence) {
+            stats.stale++;
+            continue;
+        }
+        peer.address = datagram.senderAddress();
+        peer.port = quint16(datagram.senderPort());
+        PeerSession *session = peer.session;
+        const quint32 gap = sequence - peer.receiveSequence - 1;
+        peer.receiveSequence = sequence;
+        stats.received++;
+        if (gap > 0) {
+            stats.lost += gap;
+            emit strokesLost(session);
+        }
+
+        if (message.type == Protocol::MessageType::Stroke || message.type == Protocol::MessageType::Draw)
+            emit messageReceived(session, message);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef UDPRELAY_H
+#define UDPRELAY_H
+
+#include <QObject>
+#include <QHash>
+#include <QHostAddress>
+#include "peersession.h"
+
+class QUdpSocket;
+
+// Server end of the UDP stroke channel (see udpchannel.h), one per room
+// worker and living in its thread. Every session of the worker's rooms gets
+// a token; once the client's hello arrives the relay knows where to send
+// its datagrams. Incoming strokes are handed to the worker like messages
+// read from TCP, and a sequence gap is reported so the room can resync the
+// receivers of the lost strokes.
+class UdpRelay : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        quint64 received = 0;
+        quint64 sent = 0;
+        quint64 lost = 0;
+        quint64 stale = 0;
+    };
+
+    explicit UdpRelay(QObject *parent = nullptr);
+
+    bool bind(const QHostAddress &address);
+    quint16 port() const;
+    Stats takeStats();
+
+    quint32 addSession(PeerSession *session);
+    void removeSession(PeerSession *session);
+    bool hasEndpoint(PeerSession *session) const;
+
+    // Returns false when the frame has to go over TCP instead: no endpoint
+    // yet or too large for one datagram.
+    bool send(PeerSession *session, const QByteArray &frame);
+
+signals:
+    void messageReceived(PeerSession *session, const Protocol::Message &message);
+    void strokesLost(PeerSession *session);
+
+private slots:
+    void readDatagrams();
+
+private:
+    struct Peer {
+        PeerSession *session = nullptr;
+        QHostAddress address;
+        quint16 port = 0;
+        quint32 sendSequence = 0;
+        quint32 receiveSequence = 0;
+    };
+
+    QUdpSocket *socket;
+    QHash<quint32, Peer> peers;
+    QHash<PeerSession *, quint32> tokens;
+    Stats stats;
+};
+
+#endif // UDPRELAY_H
@@ -1,24 +1,24 @@
-QT += core gui network widgets
+QT += core gui network widgets concurrent
 
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
+# StrokeRaster's scalar and SSE2 paths must round identically so canvas tile
+# hashes match between peers; FMA contraction would break that.
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(shared.pri)
+include(client.pri)
+
 SOURCES += \
-    drawgame.cpp \
     main.cpp
 
-HEADERS += \
-    drawgame.h
-
-FORMS += \
-    drawgame.ui
-
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
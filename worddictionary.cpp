@@ -0,0 +1,263 @@
+#include "worddictionary.h"
+#include <QHash>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+
+WordDictionary::~WordDictionary()
+{
+    close();
+}
+
+void WordDictionary::close()
+{
+    if (map)
+        file.unmap(map);
+    map = nullptr;
+    file.close();
+    built.clear();
+    entries = categoryTable = strings = nullptr;
+    stringsSize = 0;
+    wordCount = categories = 0;
+}
+
+void WordDictionary::setWords(const QStringList &words)
+{
+    QVector<Word> list;
+    list.reserve(words.size());
+    for (const QString &text : words) {
+        Word word;
+        word.text = text;
+        list.append(word);
+    }
+
+    close();
+    built = build(list);
+    attach(reinterpret_cast<const uchar *>(built.constData()), built.size());
+}
+
+bool WordDictionary::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    map = file.map(0, file.size());
+    if (!map) {
+        error = file.errorString();
+        return false;
+    }
+    if (!attach(map, file.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool WordDictionary::attach(const uchar *bytes, qint64 size)
+{
+    if (size < kHeaderSize || std::memcmp(bytes, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a word dictionary";
+        return false;
+    }
+    const quint32 count = qFromLittleEndian<quint32>(bytes + 8);
+    const quint32 categoryEntries = qFromLittleEndian<quint32>(bytes + 12);
+    const quint32 textSize = qFromLittleEndian<quint32>(bytes + 16);
+    const qint64 expected = kHeaderSize + qint64(count) * kEntrySize + qint64(categoryEntries) * kCategorySize
+                            + textSize;
+    if (count > quint32(INT_MAX) || categoryEntries > 256 || size < expected) {
+        error = "truncated word dictionary";
+        return false;
+    }
+
+    entries = bytes + kHeaderSize;
+    categoryTable = entries + qint64(count) * kEntrySize;
+    strings = categoryTable + qint64(categoryEntries) * kCategorySize;
+    stringsSize = textSize;
+    wordCount = int(count);
+    categories = int(categoryEntries);
+    return true;
+}
+
+// Entries pointing outside the strings block decode as empty.
+QString WordDictionary::word(int index) const
+{
+    if (index < 0 || index >= wordCount)
+        return QString();
+    const quint32 offset = qFromLittleEndian<quint32>(entry(index));
+    const quint16 length = qFromLittleEndian<quint16>(entry(index) + 4);
+    if (quint64(offset) + length > stringsSize)
+        return QString();
+    return QString::fromUtf8(reinterpret_cast<const char *>(strings + offset), length);
+}
+
+int WordDictionary::category(int index) const
+{
+    return index >= 0 && index < wordCount ? entry(index)[6] : -1;
+}
+
+int WordDictionary::difficulty(int index) const
+{
+    return index >= 0 && index < wordCount ? entry(index)[7] : -1;
+}
+
+QString WordDictionary::categoryName(int category) const
+{
+    if (category < 0 || category >= categories)
+        return QString();
+    const uchar *record = categoryTable + qint64(category) * kCategorySize;
+    const quint32 offset = qFromLittleEndian<quint32>(record);
+    const quint16 length = qFromLittleEndian<quint16>(record + 4);
+    if (quint64(offset) + length > stringsSize)
+        return QString();
+    return QString::fromUtf8(reinterpret_cast<const char *>(strings + offset), length);
+}
+
+// Words without a category get category 0, named "".
+QByteArray WordDictionary::build(const QVector<Word> &words)
+{
+    QStringList categoryNames;
+    categoryNames.append(QString());
+    QHash<QString, int> categoryIndex;
+    categoryIndex.insert(QString(), 0);
+
+    QByteArray table;
+    QByteArray text;
+    for (const Word &word : words) {
+        int category = categoryIndex.value(word.category, -1);
+        if (category < 0) {
+            category = categoryNames.size() < 256 ? categoryNames.size() : 0;
+            if (category) {
+                categoryIndex.insert(word.category, category);
+                categoryNames.append(word.category);
+            }
+        }
+        const QByteArray utf8 = word.text.toUtf8().left(0xFFFF);
+        char record[kEntrySize];
+        qToLittleEndian<quint32>(quint32(text.size()), record);
+        qToLittleEndian<quint16>(quint16(utf8.size()), record + 4);
+        record[6] = char(category);
+        record[7] = char(qBound(0, word.difficulty, 255));
+        table.append(record, kEntrySize);
+        text += utf8;
+    }
+
+    QByteArray categoryRecords;
+    for (const QString &name : qAsConst(categoryNames)) {
+        const QByteArray utf8 = name.toUtf8().left(0xFFFF);
+        char record[kCategorySize] = {};
+        qToLittleEndian<quint32>(quint32(text.size()), record);
+        qToLittleEndian<quint16>(quint16(utf8.size()), record + 4);
+        categoryRecords.append(record, kCategorySize);
+        text += utf8;
+    }
+
+    char header[kHeaderSize];
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(quint32(words.size()), header + 8);
+    qToLittleEndian<quint32>(quint32(categoryNames.size()), header + 12);
+    qToLittleEndian<quint32>(quint32(text.size()), header + 16);
+
+    QByteArray out(header, kHeaderSize);
+    out += table;
+    out += categoryRecords;
+    out += text;
+    return out;
+}
+
+bool WordDictionary::compile(const QString &source, const QString &target, QString *error)
+{
+    QFile input(source);
+    if (!input.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = input.errorString();
+        return false;
+    }
+
+    QVector<Word> words;
+    QTextStream stream(&input);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    stream.setCodec("UTF-8");
+#endif
+    QString line;
+    while (stream.readLineInto(&line)) {
+        line = line.trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        const QStringList fields = line.split('\t');
+        Word word;
+        word.text = fields.at(0).trimmed();
+        word.category = fields.value(1).trimmed();
+        word.difficulty = fields.value(2).trimmed().toInt();
+        if (!word.text.isEmpty())
+            words.append(word);
+    }
+
+    QSaveFile output(target);
+    if (!output.open(QIODevice::WriteOnly)) {
+        *error = output.errorString();
+        return false;
+    }
+    output.write(build(words));
+    if (!output.commit()) {
+        *error = output.errorString();
+        return false;
+    }
+    return true;
+}
+
+WordSampler::WordSampler(int count)
+{
+    reset(count);
+}
+
+void WordSampler::reset(int count)
+{
+    size = quint32(qMax(0, count));
+    halfBits = 1;
+    while ((quint64(1) << (2 * halfBits)) < size)
+        halfBits++;
+    domain = quint32(quint64(1) << (2 * halfBits)) - 1;    // last value of the range
+    reshuffle();
+}
+
+void WordSampler::reshuffle()
+{
+    position = 0;
+    for (quint32 &key : keys)
+        key = QRandomGenerator::global()->generate();
+}
+
+quint32 WordSampler::permute(quint32 value) const
+{
+    const quint32 mask = (quint32(1) << halfBits) - 1;
+    quint32 left = value >> halfBits;
+    quint32 right = value & mask;
+    for (quint32 key : keys) {
+        quint32 mixed = (right ^ key) * 0x9E3779B1u;
+        mixed ^= mixed >> 15;
+        const quint32 next = left ^ (mixed & mask);
+        left = right;
+        right = next;
+    }
+    return (left << halfBits) | right;
+}
+
+int WordSampler::next()
+{
+    if (size == 0)
+        return -1;
+    for (;;) {
+        const quint32 value = permute(position);
+        if (position == domain)
+            reshuffle();
+        else
+            position++;
+        if (value < size)
+            return int(value);
+    }
+}
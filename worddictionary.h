@@ -0,0 +1,101 @@
+#ifndef WORDDICTIONARY_H
+#define WORDDICTIONARY_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+// Read-only word list for the rooms, either built in memory from a
+// QStringList or mapped from a compiled file shared by every room of the
+// server:
+//
+//     "DGWORDS1" | count:u32 | categories:u32 | strings size:u32
+//     entry[count]:         offset:u32 | length:u16 | category:u8 | difficulty:u8
+//     category[categories]: offset:u32 | length:u16 | reserved:u16
+//     strings: UTF-8
+//
+// all little-endian, offsets relative to the strings block. Opening checks
+// only the header and table sizes, so it costs the same for any number of
+// words; a word is decoded when it is picked. Source files for compile()
+// hold one word per line, optionally followed by a tab, its category, a tab
+// and its difficulty (0-255); empty lines and lines starting with # are
+// skipped.
+class WordDictionary
+{
+public:
+    static constexpr char kMagic[8] = { 'D', 'G', 'W', 'O', 'R', 'D', 'S', '1' };
+    static constexpr int kHeaderSize = 20;
+    static constexpr int kEntrySize = 8;
+    static constexpr int kCategorySize = 8;
+
+    struct Word {
+        QString text;
+        QString category;
+        int difficulty = 0;
+    };
+
+    WordDictionary() = default;
+    ~WordDictionary();
+    WordDictionary(const WordDictionary &) = delete;
+    WordDictionary &operator=(const WordDictionary &) = delete;
+
+    void setWords(const QStringList &words);
+    bool open(const QString &path);
+    QString errorString() const { return error; }
+
+    int count() const { return wordCount; }
+    QString word(int index) const;
+    int category(int index) const;
+    int difficulty(int index) const;
+    int categoryCount() const { return categories; }
+    QString categoryName(int category) const;
+
+    static QByteArray build(const QVector<Word> &words);
+    static bool compile(const QString &source, const QString &target, QString *error);
+
+private:
+    bool attach(const uchar *bytes, qint64 size);
+    void close();
+    const uchar *entry(int index) const { return entries + qint64(index) * kEntrySize; }
+
+    QFile file;
+    uchar *map = nullptr;
+    QByteArray built;
+    const uchar *entries = nullptr;
+    const uchar *categoryTable = nullptr;
+    const uchar *strings = nullptr;
+    quint32 stringsSize = 0;
+    int wordCount = 0;
+    int categories = 0;
+    QString error;
+};
+
+// Hands out the indices 0..count-1 in a random order without repeats; a new
+// order starts once all were used. The order is a 4-round Feistel
+// permutation of the smallest power-of-four range covering count, with
+// indices past the end skipped (cycle walking, under four steps on
+// average), so it needs no table and next() neither allocates nor depends
+// on count.
+class WordSampler
+{
+public:
+    explicit WordSampler(int count = 0);
+
+    void reset(int count);
+    int next();     // -1 if count is 0
+
+private:
+    static constexpr int kRounds = 4;
+
+    void reshuffle();
+    quint32 permute(quint32 value) const;
+
+    quint32 size;
+    int halfBits;
+    quint32 domain;
+    quint32 position;
+    quint32 keys[kRounds];
+};
+
+#endif // WORDDICTIONARY_H